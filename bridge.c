@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 
 #include "netifd.h"
 #include "device.h"
@@ -96,6 +97,12 @@ static struct device_type bridge_device_type = {
 	.dump_info = bridge_dump_info,
 };
 
+struct bridge_fdb_queue {
+	struct bridge_fdb_entry *entries;
+	int n_entries;
+	int size;
+};
+
 struct bridge_state {
 	struct device dev;
 	device_state_cb set_state;
@@ -106,22 +113,74 @@ struct bridge_state {
 	bool active;
 	bool force_active;
 
+	/* failed members, ordered by retry deadline */
 	struct uloop_timeout retry;
+	struct list_head retry_members;
 	struct bridge_member *primary_port;
 	struct vlist_tree members;
 	int n_present;
-	int n_failed;
+
+	/* static fdb/mdb changes, programmed in one batch from fdb_timer */
+	struct uloop_timeout fdb_timer;
+	struct bridge_fdb_queue fdb_add;
+	struct bridge_fdb_queue fdb_del;
+	bool fdb_self_pending;
 };
 
 struct bridge_member {
 	struct vlist_node node;
 	struct bridge_state *bst;
 	struct device_user dev;
+	struct list_head batch;
 	uint16_t pvid;
 	bool present;
+	bool batch_pending;
+	bool fdb_pending;
+
+	/* see bridge_member_failed */
+	struct list_head retry;
+	bool retry_pending;
+	int retry_count;
+	int64_t retry_at;
+	const char *fail_reason;
+	int fail_error;
+
 	char name[];
 };
 
+#define BRIDGE_BATCH_MAX	32
+
+#define BRIDGE_RETRY_MIN	100
+#define BRIDGE_RETRY_MAX	10000
+
+static LIST_HEAD(bridge_batch);
+static int bridge_batch_depth;
+
+static void
+bridge_fdb_queue_add(struct bridge_fdb_queue *q, const struct bridge_fdb_entry *entry)
+{
+	if (q->n_entries == q->size) {
+		struct bridge_fdb_entry *entries;
+		int size = q->size ? q->size * 2 : 16;
+
+		entries = realloc(q->entries, size * sizeof(*entries));
+		if (!entries)
+			return;
+
+		q->entries = entries;
+		q->size = size;
+	}
+
+	q->entries[q->n_entries++] = *entry;
+}
+
+static void
+bridge_fdb_queue_free(struct bridge_fdb_queue *q)
+{
+	free(q->entries);
+	memset(q, 0, sizeof(*q));
+}
+
 static void
 bridge_reset_primary(struct bridge_state *bst)
 {
@@ -282,6 +341,17 @@ bridge_set_vlan_state(struct bridge_state *bst, struct bridge_vlan *vlan, bool a
 	}
 }
 
+static bool
+bridge_dequeue_member(struct bridge_member *bm)
+{
+	if (!bm->batch_pending)
+		return false;
+
+	list_del(&bm->batch);
+	bm->batch_pending = false;
+	return true;
+}
+
 static int
 bridge_disable_member(struct bridge_member *bm)
 {
@@ -291,6 +361,10 @@ bridge_disable_member(struct bridge_member *bm)
 	if (!bm->present)
 		return 0;
 
+	/* still queued for attachment, nothing was claimed yet */
+	if (bridge_dequeue_member(bm))
+		return 0;
+
 	vlist_for_each_element(&bst->dev.vlans, vlan, node)
 		bridge_set_member_vlan(bm, vlan, false);
 
@@ -321,6 +395,10 @@ bridge_enable_interface(struct bridge_state *bst)
 		bridge_set_local_vlans(bst, true);
 	}
 
+	bst->fdb_self_pending = true;
+	if (!avl_is_empty(&bst->dev.fdb.avl))
+		uloop_timeout_set(&bst->fdb_timer, 0);
+
 	bst->active = true;
 	return 0;
 }
@@ -336,55 +414,240 @@ bridge_disable_interface(struct bridge_state *bst)
 }
 
 static int
-bridge_enable_member(struct bridge_member *bm)
+bridge_claim_member(struct bridge_member *bm)
+{
+	/* Disable IPv6 for bridge members */
+	if (!(bm->dev.dev->settings.flags & DEV_OPT_IPV6)) {
+		bm->dev.dev->settings.ipv6 = 0;
+		bm->dev.dev->settings.flags |= DEV_OPT_IPV6;
+	}
+
+	return device_claim(&bm->dev);
+}
+
+static void
+bridge_member_added(struct bridge_member *bm)
 {
 	struct bridge_state *bst = bm->bst;
 	struct bridge_vlan *vlan;
+
+	bm->retry_count = 0;
+	bm->fail_reason = NULL;
+	bm->fail_error = 0;
+
+	/* the kernel dropped the static entries of the port when it left */
+	bm->fdb_pending = true;
+	if (!avl_is_empty(&bst->dev.fdb.avl))
+		uloop_timeout_set(&bst->fdb_timer, 0);
+
+	if (!bst->config.vlan_filtering)
+		return;
+
+	/* delete default VLAN 1 */
+	system_bridge_vlan(bm->dev.dev->ifname, 1, false, 0);
+
+	vlist_for_each_element(&bst->dev.vlans, vlan, node)
+		bridge_set_member_vlan(bm, vlan, true);
+}
+
+static int64_t
+bridge_time_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+bridge_retry_dequeue(struct bridge_member *bm)
+{
+	if (!bm->retry_pending)
+		return;
+
+	list_del(&bm->retry);
+	bm->retry_pending = false;
+}
+
+static void
+bridge_check_retry(struct bridge_state *bst)
+{
+	struct bridge_member *bm;
+	int64_t delay;
+
+	if (list_empty(&bst->retry_members)) {
+		uloop_timeout_cancel(&bst->retry);
+		return;
+	}
+
+	bm = list_first_entry(&bst->retry_members, struct bridge_member, retry);
+	delay = bm->retry_at - bridge_time_ms();
+	uloop_timeout_set(&bst->retry, delay > 0 ? delay : 0);
+}
+
+/*
+ * Put a member that could not be attached on the retry list of its bridge,
+ * with a deadline that backs off from BRIDGE_RETRY_MIN to BRIDGE_RETRY_MAX
+ * on repeated failures
+ */
+static void
+bridge_member_failed(struct bridge_member *bm, const char *reason, int error)
+{
+	struct bridge_state *bst = bm->bst;
+	struct bridge_member *cur;
+	int64_t delay = BRIDGE_RETRY_MIN;
+	int i;
+
+	bm->present = false;
+	bst->n_present--;
+	device_release(&bm->dev);
+
+	bm->fail_reason = reason;
+	bm->fail_error = error;
+	for (i = 0; i < bm->retry_count && delay < BRIDGE_RETRY_MAX; i++)
+		delay *= 2;
+	if (delay > BRIDGE_RETRY_MAX)
+		delay = BRIDGE_RETRY_MAX;
+	bm->retry_count++;
+	bm->retry_at = bridge_time_ms() + delay;
+
+	bridge_retry_dequeue(bm);
+	list_for_each_entry_reverse(cur, &bst->retry_members, retry)
+		if (cur->retry_at <= bm->retry_at)
+			break;
+
+	list_add(&bm->retry, &cur->retry);
+	bm->retry_pending = true;
+
+	bridge_check_retry(bst);
+}
+
+static int
+bridge_enable_member(struct bridge_member *bm)
+{
+	struct bridge_state *bst = bm->bst;
 	int ret;
 
 	if (!bm->present)
 		return 0;
 
 	ret = bridge_enable_interface(bst);
-	if (ret)
-		goto error;
-
-	/* Disable IPv6 for bridge members */
-	if (!(bm->dev.dev->settings.flags & DEV_OPT_IPV6)) {
-		bm->dev.dev->settings.ipv6 = 0;
-		bm->dev.dev->settings.flags |= DEV_OPT_IPV6;
+	if (ret) {
+		bridge_member_failed(bm, "bridge setup failed", ret);
+		return ret;
 	}
 
-	ret = device_claim(&bm->dev);
-	if (ret < 0)
-		goto error;
+	ret = bridge_claim_member(bm);
+	if (ret < 0) {
+		bridge_member_failed(bm, "device claim failed", ret);
+		return ret;
+	}
 
 	ret = system_bridge_addif(&bst->dev, bm->dev.dev);
 	if (ret < 0) {
 		D(DEVICE, "Bridge device %s could not be added\n", bm->dev.dev->ifname);
-		goto error;
+		bridge_member_failed(bm, "adding to bridge failed", ret);
+		return ret;
 	}
 
-	if (bst->config.vlan_filtering) {
-		/* delete default VLAN 1 */
-		system_bridge_vlan(bm->dev.dev->ifname, 1, false, 0);
+	bridge_member_added(bm);
+
+	device_set_present(&bst->dev, true);
+	device_broadcast_event(&bst->dev, DEV_EVENT_TOPO_CHANGE);
+
+	return 0;
+}
+
+/*
+ * Attach up to BRIDGE_BATCH_MAX queued members of the bridge of the first
+ * queued member with a single batch of netlink requests
+ */
+static void
+bridge_enable_batch(void)
+{
+	struct bridge_member *members[BRIDGE_BATCH_MAX], *bm, *tmp;
+	struct device *devs[BRIDGE_BATCH_MAX];
+	int results[BRIDGE_BATCH_MAX];
+	struct bridge_state *bst;
+	int i, n = 0, n_added = 0;
+	int ret;
 
-		vlist_for_each_element(&bst->dev.vlans, vlan, node)
-			bridge_set_member_vlan(bm, vlan, true);
+	bst = list_first_entry(&bridge_batch, struct bridge_member, batch)->bst;
+	list_for_each_entry_safe(bm, tmp, &bridge_batch, batch) {
+		if (bm->bst != bst)
+			continue;
+
+		bridge_dequeue_member(bm);
+		members[n++] = bm;
+		if (n == BRIDGE_BATCH_MAX)
+			break;
 	}
 
+	ret = bridge_enable_interface(bst);
+	for (i = 0; i < n; i++) {
+		bm = members[i];
+		if (ret) {
+			bridge_member_failed(bm, "bridge setup failed", ret);
+			continue;
+		}
+
+		if (bridge_claim_member(bm) < 0) {
+			bridge_member_failed(bm, "device claim failed", -1);
+			continue;
+		}
+
+		members[n_added] = bm;
+		devs[n_added++] = bm->dev.dev;
+	}
+
+	if (!n_added)
+		return;
+
+	system_bridge_addif_batch(&bst->dev, devs, results, n_added);
+
+	for (i = 0, n = 0; i < n_added; i++) {
+		bm = members[i];
+		if (results[i] < 0) {
+			D(DEVICE, "Bridge device %s could not be added\n", bm->dev.dev->ifname);
+			bridge_member_failed(bm, "adding to bridge failed", results[i]);
+			continue;
+		}
+
+		bridge_member_added(bm);
+		n++;
+	}
+
+	if (!n)
+		return;
+
 	device_set_present(&bst->dev, true);
 	device_broadcast_event(&bst->dev, DEV_EVENT_TOPO_CHANGE);
 
-	return 0;
+	/* see bridge_member_cb */
+	system_if_apply_settings(&bst->dev, &bst->dev.settings,
+				 DEV_OPT_MTU | DEV_OPT_MTU6);
+}
 
-error:
-	bst->n_failed++;
-	bm->present = false;
-	bst->n_present--;
-	device_release(&bm->dev);
+/*
+ * Between bridge_batch_begin() and bridge_batch_end(), members of active
+ * bridges that show up are queued instead of being attached one by one.
+ * Calls may nest, the queue is flushed by the outermost bridge_batch_end().
+ */
+void bridge_batch_begin(void)
+{
+	bridge_batch_depth++;
+}
 
-	return ret;
+void bridge_batch_end(void)
+{
+	if (--bridge_batch_depth > 0)
+		return;
+
+	device_lock();
+	while (!list_empty(&bridge_batch))
+		bridge_enable_batch();
+	device_unlock();
 }
 
 static void
@@ -395,7 +658,7 @@ bridge_remove_member(struct bridge_member *bm)
 	if (!bm->present)
 		return;
 
-	if (bst->dev.active)
+	if (!bridge_dequeue_member(bm) && bst->dev.active)
 		bridge_disable_member(bm);
 
 	bm->present = false;
@@ -418,6 +681,7 @@ bridge_free_member(struct bridge_member *bm)
 	struct device *dev = bm->dev.dev;
 
 	bridge_remove_member(bm);
+	bridge_retry_dequeue(bm);
 	device_remove_user(&bm->dev);
 
 	/*
@@ -435,15 +699,6 @@ bridge_free_member(struct bridge_member *bm)
 	free(bm);
 }
 
-static void
-bridge_check_retry(struct bridge_state *bst)
-{
-	if (!bst->n_failed)
-		return;
-
-	uloop_timeout_set(&bst->retry, 100);
-}
-
 static void
 bridge_member_cb(struct device_user *dev, enum device_event ev)
 {
@@ -459,7 +714,10 @@ bridge_member_cb(struct device_user *dev, enum device_event ev)
 
 		if (bst->n_present == 1)
 			device_set_present(&bst->dev, true);
-		if (bst->dev.active && !bridge_enable_member(bm)) {
+		if (bst->dev.active && bridge_batch_depth) {
+			list_add_tail(&bm->batch, &bridge_batch);
+			bm->batch_pending = true;
+		} else if (bst->dev.active && !bridge_enable_member(bm)) {
 			/*
 			 * Adding a bridge member can overwrite the bridge mtu
 			 * in the kernel, apply the bridge settings in case the
@@ -471,6 +729,9 @@ bridge_member_cb(struct device_user *dev, enum device_event ev)
 
 		break;
 	case DEV_EVENT_REMOVE:
+		/* retried once the device is back */
+		bridge_retry_dequeue(bm);
+
 		if (dev->hotplug) {
 			vlist_delete(&bst->members, &bm->node);
 			return;
@@ -515,10 +776,8 @@ bridge_set_up(struct bridge_state *bst)
 			return ret;
 	}
 
-	bst->n_failed = 0;
 	vlist_for_each_element(&bst->members, bm, node)
 		bridge_enable_member(bm);
-	bridge_check_retry(bst);
 
 	if (!bst->force_active && !bst->n_present) {
 		/* initialization of all member interfaces failed */
@@ -666,6 +925,11 @@ bridge_free(struct device *dev)
 	bst = container_of(dev, struct bridge_state, dev);
 	vlist_flush_all(&bst->members);
 	vlist_flush_all(&dev->vlans);
+	vlist_flush_all(&dev->fdb);
+	uloop_timeout_cancel(&bst->retry);
+	uloop_timeout_cancel(&bst->fdb_timer);
+	bridge_fdb_queue_free(&bst->fdb_add);
+	bridge_fdb_queue_free(&bst->fdb_del);
 	free(bst->config_data);
 	free(bst);
 }
@@ -675,7 +939,8 @@ bridge_dump_info(struct device *dev, struct blob_buf *b)
 {
 	struct bridge_state *bst;
 	struct bridge_member *bm;
-	void *list;
+	int64_t now = bridge_time_ms();
+	void *list, *t;
 
 	bst = container_of(dev, struct bridge_state, dev);
 
@@ -690,6 +955,23 @@ bridge_dump_info(struct device *dev, struct blob_buf *b)
 	}
 
 	blobmsg_close_array(b, list);
+
+	list = blobmsg_open_array(b, "bridge-members-failed");
+	vlist_for_each_element(&bst->members, bm, node) {
+		if (!bm->fail_reason || bm->present)
+			continue;
+
+		t = blobmsg_open_table(b, NULL);
+		blobmsg_add_string(b, "name", bm->dev.dev->ifname);
+		blobmsg_add_string(b, "reason", bm->fail_reason);
+		blobmsg_add_u32(b, "error", bm->fail_error);
+		blobmsg_add_u32(b, "retries", bm->retry_count);
+		if (bm->retry_pending)
+			blobmsg_add_u32(b, "retry_in",
+					bm->retry_at > now ? bm->retry_at - now : 0);
+		blobmsg_close_table(b, t);
+	}
+	blobmsg_close_array(b, list);
 }
 
 static void
@@ -707,7 +989,6 @@ bridge_config_init(struct device *dev)
 		device_set_present(&bst->dev, true);
 	}
 
-	bst->n_failed = 0;
 	vlist_update(&bst->members);
 	if (bst->ifnames) {
 		blobmsg_for_each_attr(cur, bst->ifnames, rem) {
@@ -730,6 +1011,7 @@ bridge_apply_settings(struct bridge_state *bst, struct blob_attr **tb)
 	struct blob_attr *cur;
 
 	/* defaults */
+	cfg->flags = 0;
 	cfg->stp = false;
 	cfg->forward_delay = 2;
 	cfg->robustness = 2;
@@ -807,18 +1089,23 @@ bridge_reload(struct device *dev, struct blob_attr *attr)
 	struct blob_attr *tb_dev[__DEV_ATTR_MAX];
 	struct blob_attr *tb_br[__BRIDGE_ATTR_MAX];
 	enum dev_change_type ret = DEV_CONFIG_APPLIED;
+	bool apply_dev = false, apply_br = false;
+	enum bridge_opt br_flags;
+	bool bridge_empty;
 	unsigned long diff;
 	struct bridge_state *bst;
 
 	BUILD_BUG_ON(sizeof(diff) < __BRIDGE_ATTR_MAX / 8);
-	BUILD_BUG_ON(sizeof(diff) < __DEV_ATTR_MAX / 8);
 
 	bst = container_of(dev, struct bridge_state, dev);
 	attr = blob_memdup(attr);
 
-	blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
+	br_flags = bst->config.flags;
+	bridge_empty = bst->config.bridge_empty;
+
+	blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
 		blob_data(attr), blob_len(attr));
-	blobmsg_parse(bridge_attrs, __BRIDGE_ATTR_MAX, tb_br,
+	blobmsg_parse_cached(bridge_attrs, __BRIDGE_ATTR_MAX, tb_br,
 		blob_data(attr), blob_len(attr));
 
 	if (tb_dev[DEV_ATTR_MACADDR])
@@ -831,49 +1118,94 @@ bridge_reload(struct device *dev, struct blob_attr *attr)
 	if (bst->config_data) {
 		struct blob_attr *otb_dev[__DEV_ATTR_MAX];
 		struct blob_attr *otb_br[__BRIDGE_ATTR_MAX];
+		int i;
 
-		blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
+		blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
 			blob_data(bst->config_data), blob_len(bst->config_data));
 
-		diff = 0;
-		uci_blob_diff(tb_dev, otb_dev, &device_attr_list, &diff);
-		if (diff)
+		/*
+		 * changed device settings are applied in place, only a setting
+		 * that was dropped from the config needs the bridge recreated to
+		 * get the kernel default back. The live settings cannot be used
+		 * for this, they also carry runtime state such as the macaddr
+		 * inherited from the primary port.
+		 */
+		for (i = 0; i < __DEV_ATTR_MAX; i++)
+			if (otb_dev[i] && !tb_dev[i])
+				break;
+
+		if (i < __DEV_ATTR_MAX)
 		    ret = DEV_CONFIG_RESTART;
+		else if (uci_blob_diff(tb_dev, otb_dev, &device_attr_list, NULL))
+		    apply_dev = true;
 
-		blobmsg_parse(bridge_attrs, __BRIDGE_ATTR_MAX, otb_br,
+		blobmsg_parse_cached(bridge_attrs, __BRIDGE_ATTR_MAX, otb_br,
 			blob_data(bst->config_data), blob_len(bst->config_data));
 
+		/*
+		 * stp, timers, priority and multicast options are writable on a
+		 * live bridge. vlan_filtering changes how members and vlans are
+		 * set up, and unset timers or an emptied bridge_empty cannot be
+		 * reverted in place.
+		 */
 		diff = 0;
 		uci_blob_diff(tb_br, otb_br, &bridge_attr_list, &diff);
-		if (diff & ~(1 << BRIDGE_ATTR_IFNAME))
+		if ((diff & (1 << BRIDGE_ATTR_VLAN_FILTERING)) ||
+		    (br_flags & ~bst->config.flags) ||
+		    (bridge_empty && !bst->config.bridge_empty))
 		    ret = DEV_CONFIG_RESTART;
+		else if (diff & ~(1 << BRIDGE_ATTR_IFNAME))
+		    apply_br = true;
 
 		bridge_config_init(dev);
 	}
 
+	if (ret == DEV_CONFIG_APPLIED && bst->active) {
+		if (apply_br) {
+			D(DEVICE, "Bridge '%s': applying bridge options in place\n", dev->ifname);
+			system_bridge_set_config(dev, &bst->config);
+		}
+
+		if (apply_dev)
+			system_if_apply_settings(dev, &dev->settings, dev->settings.flags);
+	}
+
 	free(bst->config_data);
 	bst->config_data = attr;
 	return ret;
 }
 
+/* only looks at failed members whose retry deadline has passed */
 static void
 bridge_retry_members(struct uloop_timeout *timeout)
 {
 	struct bridge_state *bst = container_of(timeout, struct bridge_state, retry);
 	struct bridge_member *bm;
+	int64_t now = bridge_time_ms();
+	LIST_HEAD(due);
 
-	bst->n_failed = 0;
-	vlist_for_each_element(&bst->members, bm, node) {
-		if (bm->present)
-			continue;
+	while (!list_empty(&bst->retry_members)) {
+		bm = list_first_entry(&bst->retry_members, struct bridge_member, retry);
+		if (bm->retry_at > now)
+			break;
+
+		list_move_tail(&bm->retry, &due);
+	}
 
-		if (!bm->dev.dev->present)
+	while (!list_empty(&due)) {
+		bm = list_first_entry(&due, struct bridge_member, retry);
+		list_del(&bm->retry);
+		bm->retry_pending = false;
+
+		if (bm->present || !bm->dev.dev->present)
 			continue;
 
 		bm->present = true;
 		bst->n_present++;
 		bridge_enable_member(bm);
 	}
+
+	bridge_check_retry(bst);
 }
 
 static int bridge_avl_cmp_u16(const void *k1, const void *k2, void *ptr)
@@ -929,6 +1261,100 @@ out:
 	free(vlan_old);
 }
 
+static bool
+bridge_fdb_port_ready(struct bridge_state *bst, const char *port)
+{
+	struct bridge_member *bm;
+
+	if (!port[0])
+		return true;
+
+	bm = vlist_find(&bst->members, port, bm, node);
+
+	return bm && bm->present && !bm->batch_pending;
+}
+
+/*
+ * Program the static entries queued by config changes, plus all entries of
+ * ports that (re)joined the bridge since the last run, as one batch each
+ * for deletions and additions
+ */
+static void
+bridge_fdb_sync(struct uloop_timeout *timeout)
+{
+	struct bridge_state *bst = container_of(timeout, struct bridge_state, fdb_timer);
+	struct bridge_fdb_queue *q = &bst->fdb_add;
+	struct bridge_member *bm;
+	struct bridge_fdb *fdb;
+	int i, n = 0;
+
+	if (!bst->active)
+		goto out;
+
+	if (bst->fdb_del.n_entries)
+		system_bridge_fdb_update(&bst->dev, bst->fdb_del.entries,
+					 bst->fdb_del.n_entries, false);
+
+	vlist_for_each_element(&bst->dev.fdb, fdb, node) {
+		if (!fdb->entry.port[0]) {
+			if (bst->fdb_self_pending)
+				bridge_fdb_queue_add(q, &fdb->entry);
+			continue;
+		}
+
+		bm = vlist_find(&bst->members, fdb->entry.port, bm, node);
+		if (bm && bm->fdb_pending)
+			bridge_fdb_queue_add(q, &fdb->entry);
+	}
+
+	/* ports that are not attached get their entries once they are */
+	for (i = 0; i < q->n_entries; i++)
+		if (bridge_fdb_port_ready(bst, q->entries[i].port))
+			q->entries[n++] = q->entries[i];
+
+	if (n)
+		system_bridge_fdb_update(&bst->dev, q->entries, n, true);
+
+out:
+	bst->fdb_self_pending = false;
+	vlist_for_each_element(&bst->members, bm, node)
+		bm->fdb_pending = false;
+
+	bst->fdb_add.n_entries = 0;
+	bst->fdb_del.n_entries = 0;
+}
+
+static int
+bridge_fdb_cmp(const void *k1, const void *k2, void *ptr)
+{
+	return memcmp(k1, k2, sizeof(struct bridge_fdb_entry));
+}
+
+static void
+bridge_fdb_update(struct vlist_tree *tree, struct vlist_node *node_new,
+		  struct vlist_node *node_old)
+{
+	struct bridge_state *bst = container_of(tree, struct bridge_state, dev.fdb);
+	struct bridge_fdb *fdb;
+
+	/* entries are keyed by all of their fields */
+	if (node_new && node_old) {
+		free(container_of(node_new, struct bridge_fdb, node));
+		return;
+	}
+
+	if (node_new) {
+		fdb = container_of(node_new, struct bridge_fdb, node);
+		bridge_fdb_queue_add(&bst->fdb_add, &fdb->entry);
+	} else {
+		fdb = container_of(node_old, struct bridge_fdb, node);
+		bridge_fdb_queue_add(&bst->fdb_del, &fdb->entry);
+		free(fdb);
+	}
+
+	uloop_timeout_set(&bst->fdb_timer, 0);
+}
+
 static struct device *
 bridge_create(const char *name, struct device_type *devtype,
 	struct blob_attr *attr)
@@ -950,6 +1376,7 @@ bridge_create(const char *name, struct device_type *devtype,
 
 	dev->config_pending = true;
 	bst->retry.cb = bridge_retry_members;
+	INIT_LIST_HEAD(&bst->retry_members);
 
 	bst->set_state = dev->set_state;
 	dev->set_state = bridge_set_state;
@@ -961,6 +1388,10 @@ bridge_create(const char *name, struct device_type *devtype,
 
 	vlist_init(&dev->vlans, bridge_avl_cmp_u16, bridge_vlan_update);
 
+	vlist_init(&dev->fdb, bridge_fdb_cmp, bridge_fdb_update);
+	dev->fdb.keep_old = true;
+	bst->fdb_timer.cb = bridge_fdb_sync;
+
 	bridge_reload(dev, attr);
 
 	return dev;
@@ -15,6 +15,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <arpa/inet.h>
+#include <netinet/ether.h>
 
 #include <uci.h>
 
@@ -25,6 +27,7 @@
 #include "proto.h"
 #include "wireless.h"
 #include "config.h"
+#include "shard.h"
 
 bool config_init = false;
 
@@ -172,6 +175,7 @@ config_parse_interface(struct uci_section *s, bool alias)
 error_free_config:
 	free(config);
 error:
+	str_release(iface->name);
 	free(iface);
 }
 
@@ -352,6 +356,95 @@ config_parse_vlan(struct device *dev, struct uci_section *s)
 	vlist_add(&dev->vlans, &vlan->node, &vlan->vid);
 }
 
+static void
+config_parse_bridge_fdb(struct device *dev, struct uci_section *s, bool mdb)
+{
+	enum {
+		BRFDB_ATTR_PORT,
+		BRFDB_ATTR_MAC,
+		BRFDB_ATTR_GROUP,
+		BRFDB_ATTR_VID,
+		BRFDB_ATTR_LOCAL,
+		BRFDB_ATTR_STICKY,
+		BRFDB_ATTR_PERMANENT,
+		__BRFDB_ATTR_MAX,
+	};
+	static const struct blobmsg_policy fdb_attrs[__BRFDB_ATTR_MAX] = {
+		[BRFDB_ATTR_PORT] = { "port", BLOBMSG_TYPE_STRING },
+		[BRFDB_ATTR_MAC] = { "mac", BLOBMSG_TYPE_STRING },
+		[BRFDB_ATTR_GROUP] = { "group", BLOBMSG_TYPE_STRING },
+		[BRFDB_ATTR_VID] = { "vlan", BLOBMSG_TYPE_INT32 },
+		[BRFDB_ATTR_LOCAL] = { "local", BLOBMSG_TYPE_BOOL },
+		[BRFDB_ATTR_STICKY] = { "sticky", BLOBMSG_TYPE_BOOL },
+		[BRFDB_ATTR_PERMANENT] = { "permanent", BLOBMSG_TYPE_BOOL },
+	};
+	static const struct uci_blob_param_list fdb_attr_list = {
+		.n_params = __BRFDB_ATTR_MAX,
+		.params = fdb_attrs,
+	};
+	struct blob_attr *tb[__BRFDB_ATTR_MAX];
+	struct blob_attr *cur;
+	struct bridge_fdb_entry entry;
+	struct bridge_fdb *fdb;
+	struct ether_addr *ea;
+	const char *addr;
+
+	blob_buf_init(&b, 0);
+	uci_to_blob(&b, s, &fdb_attr_list);
+	blobmsg_parse(fdb_attrs, __BRFDB_ATTR_MAX, tb, blob_data(b.head), blob_len(b.head));
+
+	cur = tb[mdb ? BRFDB_ATTR_GROUP : BRFDB_ATTR_MAC];
+	if (!cur)
+		return;
+
+	addr = blobmsg_get_string(cur);
+	memset(&entry, 0, sizeof(entry));
+
+	if ((cur = tb[BRFDB_ATTR_PORT]) != NULL) {
+		if (strlen(blobmsg_get_string(cur)) >= sizeof(entry.port))
+			return;
+
+		strcpy(entry.port, blobmsg_get_string(cur));
+	}
+
+	if ((cur = tb[BRFDB_ATTR_VID]) != NULL) {
+		if (blobmsg_get_u32(cur) > 4094)
+			return;
+
+		entry.vid = blobmsg_get_u32(cur);
+	}
+
+	if (mdb) {
+		entry.flags |= BRFDB_F_MDB;
+		if ((cur = tb[BRFDB_ATTR_PERMANENT]) && !blobmsg_get_bool(cur))
+			entry.flags |= BRFDB_F_TEMPORARY;
+
+		if (inet_pton(AF_INET, addr, &entry.addr.in) == 1)
+			entry.family = AF_INET;
+		else if (inet_pton(AF_INET6, addr, &entry.addr.in6) == 1)
+			entry.family = AF_INET6;
+	} else {
+		if ((cur = tb[BRFDB_ATTR_LOCAL]) && blobmsg_get_bool(cur))
+			entry.flags |= BRFDB_F_LOCAL;
+		if ((cur = tb[BRFDB_ATTR_STICKY]) && blobmsg_get_bool(cur))
+			entry.flags |= BRFDB_F_STICKY;
+	}
+
+	if (entry.family == AF_UNSPEC) {
+		ea = ether_aton(addr);
+		if (!ea)
+			return;
+
+		memcpy(entry.addr.lladdr, ea, sizeof(entry.addr.lladdr));
+	}
+
+	fdb = calloc(1, sizeof(*fdb));
+	if (!fdb)
+		return;
+
+	fdb->entry = entry;
+	vlist_add(&dev->fdb, &fdb->node, &fdb->entry);
+}
 
 static void
 config_init_vlans(void)
@@ -362,9 +455,12 @@ config_init_vlans(void)
 	device_vlan_update(false);
 	uci_foreach_element(&uci_network->sections, e) {
 		struct uci_section *s = uci_to_section(e);
+		bool vlan, mdb;
 		const char *name;
 
-		if (strcmp(s->type, "bridge-vlan") != 0)
+		vlan = !strcmp(s->type, "bridge-vlan");
+		mdb = !strcmp(s->type, "bridge-mdb");
+		if (!vlan && !mdb && strcmp(s->type, "bridge-fdb") != 0)
 			continue;
 
 		name = uci_lookup_option_string(uci_ctx, s, "device");
@@ -375,7 +471,10 @@ config_init_vlans(void)
 		if (!dev || !dev->vlans.update)
 			continue;
 
-		config_parse_vlan(dev, s);
+		if (vlan)
+			config_parse_vlan(dev, s);
+		else if (dev->fdb.update)
+			config_parse_bridge_fdb(dev, s, mdb);
 	}
 	device_vlan_update(true);
 }
@@ -409,6 +508,126 @@ config_init_package(const char *config)
 	return p;
 }
 
+static bool
+config_shard_match(struct uci_section *shard, const char *option,
+		   const char *val, bool prefix)
+{
+	struct uci_option *o;
+	struct uci_element *e;
+
+	o = uci_lookup_option(uci_ctx, shard, option);
+	if (!o || o->type != UCI_TYPE_LIST)
+		return false;
+
+	uci_foreach_element(&o->v.list, e) {
+		if (prefix ? !strncmp(val, e->name, strlen(e->name)) :
+			     !strcmp(val, e->name))
+			return true;
+	}
+
+	return false;
+}
+
+/* protocols that can receive prefixes to delegate downstream */
+static const char * const config_pd_protos[] = {
+	"dhcpv6", "6in4", "6rd", "6to4",
+};
+
+/*
+ * Delegated prefixes are only assigned by the coordinator, so interfaces
+ * that hand out or receive them have to stay there.
+ */
+static bool
+config_interface_uses_pd(struct uci_section *s, const char *proto)
+{
+	int i;
+
+	if (uci_lookup_option(uci_ctx, s, "ip6assign") ||
+	    uci_lookup_option(uci_ctx, s, "ip6prefix"))
+		return true;
+
+	for (i = 0; proto && i < ARRAY_SIZE(config_pd_protos); i++)
+		if (!strcmp(proto, config_pd_protos[i]))
+			return true;
+
+	return false;
+}
+
+static const char *
+__config_interface_shard(struct uci_section *s, const char *proto)
+{
+	struct uci_section *shard;
+	struct uci_element *e;
+	const char *name;
+
+	name = uci_lookup_option_string(uci_ctx, s, "shard");
+	if (name) {
+		shard = uci_lookup_section(uci_ctx, uci_network, name);
+		if (shard && !strcmp(shard->type, "shard"))
+			return name;
+
+		netifd_log_message(L_WARNING, "Interface '%s' refers to unknown shard '%s'\n",
+				   s->e.name, name);
+		return NULL;
+	}
+
+	uci_foreach_element(&uci_network->sections, e) {
+		shard = uci_to_section(e);
+
+		if (strcmp(shard->type, "shard"))
+			continue;
+
+		if (config_shard_match(shard, "prefix", s->e.name, true) ||
+		    (proto && config_shard_match(shard, "proto", proto, false)))
+			return shard->e.name;
+	}
+
+	return NULL;
+}
+
+/*
+ * An explicit 'option shard' wins, otherwise the first shard section
+ * whose prefix or proto list matches takes the interface. Interfaces
+ * using prefix delegation are refused and kept in the coordinator.
+ */
+static const char *
+config_interface_shard(struct uci_section *s)
+{
+	const char *shard, *proto;
+
+	proto = uci_lookup_option_string(uci_ctx, s, "proto");
+	shard = __config_interface_shard(s, proto);
+	if (!shard || !config_interface_uses_pd(s, proto))
+		return shard;
+
+	if (!netifd_shard)
+		netifd_log_message(L_WARNING, "Interface '%s' uses prefix delegation, "
+				   "keeping it out of shard '%s'\n", s->e.name, shard);
+
+	return NULL;
+}
+
+static bool
+config_interface_local(struct uci_section *s, bool alias)
+{
+	const char *shard;
+
+	/* aliases follow the interface they are stacked on */
+	if (alias) {
+		const char *parent = uci_lookup_option_string(uci_ctx, s, "interface");
+
+		s = parent ? uci_lookup_section(uci_ctx, uci_network, parent) : NULL;
+		if (!s)
+			return !netifd_shard;
+	}
+
+	shard = config_interface_shard(s);
+	if (!netifd_shard)
+		return !shard;
+
+	return shard && !strcmp(shard, netifd_shard);
+}
+
 static void
 config_init_interfaces(void)
 {
@@ -417,18 +636,35 @@ config_init_interfaces(void)
 	uci_foreach_element(&uci_network->sections, e) {
 		struct uci_section *s = uci_to_section(e);
 
-		if (!strcmp(s->type, "interface"))
+		if (!strcmp(s->type, "interface") && config_interface_local(s, false))
 			config_parse_interface(s, false);
 	}
 
 	uci_foreach_element(&uci_network->sections, e) {
 		struct uci_section *s = uci_to_section(e);
 
-		if (!strcmp(s->type, "alias"))
+		if (!strcmp(s->type, "alias") && config_interface_local(s, true))
 			config_parse_interface(s, true);
 	}
 }
 
+static void
+config_init_shards(void)
+{
+	struct uci_element *e;
+
+	shard_update_start();
+
+	uci_foreach_element(&uci_network->sections, e) {
+		struct uci_section *s = uci_to_section(e);
+
+		if (!strcmp(s->type, "shard"))
+			shard_add(s->e.name);
+	}
+
+	shard_update_complete();
+}
+
 static void
 config_init_ip(void)
 {
@@ -479,12 +715,22 @@ config_init_globals(void)
 {
 	struct uci_section *globals = uci_lookup_section(
 			uci_ctx, uci_network, "globals");
+	const char *start_batch;
+
+	interface_set_start_batch(0);
 	if (!globals)
 		return;
 
-	const char *ula_prefix = uci_lookup_option_string(
-			uci_ctx, globals, "ula_prefix");
-	interface_ip_set_ula_prefix(ula_prefix);
+	/* shard workers read the same globals, but leave the ULA prefix to the coordinator */
+	if (!netifd_shard) {
+		const char *ula_prefix = uci_lookup_option_string(
+				uci_ctx, globals, "ula_prefix");
+		interface_ip_set_ula_prefix(ula_prefix);
+	}
+
+	start_batch = uci_lookup_option_string(uci_ctx, globals, "start_batch");
+	if (start_batch)
+		interface_set_start_batch(strtoul(start_batch, NULL, 0));
 }
 
 static void
@@ -661,13 +907,17 @@ config_init_all(void)
 	device_lock();
 
 	device_reset_config();
-	config_init_devices();
+	if (!netifd_shard)
+		config_init_devices();
 	config_init_interfaces();
-	config_init_vlans();
+	if (!netifd_shard)
+		config_init_vlans();
 	config_init_ip();
-	config_init_rules();
 	config_init_globals();
-	config_init_wireless();
+	if (!netifd_shard) {
+		config_init_rules();
+		config_init_wireless();
+	}
 
 	config_init = false;
 	device_unlock();
@@ -680,5 +930,8 @@ config_init_all(void)
 	interface_start_pending();
 	wireless_start_pending();
 
+	if (!netifd_shard)
+		config_init_shards();
+
 	return ret;
 }
@@ -29,6 +29,7 @@
 #include "netifd.h"
 #include "system.h"
 #include "config.h"
+#include "shard.h"
 
 static struct list_head devtypes = LIST_HEAD_INIT(devtypes);
 static struct avl_tree devices;
@@ -58,6 +59,33 @@ static const struct blobmsg_policy dev_attrs[__DEV_ATTR_MAX] = {
 	[DEV_ATTR_SENDREDIRECTS] = { .name = "sendredirects", .type = BLOBMSG_TYPE_BOOL },
 	[DEV_ATTR_NEIGHLOCKTIME] = { .name = "neighlocktime", .type = BLOBMSG_TYPE_INT32 },
 	[DEV_ATTR_ISOLATE] = { .name = "isolate", .type = BLOBMSG_TYPE_BOOL },
+	[DEV_ATTR_RPS_CPUS] = { .name = "rps_cpus", .type = BLOBMSG_TYPE_STRING },
+	[DEV_ATTR_XPS_CPUS] = { .name = "xps_cpus", .type = BLOBMSG_TYPE_STRING },
+	[DEV_ATTR_RPS_FLOW_CNT] = { .name = "rps_flow_cnt", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_IRQ_AFFINITY] = { .name = "irq_affinity", .type = BLOBMSG_TYPE_STRING },
+	[DEV_ATTR_GRO] = { .name = "gro", .type = BLOBMSG_TYPE_BOOL },
+	[DEV_ATTR_GSO] = { .name = "gso", .type = BLOBMSG_TYPE_BOOL },
+	[DEV_ATTR_TSO] = { .name = "tso", .type = BLOBMSG_TYPE_BOOL },
+	[DEV_ATTR_LRO] = { .name = "lro", .type = BLOBMSG_TYPE_BOOL },
+	[DEV_ATTR_RX_RING] = { .name = "rx_ring", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_TX_RING] = { .name = "tx_ring", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_CHANNELS] = { .name = "channels", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_RX_USECS] = { .name = "rx_usecs", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_TX_USECS] = { .name = "tx_usecs", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_ADAPTIVE_RX] = { .name = "adaptive_rx", .type = BLOBMSG_TYPE_BOOL },
+	[DEV_ATTR_ADAPTIVE_TX] = { .name = "adaptive_tx", .type = BLOBMSG_TYPE_BOOL },
+	[DEV_ATTR_QDISC] = { .name = "qdisc", .type = BLOBMSG_TYPE_STRING },
+	[DEV_ATTR_QDISC_CHILD] = { .name = "qdisc_child", .type = BLOBMSG_TYPE_STRING },
+	[DEV_ATTR_QDISC_LIMIT] = { .name = "qdisc_limit", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_QDISC_TARGET] = { .name = "qdisc_target", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_QDISC_INTERVAL] = { .name = "qdisc_interval", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_QDISC_ECN] = { .name = "qdisc_ecn", .type = BLOBMSG_TYPE_BOOL },
+	[DEV_ATTR_QDISC_BANDWIDTH] = { .name = "qdisc_bandwidth", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_QDISC_MEMORY] = { .name = "qdisc_memory", .type = BLOBMSG_TYPE_INT32 },
+	[DEV_ATTR_XDP] = { .name = "xdp", .type = BLOBMSG_TYPE_STRING },
+	[DEV_ATTR_XDP_MODE] = { .name = "xdp_mode", .type = BLOBMSG_TYPE_STRING },
+	[DEV_ATTR_TC_INGRESS] = { .name = "tc_ingress", .type = BLOBMSG_TYPE_STRING },
+	[DEV_ATTR_TC_EGRESS] = { .name = "tc_egress", .type = BLOBMSG_TYPE_STRING },
 };
 
 const struct uci_blob_param_list device_attr_list = {
@@ -117,10 +145,13 @@ void device_vlan_update(bool done)
 		if (!dev->vlans.update)
 			continue;
 
-		if (!done)
+		if (!done) {
 			vlist_update(&dev->vlans);
-		else
+			vlist_update(&dev->fdb);
+		} else {
 			vlist_flush(&dev->vlans);
+			vlist_flush(&dev->fdb);
+		}
 	}
 }
 
@@ -176,7 +207,7 @@ simple_device_create(const char *name, struct device_type *devtype,
 	/* device type is unused for simple devices */
 	devtype = NULL;
 
-	blobmsg_parse(dev_attrs, __DEV_ATTR_MAX, tb, blob_data(attr), blob_len(attr));
+	blobmsg_parse_cached(dev_attrs, __DEV_ATTR_MAX, tb, blob_data(attr), blob_len(attr));
 	dev = device_get(name, true);
 	if (!dev)
 		return NULL;
@@ -203,6 +234,29 @@ struct device_type simple_device_type = {
 	.free = simple_device_free,
 };
 
+static void
+device_merge_ethtool_settings(struct device_settings *n, struct device_settings *s,
+			      struct device_settings *os)
+{
+	unsigned int sf = s->flags & DEV_OPT_ETHTOOL ? s->ethtool_flags : 0;
+	unsigned int of = os->ethtool_flags;
+
+#define MERGE(_flag, _field) \
+	n->_field = sf & _flag ? s->_field : os->_field
+	MERGE(DEV_ETHTOOL_RX_RING, rx_ring);
+	MERGE(DEV_ETHTOOL_TX_RING, tx_ring);
+	MERGE(DEV_ETHTOOL_CHANNELS, channels);
+	MERGE(DEV_ETHTOOL_RX_USECS, rx_usecs);
+	MERGE(DEV_ETHTOOL_TX_USECS, tx_usecs);
+	MERGE(DEV_ETHTOOL_ADAPTIVE_RX, adaptive_rx);
+	MERGE(DEV_ETHTOOL_ADAPTIVE_TX, adaptive_tx);
+#undef MERGE
+
+	n->offloads = (s->offloads & sf) | (os->offloads & ~sf);
+	n->ethtool_flags = sf | of;
+	n->ethtool_failed = s->ethtool_failed & sf;
+}
+
 void
 device_merge_settings(struct device *dev, struct device_settings *n)
 {
@@ -244,9 +298,194 @@ device_merge_settings(struct device *dev, struct device_settings *n)
 	n->unicast_flood = s->unicast_flood;
 	n->sendredirects = s->flags & DEV_OPT_SENDREDIRECTS ?
 		s->sendredirects : os->sendredirects;
+	n->rps_cpus = s->flags & DEV_OPT_RPS_CPUS ?
+		s->rps_cpus : os->rps_cpus;
+	n->xps_cpus = s->flags & DEV_OPT_XPS_CPUS ?
+		s->xps_cpus : os->xps_cpus;
+	n->rps_flow_cnt = s->flags & DEV_OPT_RPS_FLOW_CNT ?
+		s->rps_flow_cnt : os->rps_flow_cnt;
+	n->irq_affinity = s->flags & DEV_OPT_IRQ_AFFINITY ?
+		s->irq_affinity : os->irq_affinity;
+	device_merge_ethtool_settings(n, s, os);
+	n->qdisc = s->flags & DEV_OPT_QDISC ? s->qdisc : os->qdisc;
+	n->bpf = s->flags & DEV_OPT_BPF ? s->bpf : os->bpf;
 	n->flags = s->flags | os->flags | os->valid_flags;
 }
 
+static bool
+device_parse_cpumask(char **dest, const char *str)
+{
+	if (strcmp(str, "auto") != 0 &&
+	    (!*str || strspn(str, "0123456789abcdefABCDEF,") != strlen(str)))
+		return false;
+
+	free(*dest);
+	*dest = strdup(str);
+	return !!*dest;
+}
+
+static void
+device_init_ethtool_settings(struct device_settings *s, struct blob_attr **tb)
+{
+	static const struct {
+		int attr;
+		unsigned int flag;
+	} offloads[] = {
+		{ DEV_ATTR_GRO, DEV_ETHTOOL_GRO },
+		{ DEV_ATTR_GSO, DEV_ETHTOOL_GSO },
+		{ DEV_ATTR_TSO, DEV_ETHTOOL_TSO },
+		{ DEV_ATTR_LRO, DEV_ETHTOOL_LRO },
+	}, values[] = {
+		{ DEV_ATTR_RX_RING, DEV_ETHTOOL_RX_RING },
+		{ DEV_ATTR_TX_RING, DEV_ETHTOOL_TX_RING },
+		{ DEV_ATTR_CHANNELS, DEV_ETHTOOL_CHANNELS },
+		{ DEV_ATTR_RX_USECS, DEV_ETHTOOL_RX_USECS },
+		{ DEV_ATTR_TX_USECS, DEV_ETHTOOL_TX_USECS },
+	};
+	unsigned int *fields[] = {
+		&s->rx_ring, &s->tx_ring, &s->channels, &s->rx_usecs, &s->tx_usecs,
+	};
+	struct blob_attr *cur;
+	int i;
+
+	s->ethtool_flags = 0;
+	s->offloads = 0;
+
+	for (i = 0; i < ARRAY_SIZE(offloads); i++) {
+		if (!(cur = tb[offloads[i].attr]))
+			continue;
+
+		if (blobmsg_get_bool(cur))
+			s->offloads |= offloads[i].flag;
+		s->ethtool_flags |= offloads[i].flag;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(values); i++) {
+		if (!(cur = tb[values[i].attr]))
+			continue;
+
+		*fields[i] = blobmsg_get_u32(cur);
+		s->ethtool_flags |= values[i].flag;
+	}
+
+	if ((cur = tb[DEV_ATTR_ADAPTIVE_RX])) {
+		s->adaptive_rx = blobmsg_get_bool(cur);
+		s->ethtool_flags |= DEV_ETHTOOL_ADAPTIVE_RX;
+	}
+
+	if ((cur = tb[DEV_ATTR_ADAPTIVE_TX])) {
+		s->adaptive_tx = blobmsg_get_bool(cur);
+		s->ethtool_flags |= DEV_ETHTOOL_ADAPTIVE_TX;
+	}
+
+	if (s->ethtool_flags)
+		s->flags |= DEV_OPT_ETHTOOL;
+}
+
+static bool
+device_qdisc_kind_valid(const char *kind, bool child)
+{
+	return !strcmp(kind, "fq_codel") || !strcmp(kind, "cake") ||
+	       (!child && !strcmp(kind, "mq"));
+}
+
+static bool
+device_init_qdisc(struct device_qdisc *q, struct blob_attr **tb)
+{
+	struct blob_attr *cur;
+
+	memset(q, 0, sizeof(*q));
+	q->ecn = -1;
+
+	cur = tb[DEV_ATTR_QDISC];
+	if (!device_qdisc_kind_valid(blobmsg_data(cur), false))
+		return false;
+
+	strncpy(q->kind, blobmsg_data(cur), sizeof(q->kind) - 1);
+	strcpy(q->child, "fq_codel");
+
+	if ((cur = tb[DEV_ATTR_QDISC_CHILD])) {
+		if (!device_qdisc_kind_valid(blobmsg_data(cur), true))
+			return false;
+
+		strncpy(q->child, blobmsg_data(cur), sizeof(q->child) - 1);
+	}
+
+	if ((cur = tb[DEV_ATTR_QDISC_LIMIT]))
+		q->limit = blobmsg_get_u32(cur);
+
+	if ((cur = tb[DEV_ATTR_QDISC_TARGET]))
+		q->target = blobmsg_get_u32(cur);
+
+	if ((cur = tb[DEV_ATTR_QDISC_INTERVAL]))
+		q->interval = blobmsg_get_u32(cur);
+
+	if ((cur = tb[DEV_ATTR_QDISC_ECN]))
+		q->ecn = blobmsg_get_bool(cur);
+
+	if ((cur = tb[DEV_ATTR_QDISC_BANDWIDTH]))
+		q->bandwidth = blobmsg_get_u32(cur);
+
+	if ((cur = tb[DEV_ATTR_QDISC_MEMORY]))
+		q->memory = blobmsg_get_u32(cur);
+
+	/* cake has no packet limit, its queue is bounded in bytes by qdisc_memory */
+	if (q->limit && (!strcmp(q->kind, "cake") ||
+			 (!strcmp(q->kind, "mq") && !strcmp(q->child, "cake"))))
+		return false;
+
+	return true;
+}
+
+static bool
+device_bpf_path(char *dest, struct blob_attr *attr)
+{
+	const char *path;
+
+	if (!attr)
+		return true;
+
+	/* programs must be pinned in bpffs, netifd never loads objects itself */
+	path = blobmsg_data(attr);
+	if (path[0] != '/' || strlen(path) >= DEV_BPF_PATH_LEN) {
+		DPRINTF("Invalid BPF program path: %s\n", path);
+		return false;
+	}
+
+	strcpy(dest, path);
+	return true;
+}
+
+static void
+device_init_bpf(struct device_settings *s, struct blob_attr **tb)
+{
+	struct device_bpf *b = &s->bpf;
+	struct blob_attr *cur;
+
+	memset(b, 0, sizeof(*b));
+
+	if (!tb[DEV_ATTR_XDP] && !tb[DEV_ATTR_TC_INGRESS] && !tb[DEV_ATTR_TC_EGRESS])
+		return;
+
+	if ((cur = tb[DEV_ATTR_XDP_MODE])) {
+		const char *mode = blobmsg_data(cur);
+
+		if (!strcmp(mode, "generic"))
+			b->xdp_generic = true;
+		else if (strcmp(mode, "native") != 0) {
+			DPRINTF("Invalid xdp_mode: %s\n", mode);
+			return;
+		}
+	}
+
+	if (!device_bpf_path(b->xdp, tb[DEV_ATTR_XDP]) ||
+	    !device_bpf_path(b->tc_ingress, tb[DEV_ATTR_TC_INGRESS]) ||
+	    !device_bpf_path(b->tc_egress, tb[DEV_ATTR_TC_EGRESS]))
+		return;
+
+	s->flags |= DEV_OPT_BPF;
+}
+
 void
 device_init_settings(struct device *dev, struct blob_attr **tb)
 {
@@ -383,6 +622,43 @@ device_init_settings(struct device *dev, struct blob_attr **tb)
 		s->flags |= DEV_OPT_ISOLATE;
 	}
 
+	if ((cur = tb[DEV_ATTR_RPS_CPUS])) {
+		if (device_parse_cpumask(&s->rps_cpus, blobmsg_data(cur)))
+			s->flags |= DEV_OPT_RPS_CPUS;
+		else
+			DPRINTF("Invalid rps_cpus: %s\n", (char *) blobmsg_data(cur));
+	}
+
+	if ((cur = tb[DEV_ATTR_XPS_CPUS])) {
+		if (device_parse_cpumask(&s->xps_cpus, blobmsg_data(cur)))
+			s->flags |= DEV_OPT_XPS_CPUS;
+		else
+			DPRINTF("Invalid xps_cpus: %s\n", (char *) blobmsg_data(cur));
+	}
+
+	if ((cur = tb[DEV_ATTR_RPS_FLOW_CNT])) {
+		s->rps_flow_cnt = blobmsg_get_u32(cur);
+		s->flags |= DEV_OPT_RPS_FLOW_CNT;
+	}
+
+	if ((cur = tb[DEV_ATTR_IRQ_AFFINITY])) {
+		if (device_parse_cpumask(&s->irq_affinity, blobmsg_data(cur)))
+			s->flags |= DEV_OPT_IRQ_AFFINITY;
+		else
+			DPRINTF("Invalid irq_affinity: %s\n", (char *) blobmsg_data(cur));
+	}
+
+	device_init_ethtool_settings(s, tb);
+
+	if ((cur = tb[DEV_ATTR_QDISC])) {
+		if (device_init_qdisc(&s->qdisc, tb))
+			s->flags |= DEV_OPT_QDISC;
+		else
+			DPRINTF("Invalid qdisc: %s\n", (char *) blobmsg_data(cur));
+	}
+
+	device_init_bpf(s, tb);
+
 	device_set_disabled(dev, disabled);
 }
 
@@ -430,6 +706,9 @@ int device_claim(struct device_user *dep)
 		return 0;
 
 	device_broadcast_event(dev, DEV_EVENT_SETUP);
+	if (dev->shared)
+		shard_device_claim(dev, true);
+
 	if (dev->external) {
 		/* Get ifindex for external claimed devices so a valid   */
 		/* ifindex is in place avoiding possible race conditions */
@@ -474,6 +753,9 @@ void device_release(struct device_user *dep)
 	if (dev->active)
 		return;
 
+	if (dev->shared)
+		shard_device_claim(dev, false);
+
 	device_broadcast_event(dev, DEV_EVENT_DOWN);
 }
 
@@ -541,7 +823,12 @@ device_create_default(const char *name, bool external)
 	if (!dev)
 		return NULL;
 
-	dev->external = external;
+	/*
+	 * in a shard worker every device is managed by the coordinator, which
+	 * only sets it up once an interface using it is brought up
+	 */
+	dev->shared = netifd_shard && !external;
+	dev->external = external || dev->shared;
 	dev->set_state = simple_device_set_state;
 
 	if (device_init(dev, &simple_device_type, name) < 0) {
@@ -574,7 +861,7 @@ device_get(const char *name, int create)
 
 	dev = avl_find_element(&devices, name, dev, avl);
 
-	if (!dev && strchr(name, '.'))
+	if (!dev && strchr(name, '.') && !netifd_shard)
 		return get_vlan_device_chain(name, create);
 
 	if (name[0] == '@')
@@ -616,12 +903,23 @@ static int device_cleanup_cb(void *ctx, struct safe_list *list)
 	return 0;
 }
 
+static void
+device_free_cpumasks(struct device_settings *s)
+{
+	free(s->rps_cpus);
+	free(s->xps_cpus);
+	free(s->irq_affinity);
+	s->rps_cpus = s->xps_cpus = s->irq_affinity = NULL;
+}
+
 void device_cleanup(struct device *dev)
 {
 	D(DEVICE, "Clean up device '%s'\n", dev->ifname);
 	safe_list_for_each(&dev->users, device_cleanup_cb, NULL);
 	safe_list_for_each(&dev->aliases, device_cleanup_cb, NULL);
 	device_delete(dev);
+	device_free_cpumasks(&dev->settings);
+	device_free_cpumasks(&dev->orig_settings);
 }
 
 static void __device_set_present(struct device *dev, bool state)
@@ -755,6 +1053,8 @@ static void
 device_free(struct device *dev)
 {
 	__devlock++;
+	if (dev->shared)
+		shard_device_claim(dev, false);
 	free(dev->config);
 	device_cleanup(dev);
 	dev->type->free(dev);
@@ -816,16 +1116,56 @@ device_init_pending(void)
 	}
 }
 
+/*
+ * qdisc options are applied to a running device by replacing the root
+ * qdisc, changing only those does not need the device restarted
+ */
+static bool
+device_config_needs_restart(struct blob_attr **tb, struct blob_attr **otb)
+{
+	unsigned long diff[BITFIELD_SIZE(__DEV_ATTR_MAX)] = {};
+	int i;
+
+	uci_blob_diff(tb, otb, &device_attr_list, diff);
+	for (i = 0; i < __DEV_ATTR_MAX; i++) {
+		if (i >= DEV_ATTR_QDISC && i <= DEV_ATTR_QDISC_MEMORY)
+			continue;
+
+		if (bitfield_test(diff, i))
+			return true;
+	}
+
+	return false;
+}
+
+static void
+device_apply_qdisc(struct device *dev)
+{
+	struct device_settings st;
+
+	/* the merged settings carry the original qdisc if it was unset */
+	device_merge_settings(dev, &st);
+	system_if_apply_settings(dev, &st, DEV_OPT_QDISC);
+
+	/* and it is restored when the device goes down */
+	dev->orig_settings.flags |= dev->orig_settings.valid_flags & DEV_OPT_QDISC;
+}
+
 static enum dev_change_type
 device_set_config(struct device *dev, struct device_type *type,
 		  struct blob_attr *attr)
 {
 	struct blob_attr *tb[__DEV_ATTR_MAX];
+	struct blob_attr *otb[__DEV_ATTR_MAX];
 	const struct uci_blob_param_list *cfg = type->config_params;
 
 	if (type != dev->type)
 		return DEV_CONFIG_RECREATE;
 
+	/* an unchanged section cannot differ in any parsed option */
+	if (blob_attr_equal(dev->config, attr))
+		return DEV_CONFIG_NO_CHANGE;
+
 	if (dev->type->reload)
 		return dev->type->reload(dev, attr);
 
@@ -836,11 +1176,24 @@ device_set_config(struct device *dev, struct device_type *type,
 		memset(tb, 0, sizeof(tb));
 
 		if (attr)
-			blobmsg_parse(dev_attrs, __DEV_ATTR_MAX, tb,
+			blobmsg_parse_cached(dev_attrs, __DEV_ATTR_MAX, tb,
 				blob_data(attr), blob_len(attr));
 
 		device_init_settings(dev, tb);
-		return DEV_CONFIG_RESTART;
+
+		memset(otb, 0, sizeof(otb));
+		if (dev->config)
+			blobmsg_parse_cached(dev_attrs, __DEV_ATTR_MAX, otb,
+				blob_data(dev->config), blob_len(dev->config));
+
+		if (device_config_needs_restart(tb, otb))
+			return DEV_CONFIG_RESTART;
+
+		D(DEVICE, "Device '%s': applying qdisc in place\n", dev->ifname);
+		if (dev->active && !dev->external)
+			device_apply_qdisc(dev);
+
+		return DEV_CONFIG_APPLIED;
 	} else
 		return DEV_CONFIG_RECREATE;
 }
@@ -980,6 +1333,100 @@ device_create(const char *name, struct device_type *type,
 	return dev;
 }
 
+static void
+device_dump_ethtool_settings(struct blob_buf *b, struct device_settings *st)
+{
+	unsigned int f = st->ethtool_flags;
+
+	if (f & DEV_ETHTOOL_GRO)
+		blobmsg_add_u8(b, "gro", !!(st->offloads & DEV_ETHTOOL_GRO));
+	if (f & DEV_ETHTOOL_GSO)
+		blobmsg_add_u8(b, "gso", !!(st->offloads & DEV_ETHTOOL_GSO));
+	if (f & DEV_ETHTOOL_TSO)
+		blobmsg_add_u8(b, "tso", !!(st->offloads & DEV_ETHTOOL_TSO));
+	if (f & DEV_ETHTOOL_LRO)
+		blobmsg_add_u8(b, "lro", !!(st->offloads & DEV_ETHTOOL_LRO));
+	if (f & DEV_ETHTOOL_RX_RING)
+		blobmsg_add_u32(b, "rx_ring", st->rx_ring);
+	if (f & DEV_ETHTOOL_TX_RING)
+		blobmsg_add_u32(b, "tx_ring", st->tx_ring);
+	if (f & DEV_ETHTOOL_CHANNELS)
+		blobmsg_add_u32(b, "channels", st->channels);
+	if (f & DEV_ETHTOOL_RX_USECS)
+		blobmsg_add_u32(b, "rx_usecs", st->rx_usecs);
+	if (f & DEV_ETHTOOL_TX_USECS)
+		blobmsg_add_u32(b, "tx_usecs", st->tx_usecs);
+	if (f & DEV_ETHTOOL_ADAPTIVE_RX)
+		blobmsg_add_u8(b, "adaptive_rx", st->adaptive_rx);
+	if (f & DEV_ETHTOOL_ADAPTIVE_TX)
+		blobmsg_add_u8(b, "adaptive_tx", st->adaptive_tx);
+
+	if (st->ethtool_failed) {
+		static const struct {
+			unsigned int flag;
+			const char *name;
+		} names[] = {
+			{ DEV_ETHTOOL_GRO, "gro" },
+			{ DEV_ETHTOOL_GSO, "gso" },
+			{ DEV_ETHTOOL_TSO, "tso" },
+			{ DEV_ETHTOOL_LRO, "lro" },
+			{ DEV_ETHTOOL_RX_RING, "rx_ring" },
+			{ DEV_ETHTOOL_TX_RING, "tx_ring" },
+			{ DEV_ETHTOOL_CHANNELS, "channels" },
+			{ DEV_ETHTOOL_RX_USECS, "rx_usecs" },
+			{ DEV_ETHTOOL_TX_USECS, "tx_usecs" },
+			{ DEV_ETHTOOL_ADAPTIVE_RX, "adaptive_rx" },
+			{ DEV_ETHTOOL_ADAPTIVE_TX, "adaptive_tx" },
+		};
+		void *c;
+		int i;
+
+		/* configured values the driver rejected on the last apply */
+		c = blobmsg_open_array(b, "ethtool_failed");
+		for (i = 0; i < ARRAY_SIZE(names); i++)
+			if (st->ethtool_failed & names[i].flag)
+				blobmsg_add_string(b, NULL, names[i].name);
+		blobmsg_close_array(b, c);
+	}
+}
+
+static void
+device_dump_bpf(struct blob_buf *b, struct device *dev, struct device_bpf *bpf)
+{
+	void *c;
+
+	c = blobmsg_open_table(b, "bpf");
+	if (bpf->xdp[0]) {
+		blobmsg_add_string(b, "xdp", bpf->xdp);
+		blobmsg_add_string(b, "xdp_mode", bpf->xdp_generic ? "generic" : "native");
+		blobmsg_add_u8(b, "xdp_attached", !!(dev->bpf_attached & DEV_BPF_XDP));
+	}
+	if (bpf->tc_ingress[0]) {
+		blobmsg_add_string(b, "tc_ingress", bpf->tc_ingress);
+		blobmsg_add_u8(b, "tc_ingress_attached",
+			       !!(dev->bpf_attached & DEV_BPF_TC_INGRESS));
+	}
+	if (bpf->tc_egress[0]) {
+		blobmsg_add_string(b, "tc_egress", bpf->tc_egress);
+		blobmsg_add_u8(b, "tc_egress_attached",
+			       !!(dev->bpf_attached & DEV_BPF_TC_EGRESS));
+	}
+	blobmsg_close_table(b, c);
+}
+
+/* saved originals hold one mask per queue or irq, report the first one */
+static void
+device_dump_cpumask(struct blob_buf *b, const char *name, const char *mask)
+{
+	size_t len = strcspn(mask, "\n");
+	char *buf;
+
+	buf = blobmsg_alloc_string_buffer(b, name, len + 1);
+	memcpy(buf, mask, len);
+	buf[len] = 0;
+	blobmsg_add_string_buffer(b);
+}
+
 void
 device_dump_status(struct blob_buf *b, struct device *dev)
 {
@@ -1061,6 +1508,27 @@ device_dump_status(struct blob_buf *b, struct device *dev)
 			blobmsg_add_u8(b, "unicast_flood", st.unicast_flood);
 		if (st.flags & DEV_OPT_SENDREDIRECTS)
 			blobmsg_add_u8(b, "sendredirects", st.sendredirects);
+		if (st.flags & DEV_OPT_RPS_CPUS)
+			device_dump_cpumask(b, "rps_cpus", st.rps_cpus);
+		if (st.flags & DEV_OPT_XPS_CPUS)
+			device_dump_cpumask(b, "xps_cpus", st.xps_cpus);
+		if (st.flags & DEV_OPT_RPS_FLOW_CNT)
+			blobmsg_add_u32(b, "rps_flow_cnt", st.rps_flow_cnt);
+		if (st.flags & DEV_OPT_IRQ_AFFINITY)
+			device_dump_cpumask(b, "irq_affinity", st.irq_affinity);
+		if (st.flags & DEV_OPT_ETHTOOL)
+			device_dump_ethtool_settings(b, &st);
+		if (st.flags & DEV_OPT_QDISC && st.qdisc.kind[0]) {
+			blobmsg_add_string(b, "qdisc", st.qdisc.kind);
+			if (!strcmp(st.qdisc.kind, "mq"))
+				blobmsg_add_string(b, "qdisc_child", st.qdisc.child);
+			if (st.qdisc.bandwidth)
+				blobmsg_add_u32(b, "qdisc_bandwidth", st.qdisc.bandwidth);
+			if (st.qdisc.memory)
+				blobmsg_add_u32(b, "qdisc_memory", st.qdisc.memory);
+		}
+		if (st.flags & DEV_OPT_BPF)
+			device_dump_bpf(b, dev, &st.bpf);
 	}
 
 	s = blobmsg_open_table(b, "statistics");
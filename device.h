@@ -52,6 +52,33 @@ enum {
 	DEV_ATTR_SENDREDIRECTS,
 	DEV_ATTR_NEIGHLOCKTIME,
 	DEV_ATTR_ISOLATE,
+	DEV_ATTR_RPS_CPUS,
+	DEV_ATTR_XPS_CPUS,
+	DEV_ATTR_RPS_FLOW_CNT,
+	DEV_ATTR_IRQ_AFFINITY,
+	DEV_ATTR_GRO,
+	DEV_ATTR_GSO,
+	DEV_ATTR_TSO,
+	DEV_ATTR_LRO,
+	DEV_ATTR_RX_RING,
+	DEV_ATTR_TX_RING,
+	DEV_ATTR_CHANNELS,
+	DEV_ATTR_RX_USECS,
+	DEV_ATTR_TX_USECS,
+	DEV_ATTR_ADAPTIVE_RX,
+	DEV_ATTR_ADAPTIVE_TX,
+	DEV_ATTR_QDISC,
+	DEV_ATTR_QDISC_CHILD,
+	DEV_ATTR_QDISC_LIMIT,
+	DEV_ATTR_QDISC_TARGET,
+	DEV_ATTR_QDISC_INTERVAL,
+	DEV_ATTR_QDISC_ECN,
+	DEV_ATTR_QDISC_BANDWIDTH,
+	DEV_ATTR_QDISC_MEMORY,
+	DEV_ATTR_XDP,
+	DEV_ATTR_XDP_MODE,
+	DEV_ATTR_TC_INGRESS,
+	DEV_ATTR_TC_EGRESS,
 	__DEV_ATTR_MAX,
 };
 
@@ -92,7 +119,8 @@ enum {
 	DEV_OPT_IGMPVERSION		= (1 << 7),
 	DEV_OPT_MLDVERSION		= (1 << 8),
 	DEV_OPT_NEIGHREACHABLETIME	= (1 << 9),
-	/* 2 bit hole */
+	DEV_OPT_QDISC			= (1 << 10),
+	DEV_OPT_BPF			= (1 << 11),
 	DEV_OPT_MTU6			= (1 << 12),
 	DEV_OPT_DADTRANSMITS		= (1 << 13),
 	DEV_OPT_MULTICAST_TO_UNICAST	= (1 << 14),
@@ -105,8 +133,31 @@ enum {
 	DEV_OPT_SENDREDIRECTS		= (1 << 21),
 	DEV_OPT_NEIGHLOCKTIME		= (1 << 22),
 	DEV_OPT_ISOLATE			= (1 << 23),
+	DEV_OPT_RPS_CPUS		= (1 << 24),
+	DEV_OPT_XPS_CPUS		= (1 << 25),
+	DEV_OPT_RPS_FLOW_CNT		= (1 << 26),
+	DEV_OPT_IRQ_AFFINITY		= (1 << 27),
+	DEV_OPT_ETHTOOL			= (1 << 28),
 };
 
+/* individual ethtool settings covered by DEV_OPT_ETHTOOL */
+enum {
+	DEV_ETHTOOL_GRO			= (1 << 0),
+	DEV_ETHTOOL_GSO			= (1 << 1),
+	DEV_ETHTOOL_TSO			= (1 << 2),
+	DEV_ETHTOOL_LRO			= (1 << 3),
+	DEV_ETHTOOL_RX_RING		= (1 << 4),
+	DEV_ETHTOOL_TX_RING		= (1 << 5),
+	DEV_ETHTOOL_CHANNELS		= (1 << 6),
+	DEV_ETHTOOL_RX_USECS		= (1 << 7),
+	DEV_ETHTOOL_TX_USECS		= (1 << 8),
+	DEV_ETHTOOL_ADAPTIVE_RX		= (1 << 9),
+	DEV_ETHTOOL_ADAPTIVE_TX		= (1 << 10),
+};
+
+#define DEV_ETHTOOL_OFFLOADS	(DEV_ETHTOOL_GRO | DEV_ETHTOOL_GSO | \
+				 DEV_ETHTOOL_TSO | DEV_ETHTOOL_LRO)
+
 /* events broadcasted to all users of a device */
 enum device_event {
 	DEV_EVENT_ADD,
@@ -145,6 +196,36 @@ struct device_user {
 	void (*cb)(struct device_user *, enum device_event);
 };
 
+/* root qdisc installed on the device, an empty kind restores the default */
+struct device_qdisc {
+	char kind[16];
+	char child[16]; /* leaf qdisc of each mq queue */
+	unsigned int limit; /* packets, fq_codel only */
+	unsigned int memory; /* bytes, cake only */
+	unsigned int target; /* usecs */
+	unsigned int interval; /* usecs */
+	unsigned int bandwidth; /* kbit/s */
+	int ecn; /* -1: kernel default */
+};
+
+/* pinned BPF programs attached to the device, an empty path detaches */
+#define DEV_BPF_PATH_LEN	128
+
+struct device_bpf {
+	char xdp[DEV_BPF_PATH_LEN];
+	char tc_ingress[DEV_BPF_PATH_LEN];
+	char tc_egress[DEV_BPF_PATH_LEN];
+	bool xdp_generic;
+};
+
+/* programs currently attached by netifd */
+enum {
+	DEV_BPF_XDP			= (1 << 0),
+	DEV_BPF_XDP_GENERIC		= (1 << 1),
+	DEV_BPF_TC_INGRESS		= (1 << 2),
+	DEV_BPF_TC_EGRESS		= (1 << 3),
+};
+
 struct device_settings {
 	unsigned int flags;
 	unsigned int valid_flags;
@@ -172,6 +253,26 @@ struct device_settings {
 	bool unicast_flood;
 	bool sendredirects;
 	bool isolate;
+	/*
+	 * cpu masks in sysfs format, or "auto" to spread queues over cpus;
+	 * saved originals hold one mask per queue or irq, one per line
+	 */
+	char *rps_cpus;
+	char *xps_cpus;
+	unsigned int rps_flow_cnt;
+	char *irq_affinity;
+	unsigned int ethtool_flags;
+	unsigned int ethtool_failed; /* rejected by the driver on the last apply */
+	unsigned int offloads; /* enabled DEV_ETHTOOL_OFFLOADS */
+	unsigned int rx_ring;
+	unsigned int tx_ring;
+	unsigned int channels;
+	unsigned int rx_usecs;
+	unsigned int tx_usecs;
+	bool adaptive_rx;
+	bool adaptive_tx;
+	struct device_qdisc qdisc;
+	struct device_bpf bpf;
 };
 
 /*
@@ -186,6 +287,7 @@ struct device {
 	struct safe_list aliases;
 
 	struct vlist_tree vlans;
+	struct vlist_tree fdb;
 
 	char ifname[IFNAMSIZ + 1];
 	int ifindex;
@@ -201,6 +303,10 @@ struct device {
 	bool link_active;
 
 	bool external;
+	/* shard worker only: managed by the coordinator */
+	bool shared;
+	/* the coordinator holds a claim on our behalf */
+	bool shard_claimed;
 	bool disabled;
 	bool deferred;
 	bool hidden;
@@ -223,6 +329,9 @@ struct device {
 
 	struct device_settings orig_settings;
 	struct device_settings settings;
+
+	/* DEV_BPF_* */
+	unsigned int bpf_attached;
 };
 
 struct device_hotplug_ops {
@@ -252,6 +361,35 @@ struct bridge_vlan {
 	bool local;
 };
 
+enum bridge_fdb_flags {
+	BRFDB_F_MDB =		(1 << 0),
+	BRFDB_F_LOCAL =		(1 << 1),
+	BRFDB_F_STICKY =	(1 << 2),
+	BRFDB_F_TEMPORARY =	(1 << 3),
+};
+
+/*
+ * static fdb or mdb entry of a bridge port, compared as a whole.
+ * An empty port refers to the bridge itself. fdb addresses and layer 2
+ * mdb groups use family AF_UNSPEC and lladdr.
+ */
+struct bridge_fdb_entry {
+	char port[IFNAMSIZ + 1];
+	uint16_t flags;
+	uint16_t vid;
+	int family;
+	union {
+		unsigned char lladdr[6];
+		struct in_addr in;
+		struct in6_addr in6;
+	} addr;
+};
+
+struct bridge_fdb {
+	struct vlist_node node;
+	struct bridge_fdb_entry entry;
+};
+
 extern const struct uci_blob_param_list device_attr_list;
 extern struct device_type simple_device_type;
 extern struct device_type tunnel_device_type;
@@ -261,6 +399,9 @@ void device_unlock(void);
 
 void device_vlan_update(bool done);
 
+void bridge_batch_begin(void);
+void bridge_batch_end(void);
+
 int device_type_add(struct device_type *devtype);
 struct device_type *device_type_get(const char *tname);
 struct device *device_create(const char *name, struct device_type *type,
@@ -297,6 +438,10 @@ void device_dump_status(struct blob_buf *b, struct device *dev);
 
 void device_free_unused(struct device *dev);
 
+int tunnel_fdb_update_dynamic(struct device *dev, struct blob_attr *peers,
+			      struct blob_attr *fdb, bool add);
+int veth_add_batch(struct blob_attr *list, struct blob_buf *b);
+
 struct device *get_vlan_device_chain(const char *ifname, bool create);
 void alias_notify_device(const char *name, struct device *dev);
 struct device *device_alias_get(const char *name);
@@ -20,6 +20,7 @@
 #include "netifd.h"
 #include "system.h"
 #include "handler.h"
+#include "job.h"
 
 static int
 netifd_dir_push(int fd)
@@ -78,38 +79,64 @@ netifd_init_script_handler(const char *script, json_object *obj, script_dump_cb
 	cb(script, name, obj);
 }
 
+struct script_dump_job {
+	struct netifd_job job;
+	script_dump_cb cb;
+	char *out;
+	size_t len;
+	char name[];
+};
+
+/* runs on a job thread: collect the dump output, parse it later */
 static void
-netifd_parse_script_handler(const char *name, script_dump_cb cb)
+netifd_script_dump_run(struct netifd_job *job)
 {
-	struct json_tokener *tok = NULL;
-	json_object *obj;
-	static char buf[512];
-	char *start, *cmd;
-	FILE *f;
-	int len;
+	struct script_dump_job *sj = container_of(job, struct script_dump_job, job);
+	char buf[512], *cmd;
+	FILE *f, *out;
+	size_t len;
 
 #define DUMP_SUFFIX	" '' dump"
 
-	cmd = alloca(strlen(name) + 1 + sizeof(DUMP_SUFFIX));
-	sprintf(cmd, "%s" DUMP_SUFFIX, name);
+	cmd = alloca(strlen(sj->name) + 1 + sizeof(DUMP_SUFFIX));
+	sprintf(cmd, "%s" DUMP_SUFFIX, sj->name);
 
 	f = popen(cmd, "r");
 	if (!f)
 		return;
 
-	do {
-		start = fgets(buf, sizeof(buf), f);
-		if (!start)
-			continue;
+	out = open_memstream(&sj->out, &sj->len);
+	if (out) {
+		while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+			fwrite(buf, 1, len, out);
+		fclose(out);
+	}
+
+	pclose(f);
+}
 
-		len = strlen(start);
+static void
+netifd_script_dump_complete(struct netifd_job *job)
+{
+	struct script_dump_job *sj = container_of(job, struct script_dump_job, job);
+	struct json_tokener *tok = NULL;
+	json_object *obj;
+	char *start, *end;
+	int len;
+
+	for (start = sj->out; start && *start; start = end) {
+		end = strchrnul(start, '\n');
+		if (*end)
+			end++;
+
+		len = end - start;
 
 		if (!tok)
 			tok = json_tokener_new();
 
 		obj = json_tokener_parse_ex(tok, start, len);
 		if (obj) {
-			netifd_init_script_handler(name, obj, cb);
+			netifd_init_script_handler(sj->name, obj, sj->cb);
 			json_object_put(obj);
 			json_tokener_free(tok);
 			tok = NULL;
@@ -117,12 +144,29 @@ netifd_parse_script_handler(const char *name, script_dump_cb cb)
 			json_tokener_free(tok);
 			tok = NULL;
 		}
-	} while (!feof(f) && !ferror(f));
+	}
 
 	if (tok)
 		json_tokener_free(tok);
 
-	pclose(f);
+	free(sj->out);
+	free(sj);
+}
+
+static void
+netifd_parse_script_handler(const char *name, script_dump_cb cb)
+{
+	struct script_dump_job *sj;
+
+	sj = calloc(1, sizeof(*sj) + strlen(name) + 1);
+	if (!sj)
+		return;
+
+	strcpy(sj->name, name);
+	sj->cb = cb;
+	sj->job.run = netifd_script_dump_run;
+	sj->job.complete = netifd_script_dump_complete;
+	job_queue(&sj->job);
 }
 
 void netifd_init_script_handlers(int dir_fd, script_dump_cb cb)
@@ -138,6 +182,9 @@ void netifd_init_script_handlers(int dir_fd, script_dump_cb cb)
 
 	for (i = 0; i < g.gl_pathc; i++)
 		netifd_parse_script_handler(g.gl_pathv[i], cb);
+
+	/* the dumps run relative to dir_fd, so wait before leaving it */
+	job_wait();
 	netifd_dir_pop(prev_fd);
 
 	globfree(&g);
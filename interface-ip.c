@@ -35,6 +35,8 @@
 #include "proto.h"
 #include "ubus.h"
 #include "system.h"
+#include "job.h"
+#include "shard.h"
 
 enum {
 	ROUTE_INTERFACE,
@@ -96,6 +98,9 @@ const struct uci_blob_param_list neighbor_attr_list = {
 
 
 struct list_head prefixes = LIST_HEAD_INIT(prefixes);
+struct slab device_route_slab = SLAB_INIT("device_route", struct device_route);
+struct slab device_neighbor_slab = SLAB_INIT("device_neighbor", struct device_neighbor);
+struct slab device_addr_slab = SLAB_INIT("device_addr", struct device_addr);
 static struct device_prefix *ula_prefix = NULL;
 static struct uloop_timeout valid_until_timeout;
 
@@ -297,7 +302,7 @@ interface_ip_add_target_route(union if_addr *addr, bool v6, struct interface *if
 	if (defaultroute_target)
 		return iface;
 
-	route = calloc(1, sizeof(*route));
+	route = slab_alloc(&device_route_slab);
 	if (!route)
 		return NULL;
 
@@ -356,7 +361,7 @@ interface_ip_add_neighbor(struct interface *iface, struct blob_attr *attr, bool
 	} else
 		ip = &iface->proto_ip;
 
-	neighbor = calloc(1,sizeof(*neighbor));
+	neighbor = slab_alloc(&device_neighbor_slab);
 	if (!neighbor)
 		return;
 
@@ -387,7 +392,7 @@ interface_ip_add_neighbor(struct interface *iface, struct blob_attr *attr, bool
 	return;
 
 error:
-	free(neighbor);
+	slab_free(&device_neighbor_slab, neighbor);
 }
 
 void
@@ -398,7 +403,7 @@ interface_ip_add_route(struct interface *iface, struct blob_attr *attr, bool v6)
 	struct device_route *route;
 	int af = v6 ? AF_INET6 : AF_INET;
 
-	blobmsg_parse(route_attr, __ROUTE_MAX, tb, blobmsg_data(attr), blobmsg_data_len(attr));
+	blobmsg_parse_cached(route_attr, __ROUTE_MAX, tb, blobmsg_data(attr), blobmsg_data_len(attr));
 
 	if (!iface) {
 		if ((cur = tb[ROUTE_INTERFACE]) == NULL)
@@ -413,7 +418,7 @@ interface_ip_add_route(struct interface *iface, struct blob_attr *attr, bool v6)
 		ip = &iface->proto_ip;
 	}
 
-	route = calloc(1, sizeof(*route));
+	route = slab_alloc(&device_route_slab);
 	if (!route)
 		return;
 
@@ -510,7 +515,7 @@ interface_ip_add_route(struct interface *iface, struct blob_attr *attr, bool v6)
 	return;
 
 error:
-	free(route);
+	slab_free(&device_route_slab, route);
 }
 
 static int
@@ -558,8 +563,15 @@ route_cmp(const void *k1, const void *k2, void *ptr)
 static int
 prefix_cmp(const void *k1, const void *k2, void *ptr)
 {
-	return memcmp(k1, k2, offsetof(struct device_prefix, pclass) -
-			offsetof(struct device_prefix, addr));
+	const struct device_prefix *p1 = container_of(k1, struct device_prefix, addr);
+	const struct device_prefix *p2 = container_of(k2, struct device_prefix, addr);
+	int ret;
+
+	ret = memcmp(&p1->addr, &p2->addr, sizeof(p1->addr));
+	if (ret)
+		return ret;
+
+	return p1->length - p2->length;
 }
 
 static void
@@ -687,7 +699,7 @@ interface_update_proto_addr(struct vlist_tree *tree,
 			}
 		}
 		free(a_old->pclass);
-		free(a_old);
+		slab_free(&device_addr_slab, a_old);
 	}
 
 	if (node_new) {
@@ -750,7 +762,7 @@ interface_update_proto_neighbor(struct vlist_tree *tree,
 		if (!keep && neighbor_old->enabled)
 			system_del_neighbor(dev, neighbor_old);
 
-		free(neighbor_old);
+		slab_free(&device_neighbor_slab, neighbor_old);
 	}
 
 	if (node_new) {
@@ -792,7 +804,7 @@ interface_update_proto_route(struct vlist_tree *tree,
 		if (!(route_old->flags & DEVADDR_EXTERNAL) && route_old->enabled && !keep)
 			system_del_route(dev, route_old);
 
-		free(route_old);
+		slab_free(&device_route_slab, route_old);
 	}
 
 	if (node_new) {
@@ -824,7 +836,7 @@ interface_update_host_route(struct vlist_tree *tree,
 
 	if (node_old) {
 		system_del_route(dev, route_old);
-		free(route_old);
+		slab_free(&device_route_slab, route_old);
 	}
 
 	if (node_new) {
@@ -1044,11 +1056,43 @@ static int prefix_assignment_cmp(const void *k1, const void *k2, void *ptr)
 	return strcmp(a1->name, a2->name);
 }
 
+static struct device_prefix_assignment *
+prefix_assignment_alloc(const char *name)
+{
+	struct device_prefix_assignment *c;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+
+	c->name = str_intern(name);
+	if (!c->name) {
+		free(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+static void
+prefix_assignment_free(struct device_prefix_assignment *c)
+{
+	str_release(c->name);
+	free(c);
+}
+
 static void interface_update_prefix_assignments(struct device_prefix *prefix, bool setup)
 {
 	struct device_prefix_assignment *c;
 	struct interface *iface;
 
+	/*
+	 * delegated and ULA prefixes are only handed out by the coordinator,
+	 * config_interface_shard keeps interfaces that use them there
+	 */
+	if (netifd_shard)
+		setup = false;
+
 	/* Delete all assignments */
 	while (!list_empty(&prefix->assignments)) {
 		c = list_first_entry(&prefix->assignments,
@@ -1056,33 +1100,30 @@ static void interface_update_prefix_assignments(struct device_prefix *prefix, bo
 		if ((iface = vlist_find(&interfaces, c->name, iface, node)))
 			interface_set_prefix_address(c, prefix, iface, false);
 		list_del(&c->head);
-		free(c);
+		prefix_assignment_free(c);
 	}
 
 	if (!setup)
 		return;
 
 	/* End-of-assignment sentinel */
-	c = malloc(sizeof(*c) + 1);
+	c = prefix_assignment_alloc("");
 	if (!c)
 		return;
 
 	c->assigned = 1 << (64 - prefix->length);
 	c->length = 64;
-	c->name[0] = 0;
 	c->addr = in6addr_any;
 	list_add(&c->head, &prefix->assignments);
 
 	/* Excluded prefix */
 	if (prefix->excl_length > 0) {
-		const char name[] = "!excluded";
-		c = malloc(sizeof(*c) + sizeof(name));
+		c = prefix_assignment_alloc("!excluded");
 		if (c) {
 			c->assigned = ntohl(prefix->excl_addr.s6_addr32[1]) &
 					((1 << (64 - prefix->length)) - 1);
 			c->length = prefix->excl_length;
 			c->addr = in6addr_any;
-			memcpy(c->name, name, sizeof(name));
 			list_add(&c->head, &prefix->assignments);
 		}
 	}
@@ -1106,7 +1147,7 @@ static void interface_update_prefix_assignments(struct device_prefix *prefix, bo
 
 			struct interface_assignment_class *c;
 			list_for_each_entry(c, &iface->assignment_classes, head) {
-				if (!strcmp(c->name, prefix->pclass)) {
+				if (c->name == prefix->pclass) {
 					found = true;
 					break;
 				}
@@ -1116,8 +1157,7 @@ static void interface_update_prefix_assignments(struct device_prefix *prefix, bo
 				continue;
 		}
 
-		size_t namelen = strlen(iface->name) + 1;
-		c = malloc(sizeof(*c) + namelen);
+		c = prefix_assignment_alloc(iface->name);
 		if (!c)
 			continue;
 
@@ -1126,7 +1166,6 @@ static void interface_update_prefix_assignments(struct device_prefix *prefix, bo
 		c->weight = iface->assignment_weight;
 		c->addr = in6addr_any;
 		c->enabled = false;
-		memcpy(c->name, iface->name, namelen);
 
 		/* First process all custom assignments, put all others in later-list */
 		if (c->assigned == -1 || !interface_prefix_assign(&prefix->assignments, c)) {
@@ -1138,7 +1177,7 @@ static void interface_update_prefix_assignments(struct device_prefix *prefix, bo
 
 			entry = calloc(1, sizeof(*entry));
 			if (!entry) {
-				free(c);
+				prefix_assignment_free(c);
 				continue;
 			}
 
@@ -1164,7 +1203,7 @@ static void interface_update_prefix_assignments(struct device_prefix *prefix, bo
 		if (!assigned) {
 			netifd_log_message(L_WARNING, "Failed to assign subprefix "
 					"of size %hhu for %s\n", c->length, c->name);
-			free(c);
+			prefix_assignment_free(c);
 		} else
 			assigned_any = true;
 
@@ -1257,6 +1296,7 @@ interface_update_prefix(struct vlist_tree *tree,
 	if (node_old) {
 		if (prefix_old->head.next)
 			list_del(&prefix_old->head);
+		str_release(prefix_old->pclass);
 		free(prefix_old);
 	}
 
@@ -1275,10 +1315,16 @@ interface_ip_add_device_prefix(struct interface *iface, struct in6_addr *addr,
 	if (!pclass)
 		pclass = (iface) ? iface->name : "local";
 
-	struct device_prefix *prefix = calloc(1, sizeof(*prefix) + strlen(pclass) + 1);
+	struct device_prefix *prefix = calloc(1, sizeof(*prefix));
 	if (!prefix)
 		return NULL;
 
+	prefix->pclass = str_intern(pclass);
+	if (!prefix->pclass) {
+		free(prefix);
+		return NULL;
+	}
+
 	clear_if_addr(&a, length);
 
 	prefix->length = length;
@@ -1293,7 +1339,6 @@ interface_ip_add_device_prefix(struct interface *iface, struct in6_addr *addr,
 		prefix->excl_length = excl_length;
 	}
 
-	strcpy(prefix->pclass, pclass);
 
 	if (iface)
 		vlist_add(&iface->proto_ip.prefix, &prefix->node, &prefix->addr);
@@ -1335,7 +1380,7 @@ interface_ip_set_ula_prefix(const char *prefix)
 	}
 }
 
-static void
+void
 interface_add_dns_server(struct interface_ip_settings *ip, const char *str)
 {
 	struct dns_server *s;
@@ -1378,7 +1423,7 @@ interface_add_dns_server_list(struct interface_ip_settings *ip, struct blob_attr
 	}
 }
 
-static void
+void
 interface_add_dns_search_domain(struct interface_ip_settings *ip, const char *str)
 {
 	struct dns_search_domain *s;
@@ -1499,53 +1544,141 @@ __interface_write_dns_entries(FILE *f, const char *jail)
 		free(entry);
 }
 
+/*
+ * One writer per resolv.conf path. While a write is in flight only the
+ * most recent content is kept for the next one.
+ */
+struct resolv_conf_writer {
+	struct avl_node node;
+	struct netifd_job job;
+	bool busy;
+
+	char *buf, *next;
+	size_t len, next_len;
+
+	char path[];
+};
+
+static AVL_TREE(resolv_conf_writers, avl_strcmp, false, NULL);
+
+/* runs on a job thread */
+static void
+resolv_conf_write_run(struct netifd_job *job)
+{
+	struct resolv_conf_writer *w = container_of(job, struct resolv_conf_writer, job);
+	char *tmppath = alloca(strlen(w->path) + 5);
+	char *dpath = alloca(strlen(w->path) + 1);
+	uint32_t crcold, crcnew;
+	FILE *f;
+
+	strcpy(dpath, w->path);
+	mkdir(dirname(dpath), 0755);
+
+	crcnew = crc32_update(0, w->buf, w->len);
+	crcold = crcnew + 1;
+	f = fopen(w->path, "r");
+	if (f) {
+		crcold = crc32_file(f);
+		fclose(f);
+	}
+
+	if (crcold == crcnew)
+		return;
+
+	sprintf(tmppath, "%s.tmp", w->path);
+	unlink(tmppath);
+	f = fopen(tmppath, "w");
+	if (!f)
+		return;
+
+	if (fwrite(w->buf, 1, w->len, f) != w->len) {
+		fclose(f);
+		unlink(tmppath);
+		return;
+	}
+
+	if (fclose(f) || rename(tmppath, w->path) < 0)
+		unlink(tmppath);
+}
+
+static void
+resolv_conf_write_queue(struct resolv_conf_writer *w)
+{
+	w->buf = w->next;
+	w->len = w->next_len;
+	w->next = NULL;
+	w->busy = true;
+	job_queue(&w->job);
+}
+
+static void
+resolv_conf_write_complete(struct netifd_job *job)
+{
+	struct resolv_conf_writer *w = container_of(job, struct resolv_conf_writer, job);
+
+	free(w->buf);
+	w->buf = NULL;
+	w->busy = false;
+
+	if (w->next)
+		resolv_conf_write_queue(w);
+}
+
 void
 interface_write_resolv_conf(const char *jail)
 {
 	size_t plen = (jail ? strlen(jail) + 1 : 0 ) + strlen(resolv_conf) + 1;
+	struct resolv_conf_writer *w;
 	char *path = alloca(plen);
-	char *dpath = alloca(plen);
-	char *tmppath = alloca(plen + 4);
+	char *buf = NULL;
+	size_t len = 0;
 	FILE *f;
-	uint32_t crcold, crcnew;
 
-	if (jail) {
+	if (jail)
 		sprintf(path, "/tmp/resolv.conf-%s.d/resolv.conf.auto", jail);
-		strcpy(dpath, path);
-		dpath = dirname(dpath);
-		mkdir(dpath, 0755);
-	} else {
+	else
 		strcpy(path, resolv_conf);
-	}
 
-	sprintf(tmppath, "%s.tmp", path);
-	unlink(tmppath);
-	f = fopen(tmppath, "w+");
+	f = open_memstream(&buf, &len);
 	if (!f) {
-		D(INTERFACE, "Failed to open %s for writing\n", path);
+		D(INTERFACE, "Failed to generate %s\n", path);
 		return;
 	}
 
 	__interface_write_dns_entries(f, jail);
 
-	fflush(f);
-	rewind(f);
-	crcnew = crc32_file(f);
-	fclose(f);
-
-	crcold = crcnew + 1;
-	f = fopen(path, "r");
-	if (f) {
-		crcold = crc32_file(f);
+	/* resolv.conf is owned by the coordinator, workers hand it their entries */
+	if (netifd_shard) {
 		fclose(f);
+		shard_push_dns(jail, buf);
+		free(buf);
+		return;
 	}
 
-	if (crcold == crcnew) {
-		unlink(tmppath);
-	} else if (rename(tmppath, path) < 0) {
-		D(INTERFACE, "Failed to replace %s\n", path);
-		unlink(tmppath);
+	shard_write_dns(f, jail);
+	fclose(f);
+
+	w = avl_find_element(&resolv_conf_writers, path, w, node);
+	if (!w) {
+		w = calloc(1, sizeof(*w) + strlen(path) + 1);
+		if (!w) {
+			free(buf);
+			return;
+		}
+
+		strcpy(w->path, path);
+		w->node.key = w->path;
+		w->job.run = resolv_conf_write_run;
+		w->job.complete = resolv_conf_write_complete;
+		avl_insert(&resolv_conf_writers, &w->node);
 	}
+
+	free(w->next);
+	w->next = buf;
+	w->next_len = len;
+
+	if (!w->busy)
+		resolv_conf_write_queue(w);
 }
 
 void interface_ip_set_enabled(struct interface_ip_settings *ip, bool enabled)
@@ -1628,7 +1761,7 @@ void interface_ip_set_enabled(struct interface_ip_settings *ip, bool enabled)
 	struct device_prefix_assignment *a;
 	list_for_each_entry(c, &prefixes, head)
 		list_for_each_entry(a, &c->assignments, head)
-			if (!strcmp(a->name, ip->iface->name))
+			if (a->name == ip->iface->name)
 				interface_set_prefix_address(a, c, ip->iface, enabled);
 
 	if (ip->iface->policy_rules_set != enabled &&
@@ -1656,7 +1789,7 @@ interface_ip_update_start(struct interface_ip_settings *ip)
 }
 
 void
-interface_ip_update_complete(struct interface_ip_settings *ip)
+interface_ip_update_flush(struct interface_ip_settings *ip)
 {
 	vlist_simple_flush(&ip->dns_servers);
 	vlist_simple_flush(&ip->dns_search);
@@ -1664,14 +1797,82 @@ interface_ip_update_complete(struct interface_ip_settings *ip)
 	vlist_flush(&ip->addr);
 	vlist_flush(&ip->prefix);
 	vlist_flush(&ip->neighbor);
+}
+
+void
+interface_ip_update_complete(struct interface_ip_settings *ip)
+{
+	interface_ip_update_flush(ip);
 	interface_write_resolv_conf(ip->iface->jail);
 }
 
+/*
+ * Checksum over everything the protocol handler has configured, used to
+ * detect renewals that do not change any state. Lifetimes are left out,
+ * since every renewal moves them; the vlist updates still refresh them.
+ */
+uint32_t
+interface_ip_fingerprint(struct interface_ip_settings *ip, uint32_t crc)
+{
+	struct device_addr *addr;
+	struct device_route *route;
+	struct device_prefix *prefix;
+	struct device_neighbor *neighbor;
+	struct dns_server *s;
+	struct dns_search_domain *d;
+
+	vlist_for_each_element(&ip->addr, addr, node) {
+		crc = crc32_update(crc, &addr->flags, sizeof(*addr) -
+				   offsetof(struct device_addr, flags));
+		crc = crc32_update(crc, &addr->broadcast, sizeof(addr->broadcast));
+		crc = crc32_update(crc, &addr->point_to_point, sizeof(addr->point_to_point));
+		if (addr->pclass)
+			crc = crc32_update(crc, addr->pclass, strlen(addr->pclass) + 1);
+	}
+
+	vlist_for_each_element(&ip->route, route, node) {
+		crc = crc32_update(crc, &route->flags, sizeof(*route) -
+				   offsetof(struct device_route, flags));
+		crc = crc32_update(crc, &route->nexthop, sizeof(route->nexthop));
+		crc = crc32_update(crc, &route->mtu, sizeof(route->mtu));
+		crc = crc32_update(crc, &route->type, sizeof(route->type));
+		crc = crc32_update(crc, &route->proto, sizeof(route->proto));
+	}
+
+	vlist_for_each_element(&ip->prefix, prefix, node) {
+		crc = crc32_update(crc, &prefix->addr, offsetof(struct device_prefix, pclass) -
+				   offsetof(struct device_prefix, addr));
+		crc = crc32_update(crc, &prefix->excl_addr, sizeof(prefix->excl_addr));
+		crc = crc32_update(crc, &prefix->excl_length, sizeof(prefix->excl_length));
+		crc = crc32_update(crc, prefix->pclass, strlen(prefix->pclass) + 1);
+	}
+
+	vlist_for_each_element(&ip->neighbor, neighbor, node) {
+		crc = crc32_update(crc, &neighbor->flags, sizeof(neighbor->flags));
+		crc = crc32_update(crc, &neighbor->addr, sizeof(neighbor->addr));
+		crc = crc32_update(crc, neighbor->macaddr, sizeof(neighbor->macaddr));
+		crc = crc32_update(crc, &neighbor->proxy, sizeof(neighbor->proxy));
+		crc = crc32_update(crc, &neighbor->router, sizeof(neighbor->router));
+	}
+
+	vlist_simple_for_each_element(&ip->dns_servers, s, node) {
+		crc = crc32_update(crc, &s->af, sizeof(s->af));
+		crc = crc32_update(crc, &s->addr, sizeof(s->addr));
+	}
+
+	vlist_simple_for_each_element(&ip->dns_search, d, node)
+		crc = crc32_update(crc, d->name, strlen(d->name) + 1);
+
+	return crc;
+}
+
 void
 interface_ip_flush(struct interface_ip_settings *ip)
 {
-	if (ip == &ip->iface->proto_ip)
+	if (ip == &ip->iface->proto_ip) {
 		vlist_flush_all(&ip->iface->host_routes);
+		ip->iface->proto_fingerprint = 0;
+	}
 	vlist_simple_flush_all(&ip->dns_servers);
 	vlist_simple_flush_all(&ip->dns_search);
 	vlist_flush_all(&ip->route);
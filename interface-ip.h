@@ -65,7 +65,7 @@ struct device_prefix_assignment {
 	int weight;
 	struct in6_addr addr;
 	bool enabled;
-	char name[];
+	const char *name; /* interned */
 };
 
 struct device_prefix {
@@ -82,7 +82,7 @@ struct device_prefix {
 	struct in6_addr addr;
 	uint8_t length;
 
-	char pclass[];
+	const char *pclass; /* interned */
 };
 
 struct device_route {
@@ -169,16 +169,23 @@ struct dns_search_domain {
 extern const struct uci_blob_param_list route_attr_list;
 extern const struct uci_blob_param_list neighbor_attr_list;
 extern struct list_head prefixes;
+extern struct slab device_route_slab;
+extern struct slab device_neighbor_slab;
+extern struct slab device_addr_slab;
 
 void interface_ip_init(struct interface *iface);
+void interface_add_dns_server(struct interface_ip_settings *ip, const char *str);
 void interface_add_dns_server_list(struct interface_ip_settings *ip, struct blob_attr *list);
+void interface_add_dns_search_domain(struct interface_ip_settings *ip, const char *str);
 void interface_add_dns_search_list(struct interface_ip_settings *ip, struct blob_attr *list);
 void interface_write_resolv_conf(const char *jail);
 
 void interface_ip_add_route(struct interface *iface, struct blob_attr *attr, bool v6);
 void interface_ip_add_neighbor(struct interface *iface, struct blob_attr *attr, bool v6);
 void interface_ip_update_start(struct interface_ip_settings *ip);
+void interface_ip_update_flush(struct interface_ip_settings *ip);
 void interface_ip_update_complete(struct interface_ip_settings *ip);
+uint32_t interface_ip_fingerprint(struct interface_ip_settings *ip, uint32_t crc);
 void interface_ip_flush(struct interface_ip_settings *ip);
 void interface_ip_set_enabled(struct interface_ip_settings *ip, bool enabled);
 void interface_ip_update_metric(struct interface_ip_settings *ip, int metric);
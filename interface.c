@@ -14,6 +14,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -25,6 +26,7 @@
 #include "ubus.h"
 #include "config.h"
 #include "system.h"
+#include "shard.h"
 
 struct vlist_tree interfaces;
 static LIST_HEAD(iface_all_users);
@@ -51,6 +53,7 @@ enum {
 	IFACE_ATTR_IP6IFACEID,
 	IFACE_ATTR_FORCE_LINK,
 	IFACE_ATTR_IP6WEIGHT,
+	IFACE_ATTR_START_PRIORITY,
 	IFACE_ATTR_MAX
 };
 
@@ -76,6 +79,7 @@ static const struct blobmsg_policy iface_attrs[IFACE_ATTR_MAX] = {
 	[IFACE_ATTR_IP6IFACEID] = { .name = "ip6ifaceid", .type = BLOBMSG_TYPE_STRING },
 	[IFACE_ATTR_FORCE_LINK] = { .name = "force_link", .type = BLOBMSG_TYPE_BOOL },
 	[IFACE_ATTR_IP6WEIGHT] = { .name = "ip6weight", .type = BLOBMSG_TYPE_INT32 },
+	[IFACE_ATTR_START_PRIORITY] = { .name = "start_priority", .type = BLOBMSG_TYPE_INT32 },
 };
 
 const struct uci_blob_param_list interface_attr_list = {
@@ -506,8 +510,16 @@ interface_add_assignment_classes(struct interface *iface, struct blob_attr *list
 		if (!blobmsg_check_attr(cur, false))
 			continue;
 
-		struct interface_assignment_class *c = malloc(sizeof(*c) + blobmsg_data_len(cur));
-		memcpy(c->name, blobmsg_data(cur), blobmsg_data_len(cur));
+		struct interface_assignment_class *c = malloc(sizeof(*c));
+		if (!c)
+			continue;
+
+		c->name = str_intern(blobmsg_data(cur));
+		if (!c->name) {
+			free(c);
+			continue;
+		}
+
 		list_add(&c->head, &iface->assignment_classes);
 	}
 }
@@ -519,6 +531,7 @@ interface_clear_assignment_classes(struct interface *iface)
 		struct interface_assignment_class *c = list_first_entry(&iface->assignment_classes,
 				struct interface_assignment_class, head);
 		list_del(&c->head);
+		str_release(c->name);
 		free(c);
 	}
 }
@@ -547,10 +560,11 @@ interface_merge_assignment_data(struct interface *old, struct interface *new)
 		struct interface_assignment_class *c_old = list_first_entry(&old->assignment_classes,
 				struct interface_assignment_class, head);
 
-		if (strcmp(c_old->name, c->name)) /* An entry didn't match */
+		if (c_old->name != c->name) /* An entry didn't match */
 			break;
 
 		list_del(&c_old->head);
+		str_release(c_old->name);
 		free(c_old);
 	}
 
@@ -691,6 +705,7 @@ interface_do_free(struct interface *iface)
 	if (iface->jail_ifname)
 		free(iface->jail_ifname);
 
+	str_release(iface->name);
 	free(iface);
 }
 
@@ -723,6 +738,42 @@ interface_handle_config_change(struct interface *iface)
 		interface_set_up(iface);
 }
 
+/* time of the first start and whether a default route has shown up since */
+static struct timespec start_ts;
+static bool first_route_seen;
+static unsigned int start_batch;
+
+static bool
+interface_has_default_route(struct interface_ip_settings *ip)
+{
+	struct device_route *route;
+
+	vlist_for_each_element(&ip->route, route, node)
+		if (route->enabled && !route->mask)
+			return true;
+
+	return false;
+}
+
+static void
+interface_check_first_route(struct interface *iface)
+{
+	struct timespec now;
+
+	if (first_route_seen || !start_ts.tv_sec)
+		return;
+
+	if (!interface_has_default_route(&iface->proto_ip) &&
+	    !interface_has_default_route(&iface->config_ip))
+		return;
+
+	first_route_seen = true;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	netifd_log_message(L_NOTICE, "Interface '%s' provided the first default route after %ld ms\n",
+			   iface->name, (long) ((now.tv_sec - start_ts.tv_sec) * 1000 +
+					       (now.tv_nsec - start_ts.tv_nsec) / 1000000));
+}
+
 static void
 interface_proto_event_cb(struct interface_proto_state *state, enum interface_proto_event ev)
 {
@@ -746,6 +797,7 @@ interface_proto_event_cb(struct interface_proto_state *state, enum interface_pro
 		iface->start_time = system_get_rtime();
 		interface_event(iface, IFEV_UP);
 		netifd_log_message(L_NOTICE, "Interface '%s' is now up\n", iface->name);
+		interface_check_first_route(iface);
 		break;
 	case IFPEV_DOWN:
 		if (iface->state == IFS_DOWN)
@@ -796,11 +848,18 @@ interface_alloc(const char *name, struct blob_attr *config, bool dynamic)
 	struct blob_attr *tb[IFACE_ATTR_MAX];
 	struct blob_attr *cur;
 	const char *proto_name = NULL;
-	char *iface_name;
 	bool force_link = false;
 
-	iface = calloc_a(sizeof(*iface), &iface_name, strlen(name) + 1);
-	iface->name = strcpy(iface_name, name);
+	iface = calloc(1, sizeof(*iface));
+	if (!iface)
+		return NULL;
+
+	iface->name = str_intern(name);
+	if (!iface->name) {
+		free(iface);
+		return NULL;
+	}
+
 	INIT_LIST_HEAD(&iface->errors);
 	INIT_LIST_HEAD(&iface->users);
 	INIT_LIST_HEAD(&iface->hotplug_list);
@@ -813,7 +872,7 @@ interface_alloc(const char *name, struct blob_attr *config, bool dynamic)
 	iface->l3_dev.cb = interface_l3_dev_cb;
 	iface->ext_dev.cb = interface_ext_dev_cb;
 
-	blobmsg_parse(iface_attrs, IFACE_ATTR_MAX, tb,
+	blobmsg_parse_cached(iface_attrs, IFACE_ATTR_MAX, tb,
 		      blob_data(config), blob_len(config));
 
 	if ((cur = tb[IFACE_ATTR_PROTO]))
@@ -843,6 +902,9 @@ interface_alloc(const char *name, struct blob_attr *config, bool dynamic)
 	if ((cur = tb[IFACE_ATTR_METRIC]))
 		iface->metric = blobmsg_get_u32(cur);
 
+	if ((cur = tb[IFACE_ATTR_START_PRIORITY]))
+		iface->start_priority = blobmsg_get_u32(cur);
+
 	if ((cur = tb[IFACE_ATTR_IP6ASSIGN]))
 		iface->assignment_length = blobmsg_get_u32(cur);
 
@@ -915,9 +977,9 @@ static bool __interface_add(struct interface *iface, struct blob_attr *config, b
 {
 	struct blob_attr *tb[IFACE_ATTR_MAX];
 	struct blob_attr *cur;
-	char *name = NULL;
+	const char *name = NULL;
 
-	blobmsg_parse(iface_attrs, IFACE_ATTR_MAX, tb,
+	blobmsg_parse_cached(iface_attrs, IFACE_ATTR_MAX, tb,
 		      blob_data(config), blob_len(config));
 
 	if (alias) {
@@ -931,19 +993,16 @@ static bool __interface_add(struct interface *iface, struct blob_attr *config, b
 			iface->ifname = blobmsg_data(cur);
 	}
 
-	if (iface->dynamic) {
-		name = strdup(iface->name);
-
-		if (!name)
-			return false;
-	}
+	/* iface may be freed by vlist_add, keep a reference to its name */
+	if (iface->dynamic)
+		name = str_intern(iface->name);
 
 	iface->config = config;
 	vlist_add(&interfaces, &iface->node, iface->name);
 
 	if (name) {
 		iface = vlist_find(&interfaces, name, iface, node);
-		free(name);
+		str_release(name);
 
 		/* Don't delete dynamic interface on reload */
 		if (iface)
@@ -1103,6 +1162,13 @@ interface_set_up(struct interface *iface)
 	if (iface->state != IFS_DOWN)
 		return;
 
+	/*
+	 * in a shard worker the device only shows up once the coordinator
+	 * has set it up for us, which makes the interface available
+	 */
+	if (iface->main_dev.dev && iface->main_dev.dev->shared)
+		shard_device_claim(iface->main_dev.dev, true);
+
 	interface_clear_errors(iface);
 	if (iface->available) {
 		if (iface->main_dev.dev) {
@@ -1144,15 +1210,90 @@ interface_renew(struct interface *iface)
 	return interface_proto_event(iface->proto, PROTO_CMD_RENEW, false);
 }
 
-void
-interface_start_pending(void)
+static int
+interface_start_cmp(const void *k1, const void *k2)
 {
-	struct interface *iface;
+	const struct interface *i1 = *(const struct interface **) k1;
+	const struct interface *i2 = *(const struct interface **) k2;
 
-	vlist_for_each_element(&interfaces, iface, node) {
+	if (i1->start_priority != i2->start_priority)
+		return i1->start_priority > i2->start_priority ? -1 : 1;
+
+	return strcmp(i1->name, i2->name);
+}
+
+/*
+ * Start pending interfaces in descending start_priority order. Interfaces
+ * with a positive priority are all started right away. If start_batch is
+ * set, the rest are started that many at a time, one batch per main loop
+ * iteration. This keeps the uplinks from waiting behind hundreds of LAN
+ * interfaces.
+ */
+static void
+interface_start_next(struct uloop_timeout *t)
+{
+	struct interface *iface, **list;
+	int i, n = 0, started = 0;
+
+	vlist_for_each_element(&interfaces, iface, node)
+		if (iface->start_pending)
+			n++;
+
+	if (!n)
+		return;
+
+	list = calloc(n, sizeof(*list));
+	if (!list)
+		return;
+
+	n = 0;
+	vlist_for_each_element(&interfaces, iface, node)
+		if (iface->start_pending)
+			list[n++] = iface;
+
+	qsort(list, n, sizeof(*list), interface_start_cmp);
+
+	for (i = 0; i < n; i++) {
+		iface = list[i];
+		if (start_batch && iface->start_priority <= 0 && started >= start_batch)
+			break;
+
+		iface->start_pending = false;
 		if (iface->autostart)
 			interface_set_up(iface);
+
+		if (iface->start_priority <= 0)
+			started++;
 	}
+
+	if (i < n)
+		uloop_timeout_set(t, 0);
+
+	free(list);
+}
+
+static struct uloop_timeout start_timer = {
+	.cb = interface_start_next,
+};
+
+void
+interface_set_start_batch(unsigned int batch)
+{
+	start_batch = batch;
+}
+
+void
+interface_start_pending(void)
+{
+	struct interface *iface;
+
+	if (!start_ts.tv_sec)
+		clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+	vlist_for_each_element(&interfaces, iface, node)
+		iface->start_pending = iface->autostart;
+
+	interface_start_next(&start_timer);
 }
 
 void
@@ -1275,10 +1416,41 @@ interface_update_start(struct interface *iface, const bool keep_old)
 		interface_ip_update_start(&iface->proto_ip);
 }
 
+static uint32_t
+interface_proto_fingerprint(struct interface *iface)
+{
+	struct interface_data *d;
+	uint32_t crc;
+
+	crc = interface_ip_fingerprint(&iface->proto_ip, 0);
+
+	/* resolv.conf entries are scoped to the l3 device */
+	if (iface->l3_dev.dev)
+		crc = crc32_update(crc, iface->l3_dev.dev->ifname,
+				   strlen(iface->l3_dev.dev->ifname) + 1);
+	avl_for_each_element(&iface->data, d, node)
+		crc = crc32_update(crc, d->data, blob_pad_len(d->data));
+
+	return crc;
+}
+
 void
 interface_update_complete(struct interface *iface)
 {
-	interface_ip_update_complete(&iface->proto_ip);
+	uint32_t fingerprint;
+
+	interface_ip_update_flush(&iface->proto_ip);
+
+	/* skip resolv.conf and hotplug/ubus updates on no-op renewals */
+	fingerprint = interface_proto_fingerprint(iface);
+	if (iface->state == IFS_UP && fingerprint == iface->proto_fingerprint) {
+		D(INTERFACE, "Interface '%s' proto state unchanged\n", iface->name);
+		iface->updated = 0;
+		return;
+	}
+
+	iface->proto_fingerprint = fingerprint;
+	interface_write_resolv_conf(iface->jail);
 }
 
 static void
@@ -1294,9 +1466,6 @@ interface_device_config_changed(struct interface *if_old, struct interface *if_n
 	struct blob_attr *ntb[__DEV_ATTR_MAX];
 	struct blob_attr *otb[__DEV_ATTR_MAX];
 	struct device *dev = if_old->main_dev.dev;
-	unsigned long diff = 0;
-
-	BUILD_BUG_ON(sizeof(diff) < __DEV_ATTR_MAX / 8);
 
 	if (!dev)
 		return false;
@@ -1307,14 +1476,16 @@ interface_device_config_changed(struct interface *if_old, struct interface *if_n
 	if (!if_new->device_config)
 		return false;
 
-	blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, otb,
+	if (blob_attr_equal(if_old->config, if_new->config))
+		return false;
+
+	blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, otb,
 		blob_data(if_old->config), blob_len(if_old->config));
 
-	blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, ntb,
+	blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, ntb,
 		blob_data(if_new->config), blob_len(if_new->config));
 
-	uci_blob_diff(ntb, otb, &device_attr_list, &diff);
-	return diff;
+	return uci_blob_diff(ntb, otb, &device_attr_list, NULL);
 }
 
 static void
@@ -1344,7 +1515,8 @@ interface_change_config(struct interface *if_old, struct interface *if_new)
 	if (!if_old->proto_handler->config_params)
 		D(INTERFACE, "No config parameters for interface '%s'\n",
 		  if_old->name);
-	else if (!uci_blob_check_equal(if_old->config, if_new->config,
+	else if (!blob_attr_equal(if_old->config, if_new->config) &&
+		 !uci_blob_check_equal(if_old->config, if_new->config,
 				       if_old->proto_handler->config_params))
 		reload = true;
 
@@ -1382,6 +1554,7 @@ interface_change_config(struct interface *if_old, struct interface *if_new)
 	if_old->proto_handler = if_new->proto_handler;
 	if_old->force_link = if_new->force_link;
 	if_old->dns_metric = if_new->dns_metric;
+	if_old->start_priority = if_new->start_priority;
 
 	if (if_old->proto_ip.no_delegation != if_new->proto_ip.no_delegation) {
 		if_old->proto_ip.no_delegation = if_new->proto_ip.no_delegation;
@@ -1428,6 +1601,7 @@ out:
 	if_new->config = NULL;
 	interface_cleanup(if_new);
 	free(old_config);
+	str_release(if_new->name);
 	free(if_new);
 }
 
@@ -1457,7 +1631,7 @@ interface_update(struct vlist_tree *tree, struct vlist_node *node_new,
 static void __init
 interface_init_list(void)
 {
-	vlist_init(&interfaces, avl_strcmp, interface_update);
+	vlist_init(&interfaces, avl_atomcmp, interface_update);
 	interfaces.keep_old = true;
 	interfaces.no_delete = true;
 }
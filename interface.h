@@ -95,7 +95,7 @@ struct interface_data {
 
 struct interface_assignment_class {
 	struct list_head head;
-	char name[];
+	const char *name; /* interned */
 };
 
 /*
@@ -106,7 +106,7 @@ struct interface {
 	struct list_head hotplug_list;
 	enum interface_event hotplug_ev;
 
-	const char *name;
+	const char *name; /* interned */
 	const char *ifname;
 	char *jail;
 	char *jail_ifname;
@@ -127,6 +127,7 @@ struct interface {
 	enum interface_state state;
 	enum interface_config_state config_state;
 	enum interface_update_flags updated;
+	uint32_t proto_fingerprint;
 
 	struct list_head users;
 
@@ -154,6 +155,8 @@ struct interface {
 
 	int metric;
 	int dns_metric;
+	int start_priority;
+	bool start_pending;
 	unsigned int ip4table;
 	unsigned int ip6table;
 
@@ -208,6 +211,7 @@ void interface_update_start(struct interface *iface, const bool keep_old);
 void interface_update_complete(struct interface *iface);
 
 void interface_start_pending(void);
+void interface_set_start_batch(unsigned int batch);
 void interface_start_jail(const char *jail, const pid_t netns_pid);
 void interface_stop_jail(const char *jail, const pid_t netns_pid);
 
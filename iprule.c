@@ -181,10 +181,10 @@ generic_interface_cb(struct interface_user *dep,
 		if (rule_ready(rule))
 			continue;
 
-		if ((rule->flags & IPRULE_OUT) && !strcmp(rule->out_iface, iface->name))
+		if ((rule->flags & IPRULE_OUT) && rule->out_iface == iface->name)
 			interface_add_user(&rule->out_iface_user, iface);
 
-		if ((rule->flags & IPRULE_IN) && !strcmp(rule->in_iface, iface->name))
+		if ((rule->flags & IPRULE_IN) && rule->in_iface == iface->name)
 			interface_add_user(&rule->in_iface_user, iface);
 	}
 }
@@ -198,7 +198,6 @@ iprule_add(struct blob_attr *attr, bool v6)
 {
 	struct blob_attr *tb[__RULE_MAX], *cur;
 	struct iprule *rule;
-	char *iface_name;
 	int af = v6 ? AF_INET6 : AF_INET;
 
 	blobmsg_parse(rule_attr, __RULE_MAX, tb, blobmsg_data(attr), blobmsg_data_len(attr));
@@ -214,15 +213,19 @@ iprule_add(struct blob_attr *attr, bool v6)
 		rule->invert = blobmsg_get_bool(cur);
 
 	if ((cur = tb[RULE_INTERFACE_IN]) != NULL) {
-		iface_name = calloc(1, strlen(blobmsg_data(cur)) + 1);
-		rule->in_iface = strcpy(iface_name, blobmsg_data(cur));
+		rule->in_iface = str_intern(blobmsg_data(cur));
+		if (!rule->in_iface)
+			goto error;
+
 		rule->in_iface_user.cb = &rule_in_cb;
 		rule->flags |= IPRULE_IN;
 	}
 
 	if ((cur = tb[RULE_INTERFACE_OUT]) != NULL) {
-		iface_name = calloc(1, strlen(blobmsg_data(cur)) + 1);
-		rule->out_iface = strcpy(iface_name, blobmsg_data(cur));
+		rule->out_iface = str_intern(blobmsg_data(cur));
+		if (!rule->out_iface)
+			goto error;
+
 		rule->out_iface_user.cb = &rule_out_cb;
 		rule->flags |= IPRULE_OUT;
 	}
@@ -294,6 +297,8 @@ iprule_add(struct blob_attr *attr, bool v6)
 	return;
 
 error:
+	str_release(rule->in_iface);
+	str_release(rule->out_iface);
 	free(rule);
 }
 
@@ -325,8 +330,8 @@ rule_cmp(const void *k1, const void *k2, void *ptr)
 
 	/* First compare the interface names */
 	if (r1->flags & IPRULE_IN || r2->flags & IPRULE_IN) {
-		char *str1 = r1->flags & IPRULE_IN ? r1->in_iface : "";
-		char *str2 = r2->flags & IPRULE_IN ? r2->in_iface : "";
+		const char *str1 = r1->flags & IPRULE_IN ? r1->in_iface : "";
+		const char *str2 = r2->flags & IPRULE_IN ? r2->in_iface : "";
 
 		ret = strcmp(str1, str2);
 		if (ret)
@@ -334,8 +339,8 @@ rule_cmp(const void *k1, const void *k2, void *ptr)
 	}
 
 	if (r1->flags & IPRULE_OUT || r2->flags & IPRULE_OUT) {
-		char *str1 = r1->flags & IPRULE_OUT ? r1->out_iface : "";
-		char *str2 = r2->flags & IPRULE_OUT ? r2->out_iface : "";
+		const char *str1 = r1->flags & IPRULE_OUT ? r1->out_iface : "";
+		const char *str2 = r2->flags & IPRULE_OUT ? r2->out_iface : "";
 
 		ret = strcmp(str1, str2);
 		if (ret)
@@ -389,11 +394,8 @@ iprule_update_rule(struct vlist_tree *tree,
 		if (rule_old->flags & (IPRULE_IN | IPRULE_OUT))
 			deregister_interfaces(rule_old);
 
-		if (rule_old->in_iface)
-			free(rule_old->in_iface);
-
-		if (rule_old->out_iface)
-			free(rule_old->out_iface);
+		str_release(rule_old->in_iface);
+		str_release(rule_old->out_iface);
 
 		free(rule_old);
 	}
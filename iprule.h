@@ -80,9 +80,9 @@ struct iprule {
 	/* everything below is used as avl tree key */
 	/* don't change the order                   */
 
-	/* uci interface name */
-	char *in_iface;
-	char *out_iface;
+	/* uci interface name, interned */
+	const char *in_iface;
+	const char *out_iface;
 
 	enum iprule_flags flags;
 
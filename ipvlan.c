@@ -0,0 +1,314 @@
+/*
+ * netifd - network interface daemon
+ * Copyright (C) 2012 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "netifd.h"
+#include "device.h"
+#include "interface.h"
+#include "system.h"
+
+enum {
+	IPVLAN_ATTR_IFNAME,
+	IPVLAN_ATTR_MODE,
+	IPVLAN_ATTR_FLAG,
+	IPVLAN_ATTR_NETNS,
+	__IPVLAN_ATTR_MAX
+};
+
+static const struct blobmsg_policy ipvlan_attrs[__IPVLAN_ATTR_MAX] = {
+	[IPVLAN_ATTR_IFNAME]  = { "ifname", BLOBMSG_TYPE_STRING },
+	[IPVLAN_ATTR_MODE] = { "mode", BLOBMSG_TYPE_STRING },
+	[IPVLAN_ATTR_FLAG] = { "flag", BLOBMSG_TYPE_STRING },
+	[IPVLAN_ATTR_NETNS] = { "netns", BLOBMSG_TYPE_STRING },
+};
+
+static const struct uci_blob_param_list ipvlan_attr_list = {
+	.n_params = __IPVLAN_ATTR_MAX,
+	.params = ipvlan_attrs,
+
+	.n_next = 1,
+	.next = { &device_attr_list },
+};
+
+struct ipvlan_device {
+	struct device dev;
+	struct device_user parent;
+
+	device_state_cb set_state;
+
+	struct blob_attr *config_data;
+	struct blob_attr *ifname;
+	struct ipvlan_config config;
+
+	/* namespace the link was created in, config may change while it is up */
+	char *netns;
+};
+
+static void
+ipvlan_base_cb(struct device_user *dev, enum device_event ev)
+{
+	struct ipvlan_device *ipvdev = container_of(dev, struct ipvlan_device, parent);
+
+	switch (ev) {
+	case DEV_EVENT_ADD:
+		device_set_present(&ipvdev->dev, true);
+		break;
+	case DEV_EVENT_REMOVE:
+		device_set_present(&ipvdev->dev, false);
+		break;
+	default:
+		return;
+	}
+}
+
+static void
+ipvlan_delete(struct ipvlan_device *ipvdev)
+{
+	system_ipvlan_del(&ipvdev->dev, ipvdev->netns);
+	free(ipvdev->netns);
+	ipvdev->netns = NULL;
+}
+
+static int
+ipvlan_set_down(struct ipvlan_device *ipvdev)
+{
+	if (!ipvdev->netns)
+		ipvdev->set_state(&ipvdev->dev, false);
+	ipvlan_delete(ipvdev);
+	device_release(&ipvdev->parent);
+
+	return 0;
+}
+
+static int
+ipvlan_set_up(struct ipvlan_device *ipvdev)
+{
+	int ret;
+
+	ret = device_claim(&ipvdev->parent);
+	if (ret < 0)
+		return ret;
+
+	ret = system_ipvlan_add(&ipvdev->dev, ipvdev->parent.dev, &ipvdev->config);
+	if (ret < 0)
+		goto release;
+
+	/* a link created in another namespace is managed by its owner */
+	if (ipvdev->config.netns) {
+		ipvdev->netns = strdup(ipvdev->config.netns);
+		return 0;
+	}
+
+	ret = ipvdev->set_state(&ipvdev->dev, true);
+	if (ret)
+		goto delete;
+
+	return 0;
+
+delete:
+	ipvlan_delete(ipvdev);
+release:
+	device_release(&ipvdev->parent);
+	return ret;
+}
+
+static int
+ipvlan_set_state(struct device *dev, bool up)
+{
+	struct ipvlan_device *ipvdev;
+
+	D(SYSTEM, "ipvlan_set_state(%s, %u)\n", dev->ifname, up);
+
+	ipvdev = container_of(dev, struct ipvlan_device, dev);
+	if (up)
+		return ipvlan_set_up(ipvdev);
+	else
+		return ipvlan_set_down(ipvdev);
+}
+
+static void
+ipvlan_free(struct device *dev)
+{
+	struct ipvlan_device *ipvdev;
+
+	ipvdev = container_of(dev, struct ipvlan_device, dev);
+	device_remove_user(&ipvdev->parent);
+	free(ipvdev->netns);
+	free(ipvdev->config_data);
+	free(ipvdev);
+}
+
+static void
+ipvlan_dump_info(struct device *dev, struct blob_buf *b)
+{
+	struct ipvlan_device *ipvdev;
+
+	ipvdev = container_of(dev, struct ipvlan_device, dev);
+	blobmsg_add_string(b, "parent", ipvdev->parent.dev->ifname);
+	if (ipvdev->config.mode)
+		blobmsg_add_string(b, "mode", ipvdev->config.mode);
+	if (ipvdev->config.netns) {
+		blobmsg_add_string(b, "netns", ipvdev->config.netns);
+		return;
+	}
+
+	system_if_dump_info(dev, b);
+}
+
+static void
+ipvlan_config_init(struct device *dev)
+{
+	struct ipvlan_device *ipvdev;
+	struct device *basedev = NULL;
+
+	ipvdev = container_of(dev, struct ipvlan_device, dev);
+	if (ipvdev->ifname)
+		basedev = device_get(blobmsg_data(ipvdev->ifname), true);
+
+	device_add_user(&ipvdev->parent, basedev);
+}
+
+static bool
+ipvlan_check_option(const char *val, const char * const *valid)
+{
+	for (; *valid; valid++)
+		if (!strcmp(val, *valid))
+			return true;
+
+	return false;
+}
+
+static void
+ipvlan_apply_settings(struct ipvlan_device *ipvdev, struct blob_attr **tb)
+{
+	static const char * const modes[] = { "l2", "l3", "l3s", NULL };
+	static const char * const flags[] = { "bridge", "private", "vepa", NULL };
+	struct ipvlan_config *cfg = &ipvdev->config;
+	struct blob_attr *cur;
+
+	cfg->mode = NULL;
+	cfg->flag = NULL;
+	cfg->netns = NULL;
+
+	if ((cur = tb[IPVLAN_ATTR_MODE])) {
+		if (ipvlan_check_option(blobmsg_data(cur), modes))
+			cfg->mode = blobmsg_data(cur);
+		else
+			DPRINTF("Invalid ipvlan mode: %s\n", (char *) blobmsg_data(cur));
+	}
+
+	if ((cur = tb[IPVLAN_ATTR_FLAG])) {
+		if (ipvlan_check_option(blobmsg_data(cur), flags))
+			cfg->flag = blobmsg_data(cur);
+		else
+			DPRINTF("Invalid ipvlan flag: %s\n", (char *) blobmsg_data(cur));
+	}
+
+	if ((cur = tb[IPVLAN_ATTR_NETNS]))
+		cfg->netns = blobmsg_data(cur);
+}
+
+static enum dev_change_type
+ipvlan_reload(struct device *dev, struct blob_attr *attr)
+{
+	struct blob_attr *tb_dev[__DEV_ATTR_MAX];
+	struct blob_attr *tb_mv[__IPVLAN_ATTR_MAX];
+	enum dev_change_type ret = DEV_CONFIG_APPLIED;
+	struct ipvlan_device *ipvdev;
+
+	ipvdev = container_of(dev, struct ipvlan_device, dev);
+	attr = blob_memdup(attr);
+
+	blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
+		blob_data(attr), blob_len(attr));
+	blobmsg_parse(ipvlan_attrs, __IPVLAN_ATTR_MAX, tb_mv,
+		blob_data(attr), blob_len(attr));
+
+	device_init_settings(dev, tb_dev);
+	ipvlan_apply_settings(ipvdev, tb_mv);
+	ipvdev->ifname = tb_mv[IPVLAN_ATTR_IFNAME];
+
+	if (ipvdev->config_data) {
+		struct blob_attr *otb_dev[__DEV_ATTR_MAX];
+		struct blob_attr *otb_mv[__IPVLAN_ATTR_MAX];
+
+		blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
+			blob_data(ipvdev->config_data), blob_len(ipvdev->config_data));
+
+		if (uci_blob_diff(tb_dev, otb_dev, &device_attr_list, NULL))
+		    ret = DEV_CONFIG_RESTART;
+
+		blobmsg_parse(ipvlan_attrs, __IPVLAN_ATTR_MAX, otb_mv,
+			blob_data(ipvdev->config_data), blob_len(ipvdev->config_data));
+
+		if (uci_blob_diff(tb_mv, otb_mv, &ipvlan_attr_list, NULL))
+		    ret = DEV_CONFIG_RESTART;
+
+		ipvlan_config_init(dev);
+	}
+
+	free(ipvdev->config_data);
+	ipvdev->config_data = attr;
+	return ret;
+}
+
+static struct device *
+ipvlan_create(const char *name, struct device_type *devtype,
+	struct blob_attr *attr)
+{
+	struct ipvlan_device *ipvdev;
+	struct device *dev = NULL;
+
+	ipvdev = calloc(1, sizeof(*ipvdev));
+	if (!ipvdev)
+		return NULL;
+
+	dev = &ipvdev->dev;
+	if (device_init(dev, devtype, name) < 0) {
+		device_cleanup(dev);
+		free(ipvdev);
+		return NULL;
+	}
+
+	dev->config_pending = true;
+
+	ipvdev->set_state = dev->set_state;
+	dev->set_state = ipvlan_set_state;
+
+	dev->hotplug_ops = NULL;
+	ipvdev->parent.cb = ipvlan_base_cb;
+
+	ipvlan_reload(dev, attr);
+
+	return dev;
+}
+
+static struct device_type ipvlan_device_type = {
+	.name = "ipvlan",
+	.config_params = &ipvlan_attr_list,
+	.create = ipvlan_create,
+	.config_init = ipvlan_config_init,
+	.reload = ipvlan_reload,
+	.free = ipvlan_free,
+	.dump_info = ipvlan_dump_info,
+};
+
+static void __init ipvlan_device_type_init(void)
+{
+	device_type_add(&ipvlan_device_type);
+}
@@ -0,0 +1,191 @@
+/*
+ * netifd - network interface daemon
+ * Copyright (C) 2012 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "netifd.h"
+#include "job.h"
+
+#define JOB_THREADS	4
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+
+/* protected by job_lock */
+static LIST_HEAD(job_pending);
+static LIST_HEAD(job_finished);
+static bool job_stop;
+
+/* main thread only */
+static pthread_t job_threads[JOB_THREADS];
+static int job_n_threads;
+static int job_active;
+
+static struct uloop_fd job_fd = { .fd = -1 };
+
+static void *
+job_thread(void *arg)
+{
+	struct netifd_job *job;
+	uint64_t val = 1;
+
+	pthread_mutex_lock(&job_lock);
+	while (1) {
+		while (!job_stop && list_empty(&job_pending))
+			pthread_cond_wait(&job_cond, &job_lock);
+
+		if (job_stop)
+			break;
+
+		job = list_first_entry(&job_pending, struct netifd_job, list);
+		list_del(&job->list);
+		pthread_mutex_unlock(&job_lock);
+
+		job->run(job);
+
+		pthread_mutex_lock(&job_lock);
+		list_add_tail(&job->list, &job_finished);
+		if (write(job_fd.fd, &val, sizeof(val)) < 0) {}
+	}
+	pthread_mutex_unlock(&job_lock);
+
+	return NULL;
+}
+
+static void
+job_complete_finished(void)
+{
+	struct netifd_job *job;
+	LIST_HEAD(done);
+
+	pthread_mutex_lock(&job_lock);
+	list_splice_init(&job_finished, &done);
+	pthread_mutex_unlock(&job_lock);
+
+	while (!list_empty(&done)) {
+		job = list_first_entry(&done, struct netifd_job, list);
+		list_del(&job->list);
+		job_active--;
+		job->complete(job);
+	}
+}
+
+static void
+job_fd_cb(struct uloop_fd *fd, unsigned int events)
+{
+	uint64_t val;
+
+	if (read(fd->fd, &val, sizeof(val)) < 0) {}
+
+	job_complete_finished();
+}
+
+void job_queue(struct netifd_job *job)
+{
+	/* no pool available, fall back to doing the work inline */
+	if (!job_n_threads) {
+		job->run(job);
+		job->complete(job);
+		return;
+	}
+
+	job_active++;
+
+	pthread_mutex_lock(&job_lock);
+	list_add_tail(&job->list, &job_pending);
+	pthread_cond_signal(&job_cond);
+	pthread_mutex_unlock(&job_lock);
+}
+
+/* Block until every queued job has run and been completed */
+void job_wait(void)
+{
+	struct pollfd pfd = {
+		.fd = job_fd.fd,
+		.events = POLLIN,
+	};
+	uint64_t val;
+
+	while (job_active) {
+		job_complete_finished();
+		if (!job_active)
+			break;
+
+		if (poll(&pfd, 1, -1) > 0 &&
+		    read(pfd.fd, &val, sizeof(val)) < 0) {}
+	}
+}
+
+void job_init(void)
+{
+	sigset_t set, oldset;
+	int i;
+
+	job_fd.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (job_fd.fd < 0) {
+		netifd_log_message(L_WARNING, "Failed to create job eventfd, running jobs inline\n");
+		return;
+	}
+
+	/* signals are handled by uloop on the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &oldset);
+
+	for (i = 0; i < JOB_THREADS; i++) {
+		if (pthread_create(&job_threads[i], NULL, job_thread, NULL))
+			break;
+
+		job_n_threads++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	if (!job_n_threads) {
+		netifd_log_message(L_WARNING, "Failed to start job threads, running jobs inline\n");
+		close(job_fd.fd);
+		job_fd.fd = -1;
+		return;
+	}
+
+	job_fd.cb = job_fd_cb;
+	uloop_fd_add(&job_fd, ULOOP_READ);
+}
+
+void job_done(void)
+{
+	int i;
+
+	if (!job_n_threads)
+		return;
+
+	job_wait();
+
+	pthread_mutex_lock(&job_lock);
+	job_stop = true;
+	pthread_cond_broadcast(&job_cond);
+	pthread_mutex_unlock(&job_lock);
+
+	for (i = 0; i < job_n_threads; i++)
+		pthread_join(job_threads[i], NULL);
+	job_n_threads = 0;
+
+	uloop_fd_delete(&job_fd);
+	close(job_fd.fd);
+	job_fd.fd = -1;
+}
@@ -0,0 +1,38 @@
+/*
+ * netifd - network interface daemon
+ * Copyright (C) 2012 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __NETIFD_JOB_H
+#define __NETIFD_JOB_H
+
+#include <libubox/list.h>
+
+/*
+ * Blocking file and process I/O can be handed to a small pool of
+ * threads. run() is called on a pool thread and must not touch any
+ * netifd state; complete() is called afterwards from the main loop,
+ * where the result can be applied.
+ */
+struct netifd_job {
+	struct list_head list;
+
+	void (*run)(struct netifd_job *job);
+	void (*complete)(struct netifd_job *job);
+};
+
+void job_init(void);
+void job_done(void);
+
+void job_queue(struct netifd_job *job);
+void job_wait(void);
+
+#endif
@@ -183,6 +183,27 @@ macvlan_apply_settings(struct macvlan_device *mvdev, struct blob_attr **tb)
 		cfg->mode = blobmsg_data(cur);
 }
 
+/*
+ * Apply a new mode or macaddr to the live link. A dropped macaddr can't be
+ * reverted in place, and the kernel refuses switching to or from passthru.
+ */
+static bool
+macvlan_changelink(struct macvlan_device *mvdev, unsigned long diff,
+		   struct blob_attr **otb_mv)
+{
+	if (diff & (1 << MACVLAN_ATTR_IFNAME))
+		return false;
+
+	if (otb_mv[MACVLAN_ATTR_MACADDR] &&
+	    !(mvdev->config.flags & MACVLAN_OPT_MACADDR))
+		return false;
+
+	if (!mvdev->dev.active)
+		return true;
+
+	return !system_macvlan_change(&mvdev->dev, &mvdev->config);
+}
+
 static enum dev_change_type
 macvlan_reload(struct device *dev, struct blob_attr *attr)
 {
@@ -194,7 +215,7 @@ macvlan_reload(struct device *dev, struct blob_attr *attr)
 	mvdev = container_of(dev, struct macvlan_device, dev);
 	attr = blob_memdup(attr);
 
-	blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
+	blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
 		blob_data(attr), blob_len(attr));
 	blobmsg_parse(macvlan_attrs, __MACVLAN_ATTR_MAX, tb_mv,
 		blob_data(attr), blob_len(attr));
@@ -206,8 +227,9 @@ macvlan_reload(struct device *dev, struct blob_attr *attr)
 	if (mvdev->config_data) {
 		struct blob_attr *otb_dev[__DEV_ATTR_MAX];
 		struct blob_attr *otb_mv[__MACVLAN_ATTR_MAX];
+		unsigned long diff = 0;
 
-		blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
+		blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
 			blob_data(mvdev->config_data), blob_len(mvdev->config_data));
 
 		if (uci_blob_diff(tb_dev, otb_dev, &device_attr_list, NULL))
@@ -216,7 +238,9 @@ macvlan_reload(struct device *dev, struct blob_attr *attr)
 		blobmsg_parse(macvlan_attrs, __MACVLAN_ATTR_MAX, otb_mv,
 			blob_data(mvdev->config_data), blob_len(mvdev->config_data));
 
-		if (uci_blob_diff(tb_mv, otb_mv, &macvlan_attr_list, NULL))
+		uci_blob_diff(tb_mv, otb_mv, &macvlan_attr_list, &diff);
+		if (diff && ret == DEV_CONFIG_APPLIED &&
+		    !macvlan_changelink(mvdev, diff, otb_mv))
 		    ret = DEV_CONFIG_RESTART;
 
 		macvlan_config_init(dev);
@@ -26,11 +26,14 @@
 #include "interface.h"
 #include "wireless.h"
 #include "proto.h"
+#include "shard.h"
+#include "job.h"
 
 unsigned int debug_mask = 0;
 const char *main_path = DEFAULT_MAIN_PATH;
 const char *config_path = DEFAULT_CONFIG_PATH;
 const char *resolv_conf = DEFAULT_RESOLV_CONF;
+const char *netifd_shard;
 static char **global_argv;
 
 static struct list_head process_list = LIST_HEAD_INIT(process_list);
@@ -205,6 +208,9 @@ netifd_kill_process(struct netifd_process *proc)
 
 static void netifd_do_restart(struct uloop_timeout *timeout)
 {
+	wireless_save_state();
+	shard_done();
+	job_done();
 	execvp(global_argv[0], global_argv);
 }
 
@@ -236,6 +242,7 @@ static int usage(const char *progname)
 		" -l <level>:		Log output level (default: %d)\n"
 		" -S:			Use stderr instead of syslog for log messages\n"
 		"			(default: "DEFAULT_HOTPLUG_PATH")\n"
+		" -w <shard>:		Run as worker for the given interface shard\n"
 		"\n", progname, main_path, DEFAULT_LOG_LEVEL);
 
 	return 1;
@@ -280,7 +287,7 @@ int main(int argc, char **argv)
 
 	global_argv = argv;
 
-	while ((ch = getopt(argc, argv, "d:s:p:c:h:r:l:S")) != -1) {
+	while ((ch = getopt(argc, argv, "d:s:p:c:h:r:l:Sw:")) != -1) {
 		switch(ch) {
 		case 'd':
 			debug_mask = strtoul(optarg, NULL, 0);
@@ -300,6 +307,9 @@ int main(int argc, char **argv)
 		case 'r':
 			resolv_conf = optarg;
 			break;
+		case 'w':
+			netifd_shard = optarg;
+			break;
 		case 'l':
 			log_level = atoi(optarg);
 			if (log_level >= ARRAY_SIZE(log_class))
@@ -324,7 +334,10 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	job_init();
+	shard_init(argv);
 	proto_shell_init();
+	proto_plugin_init();
 	wireless_init();
 
 	if (system_init()) {
@@ -335,6 +348,9 @@ int main(int argc, char **argv)
 	config_init_all();
 
 	uloop_run();
+	wireless_save_state();
+	shard_done();
+	job_done();
 	netifd_kill_processes();
 
 	netifd_ubus_done();
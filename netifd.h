@@ -33,14 +33,17 @@
 #define DEFAULT_CONFIG_PATH	"./config"
 #define DEFAULT_HOTPLUG_PATH	"./examples/hotplug-cmd"
 #define DEFAULT_RESOLV_CONF	"./tmp/resolv.conf"
+#define DEFAULT_WIRELESS_STATE	"./tmp/wireless-state.json"
 #else
 #define DEFAULT_MAIN_PATH	"/lib/netifd"
 #define DEFAULT_CONFIG_PATH	NULL /* use the default set in libuci */
 #define DEFAULT_HOTPLUG_PATH	"/sbin/hotplug-call"
 #define DEFAULT_RESOLV_CONF	"/tmp/resolv.conf.d/resolv.conf.auto"
+#define DEFAULT_WIRELESS_STATE	"/var/run/netifd-wireless.json"
 #endif
 
 extern const char *resolv_conf;
+extern const char *netifd_shard;
 extern char *hotplug_cmd_path;
 extern unsigned int debug_mask;
 
@@ -0,0 +1,1070 @@
+/*
+ * netifd - network interface daemon
+ * Copyright (C) 2012 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#include "netifd.h"
+#include "interface.h"
+#include "interface-ip.h"
+#include "proto.h"
+#include "system.h"
+
+#define DHCP_SERVER_PORT	67
+#define DHCP_CLIENT_PORT	68
+#define DHCP_MAGIC		0x63825363
+#define DHCP_MIN_LEASE		60
+#define DHCP_MAX_RETRY_TIME	64
+
+enum dhcp_msg_type {
+	DHCPDISCOVER = 1,
+	DHCPOFFER = 2,
+	DHCPREQUEST = 3,
+	DHCPDECLINE = 4,
+	DHCPACK = 5,
+	DHCPNAK = 6,
+	DHCPRELEASE = 7,
+};
+
+enum dhcp_opt {
+	DHCP_OPT_PAD = 0,
+	DHCP_OPT_NETMASK = 1,
+	DHCP_OPT_ROUTER = 3,
+	DHCP_OPT_DNS = 6,
+	DHCP_OPT_HOSTNAME = 12,
+	DHCP_OPT_DOMAIN = 15,
+	DHCP_OPT_BROADCAST = 28,
+	DHCP_OPT_STATIC_ROUTE = 33,
+	DHCP_OPT_REQUEST_IP = 50,
+	DHCP_OPT_LEASE_TIME = 51,
+	DHCP_OPT_MSG_TYPE = 53,
+	DHCP_OPT_SERVER_ID = 54,
+	DHCP_OPT_PARAM_REQ = 55,
+	DHCP_OPT_RENEW_TIME = 58,
+	DHCP_OPT_REBIND_TIME = 59,
+	DHCP_OPT_VENDOR_ID = 60,
+	DHCP_OPT_CLIENT_ID = 61,
+	DHCP_OPT_CLASSLESS_ROUTE = 121,
+	DHCP_OPT_END = 255,
+};
+
+struct dhcp_message {
+	uint8_t op;
+	uint8_t htype;
+	uint8_t hlen;
+	uint8_t hops;
+	uint32_t xid;
+	uint16_t secs;
+	uint16_t flags;
+	struct in_addr ciaddr;
+	struct in_addr yiaddr;
+	struct in_addr siaddr;
+	struct in_addr giaddr;
+	uint8_t chaddr[16];
+	char sname[64];
+	char file[128];
+	uint32_t cookie;
+	uint8_t options[308];
+} __packed;
+
+struct dhcp_packet {
+	struct iphdr ip;
+	struct udphdr udp;
+	struct dhcp_message msg;
+} __packed;
+
+enum dhcp_state {
+	DHCP_S_IDLE,
+	DHCP_S_SELECTING,
+	DHCP_S_REQUESTING,
+	DHCP_S_BOUND,
+	DHCP_S_RENEWING,
+	DHCP_S_REBINDING,
+};
+
+enum {
+	DHCP_ATTR_HOSTNAME,
+	DHCP_ATTR_CLIENTID,
+	DHCP_ATTR_VENDORID,
+	DHCP_ATTR_REQADDRESS,
+	DHCP_ATTR_BROADCAST,
+	DHCP_ATTR_RELEASE,
+	DHCP_ATTR_CLASSLESSROUTE,
+	__DHCP_ATTR_MAX
+};
+
+static const struct blobmsg_policy dhcp_attrs[__DHCP_ATTR_MAX] = {
+	[DHCP_ATTR_HOSTNAME] = { .name = "hostname", .type = BLOBMSG_TYPE_STRING },
+	[DHCP_ATTR_CLIENTID] = { .name = "clientid", .type = BLOBMSG_TYPE_STRING },
+	[DHCP_ATTR_VENDORID] = { .name = "vendorid", .type = BLOBMSG_TYPE_STRING },
+	[DHCP_ATTR_REQADDRESS] = { .name = "reqaddress", .type = BLOBMSG_TYPE_STRING },
+	[DHCP_ATTR_BROADCAST] = { .name = "broadcast", .type = BLOBMSG_TYPE_BOOL },
+	[DHCP_ATTR_RELEASE] = { .name = "release", .type = BLOBMSG_TYPE_BOOL },
+	[DHCP_ATTR_CLASSLESSROUTE] = { .name = "classlessroute", .type = BLOBMSG_TYPE_BOOL },
+};
+
+static const char * const dhcp_validate[__DHCP_ATTR_MAX] = {
+	[DHCP_ATTR_HOSTNAME] = "hostname",
+	[DHCP_ATTR_CLIENTID] = "hexstring",
+	[DHCP_ATTR_VENDORID] = "string",
+	[DHCP_ATTR_REQADDRESS] = "ip4addr",
+	[DHCP_ATTR_BROADCAST] = "bool",
+	[DHCP_ATTR_RELEASE] = "bool",
+	[DHCP_ATTR_CLASSLESSROUTE] = "bool",
+};
+
+static const struct uci_blob_param_list dhcp_attr_list = {
+	.n_params = __DHCP_ATTR_MAX,
+	.params = dhcp_attrs,
+	.validate = dhcp_validate,
+};
+
+struct dhcp_lease {
+	struct in_addr addr;
+	struct in_addr server_id;
+	unsigned int mask;
+	uint32_t broadcast;
+
+	uint32_t lease_time;
+	uint32_t t1;
+	uint32_t t2;
+
+	struct in_addr routers[4];
+	int n_routers;
+
+	struct in_addr dns[4];
+	int n_dns;
+
+	char domain[256];
+
+	uint8_t classless[256];
+	int classless_len;
+
+	uint8_t static_routes[256];
+	int static_routes_len;
+};
+
+struct dhcp_proto_state {
+	struct interface_proto_state proto;
+	struct blob_attr *config;
+
+	struct uloop_fd fd;
+	struct uloop_timeout timer;
+	time_t timer_deadline;
+
+	enum dhcp_state state;
+	uint32_t xid;
+	int retry;
+	time_t start;
+
+	uint8_t macaddr[ETH_ALEN];
+	uint8_t server_hwaddr[ETH_ALEN];
+	int ifindex;
+
+	struct dhcp_lease lease;
+	time_t bound_time;
+
+	const char *hostname;
+	const char *vendorid;
+	uint8_t clientid[64];
+	int clientid_len;
+	struct in_addr reqaddr;
+	bool broadcast;
+	bool release;
+	bool classlessroute;
+};
+
+static const uint8_t dhcp_param_req[] = {
+	DHCP_OPT_NETMASK,
+	DHCP_OPT_ROUTER,
+	DHCP_OPT_DNS,
+	DHCP_OPT_DOMAIN,
+	DHCP_OPT_BROADCAST,
+	DHCP_OPT_STATIC_ROUTE,
+	DHCP_OPT_LEASE_TIME,
+	DHCP_OPT_RENEW_TIME,
+	DHCP_OPT_REBIND_TIME,
+	DHCP_OPT_CLASSLESS_ROUTE,
+};
+
+/* only pass non-fragmented UDP packets to the client port */
+static struct sock_filter dhcp_sock_filter[] = {
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, offsetof(struct iphdr, protocol)),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 5),
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, offsetof(struct iphdr, frag_off)),
+	BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 3, 0),
+	BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+	BPF_STMT(BPF_LD | BPF_H | BPF_IND, offsetof(struct udphdr, dest)),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, DHCP_CLIENT_PORT, 1, 0),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+	BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+};
+
+static void dhcp_timer_cb(struct uloop_timeout *t);
+
+static uint16_t
+dhcp_checksum(uint32_t sum, const void *data, size_t len)
+{
+	const uint8_t *buf = data;
+	size_t i;
+
+	for (i = 0; i + 1 < len; i += 2)
+		sum += (buf[i] << 8) | buf[i + 1];
+
+	if (len & 1)
+		sum += buf[len - 1] << 8;
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+static uint8_t *
+dhcp_put_option(uint8_t *opt, uint8_t *end, uint8_t code, const void *data, size_t len)
+{
+	if (len > 255 || opt + len + 2 >= end)
+		return opt;
+
+	*opt++ = code;
+	*opt++ = len;
+	memcpy(opt, data, len);
+
+	return opt + len;
+}
+
+static void
+dhcp_close_socket(struct dhcp_proto_state *state)
+{
+	if (state->fd.fd < 0)
+		return;
+
+	uloop_fd_delete(&state->fd);
+	close(state->fd.fd);
+	state->fd.fd = -1;
+}
+
+static int
+dhcp_open_socket(struct dhcp_proto_state *state)
+{
+	struct sockaddr_ll sll = {
+		.sll_family = AF_PACKET,
+		.sll_protocol = htons(ETH_P_IP),
+		.sll_ifindex = state->ifindex,
+	};
+	struct sock_fprog prog = {
+		.len = ARRAY_SIZE(dhcp_sock_filter),
+		.filter = dhcp_sock_filter,
+	};
+	int fd;
+
+	dhcp_close_socket(state);
+
+	fd = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, htons(ETH_P_IP));
+	if (fd < 0)
+		return -1;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0 ||
+	    bind(fd, (struct sockaddr *) &sll, sizeof(sll)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	state->fd.fd = fd;
+	uloop_fd_add(&state->fd, ULOOP_READ);
+
+	return 0;
+}
+
+static int
+dhcp_send(struct dhcp_proto_state *state, enum dhcp_msg_type type)
+{
+	struct interface *iface = state->proto.iface;
+	struct dhcp_packet pkt;
+	struct dhcp_message *msg = &pkt.msg;
+	struct sockaddr_ll sll = {
+		.sll_family = AF_PACKET,
+		.sll_protocol = htons(ETH_P_IP),
+		.sll_ifindex = state->ifindex,
+		.sll_halen = ETH_ALEN,
+	};
+	uint8_t *opt = msg->options, *end = msg->options + sizeof(msg->options);
+	struct {
+		struct in_addr saddr;
+		struct in_addr daddr;
+		uint8_t zero;
+		uint8_t proto;
+		uint16_t len;
+	} __packed pseudo;
+	struct in_addr saddr = {}, daddr = { .s_addr = INADDR_BROADCAST };
+	uint8_t msg_type = type;
+	size_t len;
+	bool unicast = false;
+
+	memset(&pkt, 0, sizeof(pkt));
+	msg->op = 1;
+	msg->htype = 1;
+	msg->hlen = ETH_ALEN;
+	msg->xid = state->xid;
+	msg->secs = htons(system_get_rtime() - state->start);
+	msg->cookie = htonl(DHCP_MAGIC);
+	memcpy(msg->chaddr, state->macaddr, ETH_ALEN);
+
+	opt = dhcp_put_option(opt, end, DHCP_OPT_MSG_TYPE, &msg_type, 1);
+	opt = dhcp_put_option(opt, end, DHCP_OPT_CLIENT_ID, state->clientid, state->clientid_len);
+
+	switch (type) {
+	case DHCPDISCOVER:
+		if (state->reqaddr.s_addr)
+			opt = dhcp_put_option(opt, end, DHCP_OPT_REQUEST_IP,
+					      &state->reqaddr, sizeof(state->reqaddr));
+		break;
+	case DHCPREQUEST:
+		if (state->state == DHCP_S_REQUESTING) {
+			opt = dhcp_put_option(opt, end, DHCP_OPT_REQUEST_IP,
+					      &state->lease.addr, sizeof(state->lease.addr));
+			opt = dhcp_put_option(opt, end, DHCP_OPT_SERVER_ID,
+					      &state->lease.server_id, sizeof(state->lease.server_id));
+			break;
+		}
+
+		msg->ciaddr = state->lease.addr;
+		saddr = state->lease.addr;
+		if (state->state == DHCP_S_RENEWING) {
+			daddr = state->lease.server_id;
+			unicast = true;
+		}
+		break;
+	case DHCPRELEASE:
+		msg->ciaddr = state->lease.addr;
+		saddr = state->lease.addr;
+		daddr = state->lease.server_id;
+		unicast = true;
+		opt = dhcp_put_option(opt, end, DHCP_OPT_SERVER_ID,
+				      &state->lease.server_id, sizeof(state->lease.server_id));
+		break;
+	default:
+		break;
+	}
+
+	if (type == DHCPDISCOVER || type == DHCPREQUEST) {
+		if (state->hostname)
+			opt = dhcp_put_option(opt, end, DHCP_OPT_HOSTNAME,
+					      state->hostname, strlen(state->hostname));
+		if (state->vendorid)
+			opt = dhcp_put_option(opt, end, DHCP_OPT_VENDOR_ID,
+					      state->vendorid, strlen(state->vendorid));
+		opt = dhcp_put_option(opt, end, DHCP_OPT_PARAM_REQ,
+				      dhcp_param_req, sizeof(dhcp_param_req));
+	}
+	*opt++ = DHCP_OPT_END;
+
+	if (state->broadcast && !msg->ciaddr.s_addr)
+		msg->flags = htons(0x8000);
+
+	len = sizeof(pkt) - sizeof(msg->options) + (opt - msg->options);
+
+	pkt.udp.source = htons(DHCP_CLIENT_PORT);
+	pkt.udp.dest = htons(DHCP_SERVER_PORT);
+	pkt.udp.len = htons(len - sizeof(pkt.ip));
+
+	pseudo.saddr = saddr;
+	pseudo.daddr = daddr;
+	pseudo.zero = 0;
+	pseudo.proto = IPPROTO_UDP;
+	pseudo.len = pkt.udp.len;
+	pkt.udp.check = htons(dhcp_checksum(~dhcp_checksum(0, &pseudo, sizeof(pseudo)) & 0xffff,
+					    &pkt.udp, len - sizeof(pkt.ip)));
+
+	pkt.ip.version = 4;
+	pkt.ip.ihl = sizeof(pkt.ip) >> 2;
+	pkt.ip.tos = IPTOS_LOWDELAY;
+	pkt.ip.tot_len = htons(len);
+	pkt.ip.ttl = IPDEFTTL;
+	pkt.ip.protocol = IPPROTO_UDP;
+	pkt.ip.saddr = saddr.s_addr;
+	pkt.ip.daddr = daddr.s_addr;
+	pkt.ip.check = htons(dhcp_checksum(0, &pkt.ip, sizeof(pkt.ip)));
+
+	if (unicast)
+		memcpy(sll.sll_addr, state->server_hwaddr, ETH_ALEN);
+	else
+		memset(sll.sll_addr, 0xff, ETH_ALEN);
+
+	D(INTERFACE, "Send DHCP message type %d on interface '%s'\n", type, iface->name);
+	if (sendto(state->fd.fd, &pkt, len, 0, (struct sockaddr *) &sll, sizeof(sll)) < 0) {
+		D(INTERFACE, "Failed to send DHCP message on interface '%s': %s\n",
+		  iface->name, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* uloop timeouts are int msecs, longer waits are armed in chunks */
+#define DHCP_TIMER_MAX	(INT_MAX / 1000)
+
+static void
+dhcp_arm_timer(struct dhcp_proto_state *state)
+{
+	time_t left = state->timer_deadline - system_get_rtime();
+
+	if (left < 0)
+		left = 0;
+	else if (left > DHCP_TIMER_MAX)
+		left = DHCP_TIMER_MAX;
+
+	uloop_timeout_set(&state->timer, left * 1000);
+}
+
+static void
+dhcp_set_timer(struct dhcp_proto_state *state, unsigned int secs)
+{
+	state->timer_deadline = system_get_rtime() + secs;
+	dhcp_arm_timer(state);
+}
+
+static int
+dhcp_retry_interval(struct dhcp_proto_state *state)
+{
+	int secs = 4 << state->retry;
+
+	if (secs > DHCP_MAX_RETRY_TIME)
+		return DHCP_MAX_RETRY_TIME;
+
+	state->retry++;
+	return secs;
+}
+
+static void
+dhcp_start_discover(struct dhcp_proto_state *state)
+{
+	state->state = DHCP_S_SELECTING;
+	state->xid = mrand48();
+	state->retry = 0;
+	state->start = system_get_rtime();
+	memset(&state->lease, 0, sizeof(state->lease));
+
+	dhcp_send(state, DHCPDISCOVER);
+	dhcp_set_timer(state, dhcp_retry_interval(state));
+}
+
+static void
+dhcp_add_route(struct interface *iface, struct in_addr *target,
+	       unsigned int mask, struct in_addr *gw)
+{
+	struct device_route *route;
+	unsigned int table = iface->ip4table;
+
+	route = slab_alloc(&device_route_slab);
+	if (!route)
+		return;
+
+	route->flags = DEVADDR_INET4;
+	route->mask = mask;
+	route->addr.in = *target;
+	route->nexthop.in = *gw;
+	route->metric = iface->metric;
+
+	if (table) {
+		route->table = table;
+		route->flags |= DEVROUTE_SRCTABLE;
+	}
+
+	vlist_add(&iface->proto_ip.route, &route->node, route);
+}
+
+static bool
+dhcp_apply_classless_routes(struct interface *iface, struct dhcp_lease *lease)
+{
+	uint8_t *cur = lease->classless, *end = cur + lease->classless_len;
+	bool have_default = false;
+
+	while (cur < end) {
+		struct in_addr target = {}, gw;
+		unsigned int mask = *cur++;
+		unsigned int octets = (mask + 7) / 8;
+
+		if (mask > 32 || cur + octets + 4 > end)
+			break;
+
+		memcpy(&target, cur, octets);
+		cur += octets;
+		memcpy(&gw, cur, 4);
+		cur += 4;
+
+		if (!mask)
+			have_default = true;
+
+		dhcp_add_route(iface, &target, mask, &gw);
+	}
+
+	return have_default;
+}
+
+static void
+dhcp_apply_static_routes(struct interface *iface, struct dhcp_lease *lease)
+{
+	uint8_t *cur = lease->static_routes;
+	int i;
+
+	for (i = 0; i + 8 <= lease->static_routes_len; i += 8) {
+		struct in_addr target, gw;
+
+		memcpy(&target, cur + i, 4);
+		memcpy(&gw, cur + i + 4, 4);
+		dhcp_add_route(iface, &target, 32, &gw);
+	}
+}
+
+static void
+dhcp_apply_lease(struct dhcp_proto_state *state)
+{
+	struct interface *iface = state->proto.iface;
+	struct dhcp_lease *lease = &state->lease;
+	struct device_addr *addr;
+	char buf[INET_ADDRSTRLEN], *domain, *saveptr;
+	bool have_default = false;
+	int i;
+
+	interface_update_start(iface, false);
+
+	addr = slab_alloc(&device_addr_slab);
+	if (addr) {
+		addr->flags = DEVADDR_INET4;
+		addr->mask = lease->mask;
+		addr->addr.in = lease->addr;
+		addr->broadcast = lease->broadcast;
+		vlist_add(&iface->proto_ip.addr, &addr->node, &addr->flags);
+	}
+
+	/* RFC 3442: routers and static routes are ignored if classless routes are present */
+	if (state->classlessroute && lease->classless_len) {
+		have_default = dhcp_apply_classless_routes(iface, lease);
+	} else {
+		dhcp_apply_static_routes(iface, lease);
+		for (i = 0; i < lease->n_routers && !have_default; i++) {
+			struct in_addr any = {};
+
+			dhcp_add_route(iface, &any, 0, &lease->routers[i]);
+			have_default = true;
+		}
+	}
+
+	for (i = 0; i < lease->n_dns; i++)
+		interface_add_dns_server(&iface->proto_ip,
+			inet_ntop(AF_INET, &lease->dns[i], buf, sizeof(buf)));
+
+	for (domain = strtok_r(lease->domain, " ", &saveptr); domain;
+	     domain = strtok_r(NULL, " ", &saveptr))
+		interface_add_dns_search_domain(&iface->proto_ip, domain);
+
+	interface_update_complete(iface);
+
+	netifd_log_message(L_NOTICE, "Interface '%s' obtained DHCP lease %s/%u (%u seconds)\n",
+			   iface->name, inet_ntop(AF_INET, &lease->addr, buf, sizeof(buf)),
+			   lease->mask, lease->lease_time);
+
+	state->proto.proto_event(&state->proto, IFPEV_UP);
+}
+
+static void
+dhcp_lease_lost(struct dhcp_proto_state *state)
+{
+	netifd_log_message(L_NOTICE, "Interface '%s' lost its DHCP lease\n",
+			   state->proto.iface->name);
+	state->proto.proto_event(&state->proto, IFPEV_LINK_LOST);
+	dhcp_start_discover(state);
+}
+
+static void
+dhcp_set_bound(struct dhcp_proto_state *state)
+{
+	struct dhcp_lease *lease = &state->lease;
+
+	if (lease->lease_time < DHCP_MIN_LEASE)
+		lease->lease_time = DHCP_MIN_LEASE;
+
+	if (!lease->t1 || lease->t1 >= lease->lease_time)
+		lease->t1 = lease->lease_time / 2;
+
+	if (!lease->t2 || lease->t2 >= lease->lease_time || lease->t2 <= lease->t1)
+		lease->t2 = lease->lease_time / 8 * 7;
+
+	state->state = DHCP_S_BOUND;
+	state->bound_time = system_get_rtime();
+	state->retry = 0;
+
+	if (lease->lease_time != 0xffffffff)
+		dhcp_set_timer(state, lease->t1);
+	else
+		uloop_timeout_cancel(&state->timer);
+
+	dhcp_apply_lease(state);
+}
+
+static bool
+dhcp_parse_options(struct dhcp_message *msg, size_t len, uint8_t *type,
+		   struct dhcp_lease *lease)
+{
+	uint8_t *opt = msg->options;
+	uint8_t *end = (uint8_t *) msg + len;
+
+	*type = 0;
+	lease->mask = 32;
+
+	while (opt < end) {
+		uint8_t code = *opt++;
+		uint8_t olen;
+
+		if (code == DHCP_OPT_PAD)
+			continue;
+
+		if (code == DHCP_OPT_END || opt >= end)
+			break;
+
+		olen = *opt++;
+		if (opt + olen > end)
+			return false;
+
+		switch (code) {
+		case DHCP_OPT_MSG_TYPE:
+			if (olen == 1)
+				*type = opt[0];
+			break;
+		case DHCP_OPT_NETMASK:
+			if (olen == 4) {
+				uint32_t mask;
+
+				memcpy(&mask, opt, 4);
+				lease->mask = 32 - fls(~ntohl(mask));
+			}
+			break;
+		case DHCP_OPT_BROADCAST:
+			if (olen == 4)
+				memcpy(&lease->broadcast, opt, 4);
+			break;
+		case DHCP_OPT_SERVER_ID:
+			if (olen == 4)
+				memcpy(&lease->server_id, opt, 4);
+			break;
+		case DHCP_OPT_LEASE_TIME:
+		case DHCP_OPT_RENEW_TIME:
+		case DHCP_OPT_REBIND_TIME:
+			if (olen == 4) {
+				uint32_t val;
+
+				memcpy(&val, opt, 4);
+				val = ntohl(val);
+				if (code == DHCP_OPT_LEASE_TIME)
+					lease->lease_time = val;
+				else if (code == DHCP_OPT_RENEW_TIME)
+					lease->t1 = val;
+				else
+					lease->t2 = val;
+			}
+			break;
+		case DHCP_OPT_ROUTER:
+			for (lease->n_routers = 0;
+			     lease->n_routers < olen / 4 && lease->n_routers < ARRAY_SIZE(lease->routers);
+			     lease->n_routers++)
+				memcpy(&lease->routers[lease->n_routers], opt + lease->n_routers * 4, 4);
+			break;
+		case DHCP_OPT_DNS:
+			for (lease->n_dns = 0;
+			     lease->n_dns < olen / 4 && lease->n_dns < ARRAY_SIZE(lease->dns);
+			     lease->n_dns++)
+				memcpy(&lease->dns[lease->n_dns], opt + lease->n_dns * 4, 4);
+			break;
+		case DHCP_OPT_DOMAIN:
+			memcpy(lease->domain, opt, olen);
+			lease->domain[olen] = 0;
+			break;
+		case DHCP_OPT_CLASSLESS_ROUTE:
+			memcpy(lease->classless, opt, olen);
+			lease->classless_len = olen;
+			break;
+		case DHCP_OPT_STATIC_ROUTE:
+			memcpy(lease->static_routes, opt, olen);
+			lease->static_routes_len = olen;
+			break;
+		default:
+			break;
+		}
+
+		opt += olen;
+	}
+
+	return *type != 0;
+}
+
+static void
+dhcp_handle_message(struct dhcp_proto_state *state, struct dhcp_message *msg,
+		    size_t len, struct sockaddr_ll *from)
+{
+	struct dhcp_lease lease = {};
+	uint8_t type;
+
+	if (len < offsetof(struct dhcp_message, options) ||
+	    msg->op != 2 || msg->xid != state->xid ||
+	    msg->cookie != htonl(DHCP_MAGIC) ||
+	    memcmp(msg->chaddr, state->macaddr, ETH_ALEN) != 0)
+		return;
+
+	if (!dhcp_parse_options(msg, len, &type, &lease))
+		return;
+
+	D(INTERFACE, "Received DHCP message type %d on interface '%s'\n",
+	  type, state->proto.iface->name);
+
+	switch (state->state) {
+	case DHCP_S_SELECTING:
+		if (type != DHCPOFFER || !lease.server_id.s_addr)
+			return;
+
+		state->lease.addr = msg->yiaddr;
+		state->lease.server_id = lease.server_id;
+		state->state = DHCP_S_REQUESTING;
+		state->retry = 0;
+		dhcp_send(state, DHCPREQUEST);
+		dhcp_set_timer(state, dhcp_retry_interval(state));
+		break;
+
+	case DHCP_S_REQUESTING:
+	case DHCP_S_RENEWING:
+	case DHCP_S_REBINDING:
+		if (type == DHCPNAK) {
+			if (state->state != DHCP_S_REQUESTING)
+				state->proto.proto_event(&state->proto, IFPEV_LINK_LOST);
+			dhcp_start_discover(state);
+			return;
+		}
+
+		if (type != DHCPACK || !msg->yiaddr.s_addr)
+			return;
+
+		lease.addr = msg->yiaddr;
+		if (!lease.server_id.s_addr)
+			lease.server_id = state->lease.server_id;
+
+		/* a different address on renewal means the old one is gone */
+		if (state->state != DHCP_S_REQUESTING &&
+		    lease.addr.s_addr != state->lease.addr.s_addr)
+			state->proto.proto_event(&state->proto, IFPEV_LINK_LOST);
+
+		if (from->sll_halen == ETH_ALEN)
+			memcpy(state->server_hwaddr, from->sll_addr, ETH_ALEN);
+
+		state->lease = lease;
+		dhcp_set_bound(state);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void
+dhcp_fd_cb(struct uloop_fd *fd, unsigned int events)
+{
+	struct dhcp_proto_state *state = container_of(fd, struct dhcp_proto_state, fd);
+	struct dhcp_packet pkt;
+	struct sockaddr_ll from;
+	struct udphdr *udp;
+	socklen_t fromlen;
+	ssize_t len;
+	size_t hdrlen, tot_len, udp_len;
+
+	while (1) {
+		fromlen = sizeof(from);
+		len = recvfrom(fd->fd, &pkt, sizeof(pkt), 0, (struct sockaddr *) &from, &fromlen);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (len < sizeof(pkt.ip) || pkt.ip.version != 4)
+			continue;
+
+		hdrlen = pkt.ip.ihl * 4;
+		tot_len = ntohs(pkt.ip.tot_len);
+		if (hdrlen < sizeof(pkt.ip) || tot_len > len ||
+		    tot_len < hdrlen + sizeof(struct udphdr))
+			continue;
+
+		udp = (struct udphdr *) ((uint8_t *) &pkt + hdrlen);
+		udp_len = ntohs(udp->len);
+		if (udp_len < sizeof(struct udphdr) || udp_len > tot_len - hdrlen)
+			continue;
+
+		dhcp_handle_message(state, (struct dhcp_message *) (udp + 1),
+				    udp_len - sizeof(struct udphdr), &from);
+	}
+}
+
+static void
+dhcp_timer_cb(struct uloop_timeout *t)
+{
+	struct dhcp_proto_state *state = container_of(t, struct dhcp_proto_state, timer);
+	struct dhcp_lease *lease = &state->lease;
+	time_t now = system_get_rtime();
+	time_t elapsed = now - state->bound_time;
+	int next;
+
+	if (now < state->timer_deadline) {
+		dhcp_arm_timer(state);
+		return;
+	}
+
+	switch (state->state) {
+	case DHCP_S_SELECTING:
+		dhcp_send(state, DHCPDISCOVER);
+		dhcp_set_timer(state, dhcp_retry_interval(state));
+		break;
+
+	case DHCP_S_REQUESTING:
+		if (state->retry >= 4) {
+			dhcp_start_discover(state);
+			break;
+		}
+
+		dhcp_send(state, DHCPREQUEST);
+		dhcp_set_timer(state, dhcp_retry_interval(state));
+		break;
+
+	case DHCP_S_BOUND:
+	case DHCP_S_RENEWING:
+	case DHCP_S_REBINDING:
+		if (elapsed >= lease->lease_time) {
+			dhcp_lease_lost(state);
+			break;
+		}
+
+		if (elapsed >= lease->t2) {
+			state->state = DHCP_S_REBINDING;
+			next = (lease->lease_time - elapsed) / 2;
+		} else {
+			state->state = DHCP_S_RENEWING;
+			next = (lease->t2 - elapsed) / 2;
+		}
+
+		if (next < DHCP_MIN_LEASE)
+			next = DHCP_MIN_LEASE;
+
+		if (elapsed + next > lease->lease_time)
+			next = lease->lease_time - elapsed;
+
+		dhcp_send(state, DHCPREQUEST);
+		dhcp_set_timer(state, next);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static int
+dhcp_proto_setup(struct dhcp_proto_state *state)
+{
+	struct interface *iface = state->proto.iface;
+	struct device *dev = iface->main_dev.dev;
+	struct device_settings st;
+
+	if (!dev || !dev->ifindex)
+		return -1;
+
+	device_merge_settings(dev, &st);
+	if (!(st.flags & DEV_OPT_MACADDR))
+		return -1;
+
+	memcpy(state->macaddr, st.macaddr, ETH_ALEN);
+	state->ifindex = dev->ifindex;
+
+	if (!state->clientid_len) {
+		state->clientid[0] = 1;
+		memcpy(state->clientid + 1, state->macaddr, ETH_ALEN);
+		state->clientid_len = ETH_ALEN + 1;
+	}
+
+	interface_set_l3_dev(iface, dev);
+
+	if (dhcp_open_socket(state)) {
+		interface_add_error(iface, "dhcp", "SOCKET_FAILED", NULL, 0);
+		return -1;
+	}
+
+	dhcp_start_discover(state);
+	return 0;
+}
+
+static void
+dhcp_proto_stop(struct dhcp_proto_state *state)
+{
+	if (state->release && state->fd.fd >= 0 &&
+	    (state->state == DHCP_S_BOUND || state->state == DHCP_S_RENEWING))
+		dhcp_send(state, DHCPRELEASE);
+
+	uloop_timeout_cancel(&state->timer);
+	dhcp_close_socket(state);
+	state->state = DHCP_S_IDLE;
+}
+
+static int
+dhcp_handler(struct interface_proto_state *proto,
+	     enum interface_proto_cmd cmd, bool force)
+{
+	struct dhcp_proto_state *state;
+
+	state = container_of(proto, struct dhcp_proto_state, proto);
+
+	switch (cmd) {
+	case PROTO_CMD_SETUP:
+		if (state->state != DHCP_S_IDLE)
+			return -1;
+
+		return dhcp_proto_setup(state);
+
+	case PROTO_CMD_RENEW:
+		if (state->state == DHCP_S_BOUND ||
+		    state->state == DHCP_S_RENEWING) {
+			state->state = DHCP_S_RENEWING;
+			dhcp_send(state, DHCPREQUEST);
+			dhcp_set_timer(state, DHCP_MIN_LEASE);
+		}
+		break;
+
+	case PROTO_CMD_TEARDOWN:
+		dhcp_proto_stop(state);
+
+		/* must be last, the state may be freed by the event */
+		proto->proto_event(proto, IFPEV_DOWN);
+		break;
+	}
+
+	return 0;
+}
+
+static void
+dhcp_free(struct interface_proto_state *proto)
+{
+	struct dhcp_proto_state *state;
+
+	state = container_of(proto, struct dhcp_proto_state, proto);
+	uloop_timeout_cancel(&state->timer);
+	dhcp_close_socket(state);
+	free(state->config);
+	free(state);
+}
+
+static int
+dhcp_parse_clientid(struct dhcp_proto_state *state, const char *str)
+{
+	size_t len = strlen(str);
+	unsigned int i, val;
+
+	if (len % 2 || len / 2 > sizeof(state->clientid))
+		return -1;
+
+	for (i = 0; i < len / 2; i++) {
+		if (sscanf(str + i * 2, "%2x", &val) != 1)
+			return -1;
+
+		state->clientid[i] = val;
+	}
+
+	state->clientid_len = len / 2;
+	return 0;
+}
+
+static struct interface_proto_state *
+dhcp_attach(const struct proto_handler *h, struct interface *iface,
+	    struct blob_attr *attr)
+{
+	struct dhcp_proto_state *state;
+	struct blob_attr *tb[__DHCP_ATTR_MAX];
+	struct blob_attr *cur;
+	static bool initialized;
+
+	if (!initialized) {
+		srand48(system_get_rtime() ^ getpid());
+		initialized = true;
+	}
+
+	state = calloc(1, sizeof(*state));
+	if (!state)
+		return NULL;
+
+	state->config = malloc(blob_pad_len(attr));
+	if (!state->config)
+		goto error;
+
+	memcpy(state->config, attr, blob_pad_len(attr));
+	blobmsg_parse(dhcp_attrs, __DHCP_ATTR_MAX, tb,
+		      blob_data(state->config), blob_len(state->config));
+
+	if ((cur = tb[DHCP_ATTR_HOSTNAME]))
+		state->hostname = blobmsg_data(cur);
+
+	if ((cur = tb[DHCP_ATTR_VENDORID]))
+		state->vendorid = blobmsg_data(cur);
+
+	if ((cur = tb[DHCP_ATTR_CLIENTID]) &&
+	    dhcp_parse_clientid(state, blobmsg_data(cur)))
+		interface_add_error(iface, "dhcp", "INVALID_CLIENTID", NULL, 0);
+
+	if ((cur = tb[DHCP_ATTR_REQADDRESS]) &&
+	    !inet_pton(AF_INET, blobmsg_data(cur), &state->reqaddr))
+		interface_add_error(iface, "dhcp", "INVALID_REQADDRESS", NULL, 0);
+
+	state->broadcast = blobmsg_get_bool_default(tb[DHCP_ATTR_BROADCAST], false);
+	state->release = blobmsg_get_bool_default(tb[DHCP_ATTR_RELEASE], false);
+	state->classlessroute = blobmsg_get_bool_default(tb[DHCP_ATTR_CLASSLESSROUTE], true);
+
+	state->fd.fd = -1;
+	state->fd.cb = dhcp_fd_cb;
+	state->timer.cb = dhcp_timer_cb;
+	state->proto.free = dhcp_free;
+	state->proto.cb = dhcp_handler;
+
+	return &state->proto;
+
+error:
+	free(state);
+	return NULL;
+}
+
+/* opt-in: "proto dhcp" keeps using the dhcp.sh handler */
+static struct proto_handler dhcp_proto = {
+	.name = "dhcp-native",
+	.config_params = &dhcp_attr_list,
+	.attach = dhcp_attach,
+};
+
+static void __init
+dhcp_proto_init(void)
+{
+	add_proto_handler(&dhcp_proto);
+}
@@ -0,0 +1,229 @@
+/*
+ * netifd - network interface daemon
+ * Copyright (C) 2012 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <glob.h>
+#include <dlfcn.h>
+
+#include "netifd.h"
+#include "interface.h"
+#include "proto.h"
+#include "interface-ip.h"
+#include "proto-plugin.h"
+
+static const char *cur_plugin;
+
+/* apply the same constraints netifd_handler_parse_config enforces for scripts */
+static bool
+proto_plugin_check_config(const struct uci_blob_param_list *config)
+{
+	int i;
+
+	if (!config)
+		return true;
+
+	if (config->n_params < 0 || (config->n_params && !config->params))
+		return false;
+
+	for (i = 0; i < config->n_params; i++) {
+		const struct blobmsg_policy *attr = &config->params[i];
+
+		if (!attr->name || !attr->name[0] || strchr(attr->name, ':'))
+			return false;
+
+		if (attr->type > BLOBMSG_TYPE_LAST)
+			return false;
+
+		if (config->validate && config->validate[i] &&
+		    !config->validate[i][0])
+			return false;
+	}
+
+	return true;
+}
+
+static int
+proto_plugin_add_handler(struct proto_handler *p)
+{
+	if (!p || !p->name || !p->attach) {
+		netifd_log_message(L_WARNING, "Plugin '%s' registered an incomplete protocol handler\n",
+				   cur_plugin);
+		return -1;
+	}
+
+	if (get_proto_handler(p->name)) {
+		netifd_log_message(L_WARNING, "Plugin '%s': protocol '%s' is already registered\n",
+				   cur_plugin, p->name);
+		return -1;
+	}
+
+	if (!proto_plugin_check_config(p->config_params)) {
+		netifd_log_message(L_WARNING, "Plugin '%s': invalid config parameters for protocol '%s'\n",
+				   cur_plugin, p->name);
+		return -1;
+	}
+
+	D(INTERFACE, "Add protocol handler '%s' from plugin '%s'\n", p->name, cur_plugin);
+	add_proto_handler(p);
+
+	return 0;
+}
+
+static const char *
+proto_plugin_interface_get_name(struct interface *iface)
+{
+	return iface->name;
+}
+
+static const char *
+proto_plugin_interface_get_ifname(struct interface *iface)
+{
+	return iface->main_dev.dev ? iface->main_dev.dev->ifname : NULL;
+}
+
+static void
+proto_plugin_add_dns_server(struct interface *iface, const char *str)
+{
+	interface_add_dns_server(&iface->proto_ip, str);
+}
+
+static void
+proto_plugin_add_dns_server_list(struct interface *iface, struct blob_attr *list)
+{
+	interface_add_dns_server_list(&iface->proto_ip, list);
+}
+
+static void
+proto_plugin_add_dns_search_domain(struct interface *iface, const char *str)
+{
+	interface_add_dns_search_domain(&iface->proto_ip, str);
+}
+
+static void
+proto_plugin_add_dns_search_list(struct interface *iface, struct blob_attr *list)
+{
+	interface_add_dns_search_list(&iface->proto_ip, list);
+}
+
+static void
+proto_plugin_ip_update_start(struct interface *iface)
+{
+	interface_ip_update_start(&iface->proto_ip);
+}
+
+static void
+proto_plugin_ip_update_complete(struct interface *iface)
+{
+	interface_ip_update_complete(&iface->proto_ip);
+}
+
+static void
+proto_plugin_ip_flush(struct interface *iface)
+{
+	interface_ip_flush(&iface->proto_ip);
+}
+
+static const struct netifd_plugin_ops plugin_ops = {
+	.abi_version = NETIFD_PLUGIN_ABI_VERSION,
+	.add_proto_handler = proto_plugin_add_handler,
+	.proto_apply_ip_settings = proto_apply_ip_settings,
+	.proto_apply_static_ip_settings = proto_apply_static_ip_settings,
+	.interface_set_l3_dev = interface_set_l3_dev,
+	.interface_add_error = interface_add_error,
+	.log_message = netifd_log_message,
+	.fd_add = uloop_fd_add,
+	.fd_delete = uloop_fd_delete,
+	.timeout_set = uloop_timeout_set,
+	.timeout_cancel = uloop_timeout_cancel,
+
+	.interface_get_name = proto_plugin_interface_get_name,
+	.interface_get_ifname = proto_plugin_interface_get_ifname,
+	.interface_update_start = interface_update_start,
+	.interface_update_complete = interface_update_complete,
+	.interface_add_dns_server = proto_plugin_add_dns_server,
+	.interface_add_dns_server_list = proto_plugin_add_dns_server_list,
+	.interface_add_dns_search_domain = proto_plugin_add_dns_search_domain,
+	.interface_add_dns_search_list = proto_plugin_add_dns_search_list,
+	.interface_ip_add_route = interface_ip_add_route,
+	.interface_ip_add_neighbor = interface_ip_add_neighbor,
+	.interface_ip_add_device_prefix = interface_ip_add_device_prefix,
+	.interface_ip_update_start = proto_plugin_ip_update_start,
+	.interface_ip_update_complete = proto_plugin_ip_update_complete,
+	.interface_ip_flush = proto_plugin_ip_flush,
+};
+
+static void
+proto_plugin_load(const char *path)
+{
+	const struct netifd_plugin *plugin;
+	void *dlh;
+
+	dlh = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!dlh) {
+		netifd_log_message(L_WARNING, "Failed to load plugin %s: %s\n", path, dlerror());
+		return;
+	}
+
+	plugin = dlsym(dlh, NETIFD_PLUGIN_SYMBOL);
+	if (!plugin || !plugin->init) {
+		netifd_log_message(L_WARNING, "Plugin %s does not export '%s'\n",
+				   path, NETIFD_PLUGIN_SYMBOL);
+		goto error;
+	}
+
+	if (plugin->abi_version < NETIFD_PLUGIN_ABI_MIN ||
+	    plugin->abi_version > NETIFD_PLUGIN_ABI_VERSION) {
+		netifd_log_message(L_WARNING, "Plugin %s has ABI version %u, expected %u to %u\n",
+				   path, plugin->abi_version, NETIFD_PLUGIN_ABI_MIN,
+				   NETIFD_PLUGIN_ABI_VERSION);
+		goto error;
+	}
+
+	cur_plugin = plugin->name ? plugin->name : path;
+	if (plugin->init(&plugin_ops))
+		netifd_log_message(L_WARNING, "Plugin '%s' failed to initialize\n", cur_plugin);
+
+	/*
+	 * handlers registered before a failure still point into the object,
+	 * so a plugin is never unloaded once its init has run
+	 */
+	cur_plugin = NULL;
+	return;
+
+error:
+	dlclose(dlh);
+}
+
+void proto_plugin_init(void)
+{
+	char *pattern;
+	glob_t g;
+	int i;
+
+	if (asprintf(&pattern, "%s/plugins/*.so", main_path) < 0)
+		return;
+
+	if (glob(pattern, 0, NULL, &g)) {
+		free(pattern);
+		return;
+	}
+
+	for (i = 0; i < g.gl_pathc; i++)
+		proto_plugin_load(g.gl_pathv[i]);
+
+	globfree(&g);
+	free(pattern);
+}
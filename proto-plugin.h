@@ -0,0 +1,103 @@
+/*
+ * netifd - network interface daemon
+ * Copyright (C) 2012 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __NETIFD_PROTO_PLUGIN_H
+#define __NETIFD_PROTO_PLUGIN_H
+
+#include <stdbool.h>
+#include <netinet/in.h>
+#include <libubox/uloop.h>
+
+#include "proto.h"
+
+/*
+ * Native protocol handler plugins are shared objects loaded from
+ * <main_path>/plugins at startup. Each one exports a symbol named
+ * NETIFD_PLUGIN_SYMBOL of type struct netifd_plugin. Its init callback
+ * receives the helper table below and registers its proto_handler(s)
+ * through ops->add_proto_handler.
+ *
+ * struct interface and struct device are opaque handles to plugins:
+ * their layout is not part of the ABI and changes freely, so plugins
+ * must only pass them back to the ops and use the accessors below.
+ *
+ * Bump NETIFD_PLUGIN_ABI_VERSION whenever struct proto_handler,
+ * struct interface_proto_state or struct netifd_plugin_ops change.
+ * New ops are only ever appended, so plugins built against an older
+ * version keep loading; NETIFD_PLUGIN_ABI_MIN is the oldest accepted.
+ *
+ * Version 2 adds the update, DNS and ip settings helpers a handler
+ * needs to replace or flush the state it configured, and makes
+ * struct interface opaque. Version 1 plugins had to read it directly,
+ * so they are no longer accepted.
+ */
+#define NETIFD_PLUGIN_ABI_VERSION	2
+#define NETIFD_PLUGIN_ABI_MIN		2
+#define NETIFD_PLUGIN_SYMBOL		"netifd_plugin"
+
+struct device;
+struct blob_attr;
+struct device_prefix;
+
+struct netifd_plugin_ops {
+	unsigned int abi_version;
+
+	int (*add_proto_handler)(struct proto_handler *p);
+
+	int (*proto_apply_ip_settings)(struct interface *iface,
+				       struct blob_attr *attr, bool ext);
+	int (*proto_apply_static_ip_settings)(struct interface *iface,
+					      struct blob_attr *attr);
+	void (*interface_set_l3_dev)(struct interface *iface, struct device *dev);
+	void (*interface_add_error)(struct interface *iface, const char *subsystem,
+				    const char *code, const char **data, int n_data);
+	void (*log_message)(int priority, const char *format, ...);
+
+	int (*fd_add)(struct uloop_fd *fd, unsigned int flags);
+	int (*fd_delete)(struct uloop_fd *fd);
+	int (*timeout_set)(struct uloop_timeout *timeout, int msecs);
+	int (*timeout_cancel)(struct uloop_timeout *timeout);
+
+	/* ABI version 2 */
+	const char *(*interface_get_name)(struct interface *iface);
+	/* ifname of the interface's main device, NULL if it has none */
+	const char *(*interface_get_ifname)(struct interface *iface);
+
+	void (*interface_update_start)(struct interface *iface, const bool keep_old);
+	void (*interface_update_complete)(struct interface *iface);
+
+	/* DNS and ip helpers act on the settings owned by the protocol handler */
+	void (*interface_add_dns_server)(struct interface *iface, const char *str);
+	void (*interface_add_dns_server_list)(struct interface *iface, struct blob_attr *list);
+	void (*interface_add_dns_search_domain)(struct interface *iface, const char *str);
+	void (*interface_add_dns_search_list)(struct interface *iface, struct blob_attr *list);
+
+	void (*interface_ip_add_route)(struct interface *iface, struct blob_attr *attr, bool v6);
+	void (*interface_ip_add_neighbor)(struct interface *iface, struct blob_attr *attr, bool v6);
+	struct device_prefix *(*interface_ip_add_device_prefix)(struct interface *iface,
+			struct in6_addr *addr, uint8_t length, time_t valid_until,
+			time_t preferred_until, struct in6_addr *excl_addr,
+			uint8_t excl_length, const char *pclass);
+	void (*interface_ip_update_start)(struct interface *iface);
+	void (*interface_ip_update_complete)(struct interface *iface);
+	void (*interface_ip_flush)(struct interface *iface);
+};
+
+struct netifd_plugin {
+	unsigned int abi_version;
+	const char *name;
+
+	int (*init)(const struct netifd_plugin_ops *ops);
+};
+
+#endif
@@ -105,7 +105,7 @@ alloc_device_addr(bool v6, bool ext)
 {
 	struct device_addr *addr;
 
-	addr = calloc(1, sizeof(*addr));
+	addr = slab_alloc(&device_addr_slab);
 	if (!addr)
 		return NULL;
 
@@ -148,7 +148,7 @@ parse_addr(struct interface *iface, const char *str, bool v6, int mask,
 
 error:
 	interface_add_error(iface, "proto", "INVALID_ADDRESS", &str, 1);
-	free(addr);
+	slab_free(&device_addr_slab, addr);
 
 	return false;
 }
@@ -250,7 +250,7 @@ parse_address_item(struct blob_attr *attr, bool v6, bool ext)
 	return addr;
 
 error:
-	free(addr);
+	slab_free(&device_addr_slab, addr);
 	return NULL;
 }
 
@@ -282,13 +282,13 @@ parse_gateway_option(struct interface *iface, struct blob_attr *attr, bool v6)
 	const char *str = blobmsg_data(attr);
 	int af = v6 ? AF_INET6 : AF_INET;
 
-	route = calloc(1, sizeof(*route));
+	route = slab_alloc(&device_route_slab);
 	if (!route)
 		return NULL;
 
 	if (!inet_pton(af, str, &route->nexthop)) {
 		interface_add_error(iface, "proto", "INVALID_GATEWAY", &str, 1);
-		free(route);
+		slab_free(&device_route_slab, route);
 		return false;
 	}
 
@@ -563,7 +563,7 @@ static const struct proto_handler no_proto = {
 	.attach = default_proto_attach,
 };
 
-static const struct proto_handler *
+const struct proto_handler *
 get_proto_handler(const char *name)
 {
 	struct proto_handler *proto;
@@ -71,6 +71,7 @@ struct proto_handler {
 extern const struct uci_blob_param_list proto_ip_attr;
 
 void add_proto_handler(struct proto_handler *p);
+const struct proto_handler *get_proto_handler(const char *name);
 void proto_init_interface(struct interface *iface, struct blob_attr *attr);
 void proto_attach_interface(struct interface *iface, const char *proto_name);
 int interface_proto_event(struct interface_proto_state *proto,
@@ -81,5 +82,6 @@ int proto_apply_static_ip_settings(struct interface *iface, struct blob_attr *at
 int proto_apply_ip_settings(struct interface *iface, struct blob_attr *attr, bool ext);
 void proto_dump_handlers(struct blob_buf *b);
 void proto_shell_init(void);
+void proto_plugin_init(void);
 
 #endif
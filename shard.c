@@ -0,0 +1,706 @@
+/*
+ * netifd - network interface daemon
+ * Copyright (C) 2012 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <libubox/avl-cmp.h>
+
+#include "netifd.h"
+#include "device.h"
+#include "interface-ip.h"
+#include "ubus.h"
+#include "shard.h"
+
+#define SHARD_RESTART_DELAY	1000
+#define SHARD_CLAIM_TIMEOUT	5000
+#define SHARD_DUMP_TIMEOUT	2000
+
+struct shard_worker {
+	struct vlist_node node;
+	struct uloop_process proc;
+	struct uloop_timeout restart;
+
+	struct ubus_request req;
+	bool req_pending;
+
+	char name[];
+};
+
+struct shard_claim {
+	struct avl_node node;
+	struct device_user dep;
+
+	/* "<owner>/<device>" */
+	char key[];
+};
+
+struct shard_dump;
+
+struct shard_dump_call {
+	struct ubus_request req;
+	struct shard_dump *dump;
+	bool pending;
+};
+
+/* network.interface dump waiting for the workers' dumps */
+struct shard_dump {
+	struct ubus_request_data req;
+	struct uloop_timeout timeout;
+	struct blob_buf buf;
+	void *array;
+
+	int n_calls, pending;
+	struct shard_dump_call calls[];
+};
+
+static char **shard_argv;
+static int shard_argc;
+
+/* resolv.conf entries reported by workers, keyed by "<owner>/<jail>" */
+struct shard_dns {
+	struct avl_node node;
+	const char *jail;
+	char *data;
+	char key[];
+};
+
+static struct vlist_tree workers;
+static struct ubus_subscriber shard_subscriber;
+static struct ubus_event_handler shard_object_ev;
+static AVL_TREE(claims, avl_strcmp, false, NULL);
+static AVL_TREE(dns_entries, avl_strcmp, false, NULL);
+static struct blob_buf b;
+
+static bool
+shard_key_owner(const char *key, const char *owner)
+{
+	int len = strlen(owner);
+
+	return !strncmp(key, owner, len) && key[len] == '/';
+}
+
+static void
+shard_claim_free(struct shard_claim *c)
+{
+	avl_delete(&claims, &c->node);
+	device_release(&c->dep);
+	device_remove_user(&c->dep);
+	free(c);
+}
+
+static void
+shard_release_owner(const char *owner)
+{
+	struct shard_claim *c, *tmp;
+
+	avl_for_each_element_safe(&claims, c, node, tmp) {
+		if (shard_key_owner(c->key, owner))
+			shard_claim_free(c);
+	}
+}
+
+static void
+shard_dns_free(struct shard_dns *d, bool update)
+{
+	char *jail = NULL;
+
+	avl_delete(&dns_entries, &d->node);
+	if (update && d->jail)
+		jail = strdup(d->jail);
+
+	free(d->data);
+	free(d);
+
+	if (update)
+		interface_write_resolv_conf(jail);
+	free(jail);
+}
+
+static void
+shard_release_dns(const char *owner)
+{
+	struct shard_dns *d, *tmp;
+
+	avl_for_each_element_safe(&dns_entries, d, node, tmp) {
+		if (shard_key_owner(d->key, owner))
+			shard_dns_free(d, true);
+	}
+}
+
+int shard_set_dns(const char *owner, const char *jail, const char *data)
+{
+	struct shard_worker *w;
+	struct shard_dns *d;
+	char *key;
+
+	if (netifd_shard || strchr(owner, '/'))
+		return -EINVAL;
+
+	w = vlist_find(&workers, owner, w, node);
+	if (!w)
+		return -ENOENT;
+
+	if (jail && !*jail)
+		jail = NULL;
+
+	key = alloca(strlen(owner) + (jail ? strlen(jail) : 0) + 2);
+	sprintf(key, "%s/%s", owner, jail ? jail : "");
+
+	d = avl_find_element(&dns_entries, key, d, node);
+	if (!*data) {
+		if (d)
+			shard_dns_free(d, true);
+		return 0;
+	}
+
+	if (d) {
+		if (!strcmp(d->data, data))
+			return 0;
+
+		free(d->data);
+	} else {
+		d = calloc(1, sizeof(*d) + strlen(key) + 1);
+		if (!d)
+			return -ENOMEM;
+
+		strcpy(d->key, key);
+		d->node.key = d->key;
+		if (jail)
+			d->jail = d->key + strlen(owner) + 1;
+		avl_insert(&dns_entries, &d->node);
+	}
+
+	d->data = strdup(data);
+	if (!d->data) {
+		shard_dns_free(d, false);
+		return -ENOMEM;
+	}
+
+	interface_write_resolv_conf(jail);
+
+	return 0;
+}
+
+/* worker entries follow the coordinator's own, in shard name order */
+void shard_write_dns(FILE *f, const char *jail)
+{
+	struct shard_dns *d;
+
+	avl_for_each_element(&dns_entries, d, node) {
+		if (!jail != !d->jail || (jail && strcmp(jail, d->jail)))
+			continue;
+
+		fputs(d->data, f);
+	}
+}
+
+void shard_push_dns(const char *jail, const char *data)
+{
+	uint32_t id;
+
+	if (!netifd_shard)
+		return;
+
+	if (ubus_lookup_id(ubus_ctx, "network", &id))
+		return;
+
+	blob_buf_init(&b, 0);
+	blobmsg_add_string(&b, "owner", netifd_shard);
+	if (jail)
+		blobmsg_add_string(&b, "jail", jail);
+	blobmsg_add_string(&b, "dns", data ? data : "");
+
+	ubus_invoke(ubus_ctx, id, "shard_dns", b.head, NULL, NULL, SHARD_CLAIM_TIMEOUT);
+}
+
+static void
+shard_claim_cb(struct device_user *dep, enum device_event ev)
+{
+}
+
+int shard_claim(const char *owner, const char *name, bool claim)
+{
+	struct shard_claim *c;
+	struct device *dev;
+	char *key;
+	int ret;
+
+	if (netifd_shard || strchr(owner, '/'))
+		return -EINVAL;
+
+	key = alloca(strlen(owner) + strlen(name) + 2);
+	sprintf(key, "%s/%s", owner, name);
+
+	c = avl_find_element(&claims, key, c, node);
+	if (!claim) {
+		if (!c)
+			return -ENOENT;
+
+		shard_claim_free(c);
+		return 0;
+	}
+
+	if (c)
+		return 0;
+
+	dev = device_get(name, 1);
+	if (!dev)
+		return -ENODEV;
+
+	c = calloc(1, sizeof(*c) + strlen(key) + 1);
+	if (!c)
+		return -ENOMEM;
+
+	strcpy(c->key, key);
+	c->node.key = c->key;
+	c->dep.cb = shard_claim_cb;
+	device_add_user(&c->dep, dev);
+
+	ret = device_claim(&c->dep);
+	if (ret) {
+		device_remove_user(&c->dep);
+		free(c);
+		return ret;
+	}
+
+	avl_insert(&claims, &c->node);
+	D(DEVICE, "Device '%s' claimed by shard '%s'\n", name, owner);
+
+	return 0;
+}
+
+/*
+ * Ask the coordinator to set up a device for us or to drop it again.
+ * Called when a worker interface is brought up, and when the device
+ * is released or freed.
+ */
+int shard_device_claim(struct device *dev, bool claim)
+{
+	uint32_t id;
+	int ret;
+
+	if (!netifd_shard || dev->shard_claimed == claim)
+		return 0;
+
+	if (ubus_lookup_id(ubus_ctx, "network.device", &id))
+		return -ENOENT;
+
+	blob_buf_init(&b, 0);
+	blobmsg_add_string(&b, "name", dev->ifname);
+	blobmsg_add_string(&b, "owner", netifd_shard);
+
+	ret = ubus_invoke(ubus_ctx, id, claim ? "claim" : "release", b.head,
+			  NULL, NULL, SHARD_CLAIM_TIMEOUT);
+	if (ret && claim)
+		netifd_log_message(L_WARNING, "Failed to claim device '%s' from the coordinator\n",
+				   dev->ifname);
+	else
+		dev->shard_claimed = claim;
+
+	return ret;
+}
+
+static void
+shard_dump_add(struct shard_dump *d, struct blob_attr *msg)
+{
+	static const struct blobmsg_policy policy = {
+		.name = "interface", .type = BLOBMSG_TYPE_ARRAY
+	};
+	struct blob_attr *list, *cur;
+	int rem;
+
+	blobmsg_parse(&policy, 1, &list, blob_data(msg), blob_len(msg));
+	if (!list)
+		return;
+
+	blobmsg_for_each_attr(cur, list, rem) {
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_TABLE)
+			continue;
+
+		blobmsg_add_field(&d->buf, BLOBMSG_TYPE_TABLE, NULL,
+				  blobmsg_data(cur), blobmsg_data_len(cur));
+	}
+}
+
+static void
+shard_dump_finish(struct shard_dump *d)
+{
+	int i;
+
+	uloop_timeout_cancel(&d->timeout);
+
+	/* workers that did not answer in time are left out */
+	for (i = 0; i < d->n_calls; i++)
+		if (d->calls[i].pending)
+			ubus_abort_request(ubus_ctx, &d->calls[i].req);
+
+	blobmsg_close_array(&d->buf, d->array);
+	ubus_send_reply(ubus_ctx, &d->req, d->buf.head);
+	ubus_complete_deferred_request(ubus_ctx, &d->req, 0);
+
+	blob_buf_free(&d->buf);
+	free(d);
+}
+
+static void
+shard_dump_timeout(struct uloop_timeout *t)
+{
+	struct shard_dump *d = container_of(t, struct shard_dump, timeout);
+
+	shard_dump_finish(d);
+}
+
+static void
+shard_dump_data_cb(struct ubus_request *req, int type, struct blob_attr *msg)
+{
+	struct shard_dump_call *call = container_of(req, struct shard_dump_call, req);
+
+	shard_dump_add(call->dump, msg);
+}
+
+static void
+shard_dump_complete_cb(struct ubus_request *req, int ret)
+{
+	struct shard_dump_call *call = container_of(req, struct shard_dump_call, req);
+	struct shard_dump *d = call->dump;
+
+	call->pending = false;
+	if (!--d->pending)
+		shard_dump_finish(d);
+}
+
+/*
+ * Answer a network.interface dump with the coordinator's own interfaces
+ * (local) followed by those of every running worker. Returns nonzero if
+ * there is nothing to add and the caller should reply directly.
+ */
+int shard_dump_interfaces(struct ubus_context *ctx, struct ubus_request_data *req,
+			  struct blob_attr *local)
+{
+	struct shard_worker *w;
+	struct shard_dump *d;
+	char obj[64];
+	uint32_t id;
+	int n = 0;
+
+	if (netifd_shard)
+		return -ENOENT;
+
+	vlist_for_each_element(&workers, w, node)
+		if (w->proc.pending)
+			n++;
+
+	if (!n)
+		return -ENOENT;
+
+	d = calloc(1, sizeof(*d) + n * sizeof(d->calls[0]));
+	if (!d)
+		return -ENOMEM;
+
+	blob_buf_init(&d->buf, 0);
+	d->array = blobmsg_open_array(&d->buf, "interface");
+	shard_dump_add(d, local);
+
+	ubus_defer_request(ctx, req, &d->req);
+	d->timeout.cb = shard_dump_timeout;
+
+	vlist_for_each_element(&workers, w, node) {
+		struct shard_dump_call *call = &d->calls[d->n_calls];
+
+		if (!w->proc.pending)
+			continue;
+
+		snprintf(obj, sizeof(obj), "network.shard.%s.interface", w->name);
+		if (ubus_lookup_id(ctx, obj, &id))
+			continue;
+
+		blob_buf_init(&b, 0);
+		if (ubus_invoke_async(ctx, id, "dump", b.head, &call->req))
+			continue;
+
+		call->dump = d;
+		call->pending = true;
+		call->req.data_cb = shard_dump_data_cb;
+		call->req.complete_cb = shard_dump_complete_cb;
+		ubus_complete_request_async(ctx, &call->req);
+		d->n_calls++;
+		d->pending++;
+	}
+
+	if (d->pending)
+		uloop_timeout_set(&d->timeout, SHARD_DUMP_TIMEOUT);
+	else
+		shard_dump_finish(d);
+
+	return 0;
+}
+
+static void
+shard_worker_start(struct shard_worker *w)
+{
+	const char **argv;
+	int i, pid;
+
+	argv = calloc(shard_argc + 3, sizeof(*argv));
+	if (!argv)
+		goto retry;
+
+	for (i = 0; i < shard_argc; i++)
+		argv[i] = shard_argv[i];
+	argv[i++] = "-w";
+	argv[i++] = w->name;
+
+	pid = fork();
+	if (pid < 0) {
+		free(argv);
+		goto retry;
+	}
+
+	if (!pid) {
+		execvp(argv[0], (char **) argv);
+		exit(127);
+	}
+
+	free(argv);
+	w->proc.pid = pid;
+	uloop_process_add(&w->proc);
+	netifd_log_message(L_NOTICE, "Started worker for shard '%s' (pid %d)\n",
+			   w->name, pid);
+	return;
+
+retry:
+	uloop_timeout_set(&w->restart, SHARD_RESTART_DELAY);
+}
+
+static void
+shard_worker_restart(struct uloop_timeout *t)
+{
+	struct shard_worker *w = container_of(t, struct shard_worker, restart);
+
+	shard_worker_start(w);
+}
+
+static void
+shard_worker_exit(struct uloop_process *proc, int ret)
+{
+	struct shard_worker *w = container_of(proc, struct shard_worker, proc);
+
+	netifd_log_message(L_WARNING, "Worker for shard '%s' exited (status %d), restarting\n",
+			   w->name, ret);
+
+	if (w->req_pending) {
+		ubus_abort_request(ubus_ctx, &w->req);
+		w->req_pending = false;
+	}
+
+	/* the replacement claims its devices again once it is up */
+	shard_release_owner(w->name);
+	shard_release_dns(w->name);
+	uloop_timeout_set(&w->restart, SHARD_RESTART_DELAY);
+}
+
+static void
+shard_worker_reload_done(struct ubus_request *req, int ret)
+{
+	struct shard_worker *w = container_of(req, struct shard_worker, req);
+
+	w->req_pending = false;
+	if (ret)
+		D(INTERFACE, "Reload of shard '%s' failed: %s\n",
+		  w->name, ubus_strerror(ret));
+}
+
+/*
+ * Asynchronous, since the worker may itself be waiting on a claim
+ * request to this process while it handles the reload.
+ */
+static void
+shard_worker_reload(struct shard_worker *w)
+{
+	char obj[64];
+	uint32_t id;
+
+	if (!w->proc.pending)
+		return;
+
+	if (w->req_pending) {
+		ubus_abort_request(ubus_ctx, &w->req);
+		w->req_pending = false;
+	}
+
+	snprintf(obj, sizeof(obj), "network.shard.%s", w->name);
+	if (ubus_lookup_id(ubus_ctx, obj, &id))
+		return;
+
+	blob_buf_init(&b, 0);
+	if (ubus_invoke_async(ubus_ctx, id, "reload", b.head, &w->req))
+		return;
+
+	w->req.complete_cb = shard_worker_reload_done;
+	ubus_complete_request_async(ubus_ctx, &w->req);
+	w->req_pending = true;
+}
+
+static void
+shard_worker_free(struct shard_worker *w)
+{
+	uloop_timeout_cancel(&w->restart);
+
+	if (w->req_pending)
+		ubus_abort_request(ubus_ctx, &w->req);
+
+	if (w->proc.pending) {
+		uloop_process_delete(&w->proc);
+		kill(w->proc.pid, SIGTERM);
+		netifd_log_message(L_NOTICE, "Stopped worker for shard '%s'\n", w->name);
+	}
+
+	shard_release_owner(w->name);
+	shard_release_dns(w->name);
+	free(w);
+}
+
+static void
+shard_worker_update(struct vlist_tree *tree, struct vlist_node *node_new,
+		    struct vlist_node *node_old)
+{
+	struct shard_worker *w_new = container_of(node_new, struct shard_worker, node);
+	struct shard_worker *w_old = container_of(node_old, struct shard_worker, node);
+
+	if (node_new && node_old) {
+		free(w_new);
+		shard_worker_reload(w_old);
+		return;
+	}
+
+	if (node_old)
+		shard_worker_free(w_old);
+
+	if (node_new)
+		shard_worker_start(w_new);
+}
+
+/*
+ * Subscribers of network.interface expect the notifications of every
+ * interface, so the coordinator subscribes to each worker's interface
+ * object and passes its notifications on.
+ */
+static int
+shard_notify_cb(struct ubus_context *ctx, struct ubus_object *obj,
+		struct ubus_request_data *req, const char *method,
+		struct blob_attr *msg)
+{
+	netifd_ubus_relay_interface_notify(method, msg);
+	return 0;
+}
+
+static void
+shard_object_add_cb(struct ubus_context *ctx, struct ubus_event_handler *ev,
+		    const char *type, struct blob_attr *msg)
+{
+	static const char prefix[] = "network.shard.";
+	static const char suffix[] = ".interface";
+	enum {
+		OBJ_ATTR_ID,
+		OBJ_ATTR_PATH,
+		__OBJ_ATTR_MAX
+	};
+	static const struct blobmsg_policy policy[__OBJ_ATTR_MAX] = {
+		[OBJ_ATTR_ID] = { .name = "id", .type = BLOBMSG_TYPE_INT32 },
+		[OBJ_ATTR_PATH] = { .name = "path", .type = BLOBMSG_TYPE_STRING },
+	};
+	struct blob_attr *tb[__OBJ_ATTR_MAX];
+	struct shard_worker *w;
+	const char *path;
+	char *name;
+	int len;
+
+	blobmsg_parse(policy, __OBJ_ATTR_MAX, tb, blob_data(msg), blob_len(msg));
+	if (!tb[OBJ_ATTR_ID] || !tb[OBJ_ATTR_PATH])
+		return;
+
+	path = blobmsg_get_string(tb[OBJ_ATTR_PATH]);
+	len = strlen(path) - (sizeof(prefix) - 1) - (sizeof(suffix) - 1);
+	if (len <= 0 || strncmp(path, prefix, sizeof(prefix) - 1) ||
+	    strcmp(path + sizeof(prefix) - 1 + len, suffix))
+		return;
+
+	name = alloca(len + 1);
+	memcpy(name, path + sizeof(prefix) - 1, len);
+	name[len] = 0;
+
+	w = vlist_find(&workers, name, w, node);
+	if (!w)
+		return;
+
+	if (ubus_subscribe(ctx, &shard_subscriber, blobmsg_get_u32(tb[OBJ_ATTR_ID])))
+		D(INTERFACE, "Failed to subscribe to shard '%s'\n", name);
+}
+
+static void
+shard_relay_init(void)
+{
+	shard_subscriber.cb = shard_notify_cb;
+	if (ubus_register_subscriber(ubus_ctx, &shard_subscriber))
+		return;
+
+	shard_object_ev.cb = shard_object_add_cb;
+	ubus_register_event_handler(ubus_ctx, &shard_object_ev, "ubus.object.add");
+}
+
+void shard_update_start(void)
+{
+	vlist_update(&workers);
+}
+
+void shard_add(const char *name)
+{
+	struct shard_worker *w;
+
+	w = calloc(1, sizeof(*w) + strlen(name) + 1);
+	if (!w)
+		return;
+
+	strcpy(w->name, name);
+	w->proc.cb = shard_worker_exit;
+	w->restart.cb = shard_worker_restart;
+	vlist_add(&workers, &w->node, w->name);
+}
+
+void shard_update_complete(void)
+{
+	vlist_flush(&workers);
+}
+
+void shard_init(char **argv)
+{
+	shard_argv = argv;
+	while (argv[shard_argc])
+		shard_argc++;
+
+	vlist_init(&workers, avl_strcmp, shard_worker_update);
+	workers.keep_old = true;
+
+	if (!netifd_shard)
+		shard_relay_init();
+}
+
+void shard_done(void)
+{
+	vlist_flush_all(&workers);
+}
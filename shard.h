@@ -0,0 +1,51 @@
+/*
+ * netifd - network interface daemon
+ * Copyright (C) 2012 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __NETIFD_SHARD_H
+#define __NETIFD_SHARD_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Interfaces can be split across several netifd instances with
+ * 'config shard' sections. The main instance (the coordinator) keeps
+ * devices, rules, wireless and every interface not assigned to a shard,
+ * and runs one worker per shard ("netifd -w <shard>"). Workers only
+ * manage their own interfaces and claim the devices they use through
+ * the coordinator's network.device object.
+ */
+
+struct device;
+struct blob_attr;
+struct ubus_context;
+struct ubus_request_data;
+
+void shard_init(char **argv);
+void shard_done(void);
+
+void shard_update_start(void);
+void shard_add(const char *name);
+void shard_update_complete(void);
+
+int shard_claim(const char *owner, const char *name, bool claim);
+int shard_device_claim(struct device *dev, bool claim);
+
+int shard_set_dns(const char *owner, const char *jail, const char *data);
+void shard_write_dns(FILE *f, const char *jail);
+void shard_push_dns(const char *jail, const char *data);
+
+int shard_dump_interfaces(struct ubus_context *ctx, struct ubus_request_data *req,
+			  struct blob_attr *local);
+
+#endif
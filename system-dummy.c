@@ -43,12 +43,29 @@ int system_bridge_delbr(struct device *bridge)
 	return 0;
 }
 
+int system_bridge_set_config(struct device *bridge, struct bridge_config *cfg)
+{
+	D(SYSTEM, "brctl setconfig %s stp=%d\n", bridge->ifname, cfg->stp);
+	return 0;
+}
+
 int system_bridge_addif(struct device *bridge, struct device *dev)
 {
 	D(SYSTEM, "brctl addif %s %s\n", bridge->ifname, dev->ifname);
 	return 0;
 }
 
+int system_bridge_addif_batch(struct device *bridge, struct device **devs,
+			      int *results, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		results[i] = system_bridge_addif(bridge, devs[i]);
+
+	return 0;
+}
+
 int system_bridge_delif(struct device *bridge, struct device *dev)
 {
 	D(SYSTEM, "brctl delif %s %s\n", bridge->ifname, dev->ifname);
@@ -318,6 +335,25 @@ int system_add_ip_tunnel(const char *name, struct blob_attr *attr)
 	return 0;
 }
 
+int system_change_ip_tunnel(const char *name, struct blob_attr *attr)
+{
+	return 0;
+}
+
+int system_bridge_fdb_update(struct device *bridge, const struct bridge_fdb_entry *entries,
+			     int n_entries, bool add)
+{
+	D(SYSTEM, "bridge fdb %s %d entries on %s\n", add ? "add" : "del", n_entries, bridge->ifname);
+	return 0;
+}
+
+int system_vxlan_fdb_update(struct device *dev, const struct vxlan_fdb_entry *entries,
+			    int n_entries, bool add)
+{
+	D(SYSTEM, "fdb %s %d entries on %s\n", add ? "add" : "del", n_entries, dev->ifname);
+	return 0;
+}
+
 int system_update_ipv6_mtu(struct device *dev, int mtu)
 {
 	return 0;
@@ -333,16 +369,37 @@ int system_macvlan_del(struct device *macvlan)
 	return 0;
 }
 
+int system_macvlan_change(struct device *macvlan, struct macvlan_config *cfg)
+{
+	return 0;
+}
+
 int system_veth_add(struct device *veth, struct veth_config *cfg)
 {
 	return 0;
 }
 
+int system_veth_add_batch(const char **ifnames, struct veth_config *cfgs, int *results, int n)
+{
+	memset(results, 0, n * sizeof(*results));
+	return 0;
+}
+
 int system_veth_del(struct device *veth)
 {
 	return 0;
 }
 
+int system_ipvlan_add(struct device *ipvlan, struct device *dev, struct ipvlan_config *cfg)
+{
+	return 0;
+}
+
+int system_ipvlan_del(struct device *ipvlan, const char *netns)
+{
+	return 0;
+}
+
 int system_vlandev_add(struct device *vlandev, struct device *dev, struct vlandev_config *cfg)
 {
 	return 0;
@@ -352,3 +409,9 @@ int system_vlandev_del(struct device *vlandev)
 {
 	return 0;
 }
+
+int system_vlandev_change(struct device *vlandev, struct vlandev_config *cfg,
+			  struct vlandev_config *ocfg)
+{
+	return 0;
+}
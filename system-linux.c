@@ -44,9 +44,13 @@
 #include <linux/ethtool.h>
 #include <linux/fib_rules.h>
 #include <linux/veth.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/bpf.h>
 #include <linux/version.h>
 
 #include <sched.h>
+#include <ctype.h>
 
 #ifndef RTN_FAILED_POLICY
 #define RTN_FAILED_POLICY 12
@@ -575,6 +579,511 @@ static int system_get_sendredirects(struct device *dev, char *buf, const size_t
 			dev->ifname, buf, buf_sz);
 }
 
+static int system_get_queue_sysctl(struct device *dev, const char *queue, const char *attr,
+				   char *buf, const size_t buf_sz)
+{
+	char path[PATH_MAX];
+	char *nl;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/queues/%s/%s", dev->ifname, queue, attr);
+	if (system_get_sysctl(path, buf, buf_sz))
+		return -1;
+
+	if ((nl = strchr(buf, '\n')))
+		*nl = 0;
+
+	return 0;
+}
+
+/*
+ * number of cpu ids the kernel can use, which sets the length of the cpu
+ * masks in sysfs and procfs
+ */
+static int system_get_possible_cpus(void)
+{
+	static int n_cpus;
+	char buf[64], *p;
+
+	if (n_cpus)
+		return n_cpus;
+
+	/* a list of ranges like "0-3,8-11", the last id is the highest one */
+	if (!system_get_sysctl("/sys/devices/system/cpu/possible", buf, sizeof(buf))) {
+		p = buf + strcspn(buf, "\n");
+		*p = 0;
+		while (p > buf && isdigit(p[-1]))
+			p--;
+		if (*p)
+			n_cpus = atoi(p) + 1;
+	}
+
+	if (n_cpus <= 0)
+		n_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (n_cpus <= 0)
+		n_cpus = 1;
+
+	return n_cpus;
+}
+
+/* buffer size for a cpu mask in sysfs format, including the terminating NUL */
+static size_t system_cpumask_len(void)
+{
+	return (system_get_possible_cpus() + 31) / 32 * 9;
+}
+
+static int system_get_online_cpus(int *cpus, int max)
+{
+	int n_possible = system_get_possible_cpus();
+	size_t size = CPU_ALLOC_SIZE(n_possible);
+	cpu_set_t *set;
+	int i, n = 0;
+
+	set = CPU_ALLOC(n_possible);
+	if (!set)
+		return 0;
+
+	if (!sched_getaffinity(0, size, set))
+		for (i = 0; i < n_possible && n < max; i++)
+			if (CPU_ISSET_S(i, size, set))
+				cpus[n++] = i;
+
+	CPU_FREE(set);
+	return n;
+}
+
+/* format a list of cpus the way sysfs does: 32 bit hex words separated by commas */
+static void system_format_cpumask(char *buf, size_t len, const int *cpus, int n)
+{
+	int i, w, words = 1;
+	uint32_t *mask;
+	size_t ofs = 0;
+
+	for (i = 0; i < n; i++)
+		if (cpus[i] / 32 + 1 > words)
+			words = cpus[i] / 32 + 1;
+
+	buf[0] = 0;
+	mask = calloc(words, sizeof(*mask));
+	if (!mask)
+		return;
+
+	for (i = 0; i < n; i++)
+		mask[cpus[i] / 32] |= 1U << (cpus[i] % 32);
+
+	for (w = words - 1; w >= 0 && ofs < len; w--)
+		ofs += snprintf(buf + ofs, len - ofs, "%s%08x",
+				w == words - 1 ? "" : ",", mask[w]);
+
+	free(mask);
+}
+
+/*
+ * cpus for queue/irq 'idx' out of 'n' in auto mode: with more queues than
+ * cpus each queue gets one cpu round-robin, otherwise the cpus are split
+ * evenly between the queues
+ */
+static void system_spread_cpumask(char *buf, size_t len, int idx, int n)
+{
+	int n_possible = system_get_possible_cpus();
+	int i, n_cpus, n_sel = 0;
+	int *cpus, *sel;
+	int cpu0 = 0;
+
+	cpus = calloc(2 * n_possible, sizeof(*cpus));
+	if (!cpus) {
+		system_format_cpumask(buf, len, &cpu0, 1);
+		return;
+	}
+
+	sel = cpus + n_possible;
+	n_cpus = system_get_online_cpus(cpus, n_possible);
+	if (!n_cpus)
+		sel[n_sel++] = 0;
+	else if (n >= n_cpus)
+		sel[n_sel++] = cpus[idx % n_cpus];
+	else
+		for (i = idx; i < n_cpus; i += n)
+			sel[n_sel++] = cpus[i];
+
+	system_format_cpumask(buf, len, sel, n_sel);
+	free(cpus);
+}
+
+/*
+ * Saved values hold one mask per queue or irq, one per line, so each one
+ * gets its own value back. A configured value is a single line that is
+ * used for all of them.
+ */
+static void system_cpumask_entry(char *buf, size_t len, const char *val, int idx)
+{
+	const char *next;
+	size_t n;
+
+	while (idx-- > 0 && (next = strchr(val, '\n')))
+		val = next + 1;
+
+	n = strcspn(val, "\n");
+	if (n >= len)
+		n = len - 1;
+
+	memcpy(buf, val, n);
+	buf[n] = 0;
+}
+
+/* append the mask in 'path' to a list of saved masks */
+static int system_save_cpumask(FILE *f, const char *path, bool first)
+{
+	size_t len = system_cpumask_len() + 1;
+	char *buf, *nl;
+	int ret;
+
+	buf = malloc(len);
+	if (!buf)
+		return -1;
+
+	ret = system_get_sysctl(path, buf, len);
+	if (!ret) {
+		if ((nl = strchr(buf, '\n')))
+			*nl = 0;
+		fprintf(f, "%s%s", first ? "" : "\n", buf);
+	}
+
+	free(buf);
+	return ret;
+}
+
+static char *system_get_queue_cpumasks(struct device *dev, const char *type,
+				       const char *attr)
+{
+	char path[PATH_MAX];
+	char *ret = NULL;
+	size_t size;
+	FILE *f;
+	int i;
+
+	f = open_memstream(&ret, &size);
+	if (!f)
+		return NULL;
+
+	for (i = 0; ; i++) {
+		snprintf(path, sizeof(path), "/sys/class/net/%s/queues/%s-%d/%s",
+			 dev->ifname, type, i, attr);
+		if (system_save_cpumask(f, path, !i))
+			break;
+	}
+
+	fclose(f);
+	if (!i) {
+		free(ret);
+		ret = NULL;
+	}
+
+	return ret;
+}
+
+static int system_if_set_queue_attr(struct device *dev, const char *type,
+				    const char *attr, const char *val)
+{
+	char path[PATH_MAX], *buf;
+	size_t len;
+	glob_t g;
+	int i, idx, n;
+
+	len = strlen(val) + 1;
+	if (len < system_cpumask_len())
+		len = system_cpumask_len();
+
+	buf = malloc(len);
+	if (!buf)
+		return 0;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/queues/%s-*", dev->ifname, type);
+	if (glob(path, 0, NULL, &g)) {
+		free(buf);
+		return 0;
+	}
+
+	n = g.gl_pathc;
+	for (i = 0; i < n; i++) {
+		idx = atoi(strrchr(g.gl_pathv[i], '-') + 1);
+		if (!strcmp(val, "auto"))
+			system_spread_cpumask(buf, len, idx, n);
+		else
+			system_cpumask_entry(buf, len, val, idx);
+
+		if (!*buf)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", g.gl_pathv[i], attr);
+		system_set_sysctl(path, buf);
+	}
+
+	globfree(&g);
+	free(buf);
+	return n;
+}
+
+static void system_if_set_rps_flow_cnt(struct device *dev, unsigned int cnt)
+{
+	char buf[16];
+	int n;
+
+	snprintf(buf, sizeof(buf), "%u", cnt);
+	n = system_if_set_queue_attr(dev, "rx", "rps_flow_cnt", buf);
+
+	/* RFS needs a global socket flow table at least as large as the queue tables */
+	if (!system_get_sysctl("/proc/sys/net/core/rps_sock_flow_entries", buf, sizeof(buf)) &&
+	    strtoul(buf, NULL, 0) < cnt * n) {
+		snprintf(buf, sizeof(buf), "%u", cnt * n);
+		system_set_sysctl("/proc/sys/net/core/rps_sock_flow_entries", buf);
+	}
+}
+
+static int system_irq_cmp(const void *a, const void *b)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+static int system_if_get_irqs(struct device *dev, int *irqs, int max)
+{
+	char path[PATH_MAX], buf[16];
+	glob_t g;
+	int i, n = 0;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/device/msi_irqs/*", dev->ifname);
+	if (!glob(path, 0, NULL, &g)) {
+		for (i = 0; i < g.gl_pathc && n < max; i++)
+			irqs[n++] = atoi(strrchr(g.gl_pathv[i], '/') + 1);
+		globfree(&g);
+		qsort(irqs, n, sizeof(*irqs), system_irq_cmp);
+		return n;
+	}
+
+	if (!system_get_dev_sysctl("/sys/class/net/%s/device/irq", dev->ifname, buf, sizeof(buf)) &&
+	    atoi(buf) > 0 && max > 0)
+		irqs[n++] = atoi(buf);
+
+	return n;
+}
+
+static void system_if_set_irq_affinity(struct device *dev, const char *mask)
+{
+	char path[64], *buf;
+	int irqs[256];
+	size_t len;
+	int i, n;
+
+	len = strlen(mask) + 1;
+	if (len < system_cpumask_len())
+		len = system_cpumask_len();
+
+	buf = malloc(len);
+	if (!buf)
+		return;
+
+	n = system_if_get_irqs(dev, irqs, ARRAY_SIZE(irqs));
+	for (i = 0; i < n; i++) {
+		if (!strcmp(mask, "auto"))
+			system_spread_cpumask(buf, len, i, n);
+		else
+			system_cpumask_entry(buf, len, mask, i);
+
+		if (!*buf)
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity", irqs[i]);
+		system_set_sysctl(path, buf);
+	}
+
+	free(buf);
+}
+
+/* masks of all irqs in the order system_if_set_irq_affinity uses them */
+static char *system_if_get_irq_affinity(struct device *dev)
+{
+	char path[64];
+	int irqs[256];
+	char *ret = NULL;
+	size_t size;
+	FILE *f;
+	int i, n;
+
+	n = system_if_get_irqs(dev, irqs, ARRAY_SIZE(irqs));
+	if (n < 1)
+		return NULL;
+
+	f = open_memstream(&ret, &size);
+	if (!f)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity", irqs[i]);
+		/* keep the positions of the others if one cannot be read */
+		if (system_save_cpumask(f, path, !i) && i)
+			fputc('\n', f);
+	}
+
+	fclose(f);
+	return ret;
+}
+
+static int system_ethtool(struct device *dev, void *data)
+{
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, dev->ifname, sizeof(ifr.ifr_name) - 1);
+	ifr.ifr_data = (caddr_t) data;
+
+	return ioctl(sock_ioctl, SIOCETHTOOL, &ifr);
+}
+
+static const struct {
+	unsigned int flag;
+	__u32 get_cmd;
+	__u32 set_cmd;
+} system_ethtool_offloads[] = {
+	{ DEV_ETHTOOL_GRO, ETHTOOL_GGRO, ETHTOOL_SGRO },
+	{ DEV_ETHTOOL_GSO, ETHTOOL_GGSO, ETHTOOL_SGSO },
+	{ DEV_ETHTOOL_TSO, ETHTOOL_GTSO, ETHTOOL_STSO },
+};
+
+static void system_ethtool_get_settings(struct device *dev, struct device_settings *s)
+{
+	struct ethtool_ringparam ring = { .cmd = ETHTOOL_GRINGPARAM };
+	struct ethtool_channels ch = { .cmd = ETHTOOL_GCHANNELS };
+	struct ethtool_coalesce coal = { .cmd = ETHTOOL_GCOALESCE };
+	struct ethtool_value ev;
+	int i;
+
+	s->ethtool_flags = 0;
+	s->offloads = 0;
+
+	for (i = 0; i < ARRAY_SIZE(system_ethtool_offloads); i++) {
+		ev.cmd = system_ethtool_offloads[i].get_cmd;
+		if (system_ethtool(dev, &ev))
+			continue;
+
+		s->ethtool_flags |= system_ethtool_offloads[i].flag;
+		if (ev.data)
+			s->offloads |= system_ethtool_offloads[i].flag;
+	}
+
+	ev.cmd = ETHTOOL_GFLAGS;
+	if (!system_ethtool(dev, &ev)) {
+		s->ethtool_flags |= DEV_ETHTOOL_LRO;
+		if (ev.data & ETH_FLAG_LRO)
+			s->offloads |= DEV_ETHTOOL_LRO;
+	}
+
+	if (!system_ethtool(dev, &ring)) {
+		s->rx_ring = ring.rx_pending;
+		s->tx_ring = ring.tx_pending;
+		s->ethtool_flags |= DEV_ETHTOOL_RX_RING | DEV_ETHTOOL_TX_RING;
+	}
+
+	if (!system_ethtool(dev, &ch)) {
+		s->channels = ch.combined_count;
+		s->ethtool_flags |= DEV_ETHTOOL_CHANNELS;
+	}
+
+	if (!system_ethtool(dev, &coal)) {
+		s->rx_usecs = coal.rx_coalesce_usecs;
+		s->tx_usecs = coal.tx_coalesce_usecs;
+		s->adaptive_rx = coal.use_adaptive_rx_coalesce;
+		s->adaptive_tx = coal.use_adaptive_tx_coalesce;
+		s->ethtool_flags |= DEV_ETHTOOL_RX_USECS | DEV_ETHTOOL_TX_USECS |
+				    DEV_ETHTOOL_ADAPTIVE_RX | DEV_ETHTOOL_ADAPTIVE_TX;
+	}
+
+	if (s->ethtool_flags)
+		s->flags |= DEV_OPT_ETHTOOL;
+}
+
+/*
+ * settings the driver rejects stay configured, so they are tried again on
+ * the next apply; the rejected ones are recorded in ethtool_failed
+ */
+static void system_ethtool_apply_settings(struct device *dev, struct device_settings *s)
+{
+	unsigned int f = s->ethtool_flags;
+	struct ethtool_value ev;
+	int i;
+
+	s->ethtool_failed = 0;
+
+	for (i = 0; i < ARRAY_SIZE(system_ethtool_offloads); i++) {
+		if (!(f & system_ethtool_offloads[i].flag))
+			continue;
+
+		ev.cmd = system_ethtool_offloads[i].set_cmd;
+		ev.data = !!(s->offloads & system_ethtool_offloads[i].flag);
+		if (system_ethtool(dev, &ev))
+			s->ethtool_failed |= system_ethtool_offloads[i].flag;
+	}
+
+	if (f & DEV_ETHTOOL_LRO) {
+		ev.cmd = ETHTOOL_GFLAGS;
+		if (!system_ethtool(dev, &ev)) {
+			ev.cmd = ETHTOOL_SFLAGS;
+			if (s->offloads & DEV_ETHTOOL_LRO)
+				ev.data |= ETH_FLAG_LRO;
+			else
+				ev.data &= ~ETH_FLAG_LRO;
+		}
+
+		if (ev.cmd != ETHTOOL_SFLAGS || system_ethtool(dev, &ev))
+			s->ethtool_failed |= DEV_ETHTOOL_LRO;
+	}
+
+	if (f & (DEV_ETHTOOL_RX_RING | DEV_ETHTOOL_TX_RING)) {
+		struct ethtool_ringparam ring = { .cmd = ETHTOOL_GRINGPARAM };
+
+		if (!system_ethtool(dev, &ring)) {
+			ring.cmd = ETHTOOL_SRINGPARAM;
+			if (f & DEV_ETHTOOL_RX_RING)
+				ring.rx_pending = s->rx_ring;
+			if (f & DEV_ETHTOOL_TX_RING)
+				ring.tx_pending = s->tx_ring;
+		}
+
+		if (ring.cmd != ETHTOOL_SRINGPARAM || system_ethtool(dev, &ring))
+			s->ethtool_failed |= f & (DEV_ETHTOOL_RX_RING | DEV_ETHTOOL_TX_RING);
+	}
+
+	if (f & DEV_ETHTOOL_CHANNELS) {
+		struct ethtool_channels ch = { .cmd = ETHTOOL_GCHANNELS };
+
+		if (!system_ethtool(dev, &ch) && ch.combined_count != s->channels) {
+			ch.cmd = ETHTOOL_SCHANNELS;
+			ch.combined_count = s->channels;
+			if (system_ethtool(dev, &ch))
+				s->ethtool_failed |= DEV_ETHTOOL_CHANNELS;
+		}
+	}
+
+	if (f & (DEV_ETHTOOL_RX_USECS | DEV_ETHTOOL_TX_USECS |
+		 DEV_ETHTOOL_ADAPTIVE_RX | DEV_ETHTOOL_ADAPTIVE_TX)) {
+		struct ethtool_coalesce coal = { .cmd = ETHTOOL_GCOALESCE };
+
+		if (!system_ethtool(dev, &coal)) {
+			coal.cmd = ETHTOOL_SCOALESCE;
+			if (f & DEV_ETHTOOL_RX_USECS)
+				coal.rx_coalesce_usecs = s->rx_usecs;
+			if (f & DEV_ETHTOOL_TX_USECS)
+				coal.tx_coalesce_usecs = s->tx_usecs;
+			if (f & DEV_ETHTOOL_ADAPTIVE_RX)
+				coal.use_adaptive_rx_coalesce = s->adaptive_rx;
+			if (f & DEV_ETHTOOL_ADAPTIVE_TX)
+				coal.use_adaptive_tx_coalesce = s->adaptive_tx;
+		}
+
+		if (coal.cmd != ETHTOOL_SCOALESCE || system_ethtool(dev, &coal))
+			s->ethtool_failed |= f & (DEV_ETHTOOL_RX_USECS | DEV_ETHTOOL_TX_USECS |
+						  DEV_ETHTOOL_ADAPTIVE_RX | DEV_ETHTOOL_ADAPTIVE_TX);
+	}
+}
+
 /* Evaluate netlink messages */
 static int cb_rtnl_event(struct nl_msg *msg, void *arg)
 {
@@ -740,74 +1249,246 @@ static int system_rtnl_call(struct nl_msg *msg)
 	return nl_wait_for_ack(sock_rtnl);
 }
 
-int system_bridge_delbr(struct device *bridge)
+/*
+ * Reusable rtnetlink send buffer. Requests are serialized into it in place
+ * and several of them can be queued before one sendto(), so bulk route or
+ * address updates do not allocate per message. Positions are kept as
+ * offsets because the buffer may move when it grows.
+ */
+struct nlbuf {
+	char *data;
+	size_t len;
+	size_t size;
+	size_t msg;
+	int n_msgs;
+	bool error;
+};
+
+static struct nlbuf rtnl_buf;
+
+static void *nlbuf_reserve(struct nlbuf *b, size_t len)
 {
-	return ioctl(sock_ioctl, SIOCBRDELBR, bridge->ifname);
+	size_t size;
+	void *data;
+
+	if (b->error)
+		return NULL;
+
+	if (b->len + len > b->size) {
+		size = b->size ? b->size : 4096;
+		while (size < b->len + len)
+			size *= 2;
+
+		data = realloc(b->data, size);
+		if (!data) {
+			b->error = true;
+			return NULL;
+		}
+
+		b->data = data;
+		b->size = size;
+	}
+
+	data = b->data + b->len;
+	memset(data, 0, len);
+	b->len += len;
+
+	return data;
 }
 
-static int system_bridge_if(const char *bridge, struct device *dev, int cmd, void *data)
+static void nlbuf_update_len(struct nlbuf *b)
 {
-	struct ifreq ifr;
+	struct nlmsghdr *nlh = (struct nlmsghdr *) (b->data + b->msg);
 
-	memset(&ifr, 0, sizeof(ifr));
-	if (dev)
-		ifr.ifr_ifindex = dev->ifindex;
-	else
-		ifr.ifr_data = data;
-	strncpy(ifr.ifr_name, bridge, sizeof(ifr.ifr_name) - 1);
-	return ioctl(sock_ioctl, cmd, &ifr);
+	nlh->nlmsg_len = b->len - b->msg;
 }
 
-static bool system_is_bridge(const char *name, char *buf, int buflen)
+static void nlbuf_msg(struct nlbuf *b, int type, int flags, const void *hdr, size_t hdrlen)
 {
-	struct stat st;
+	struct nlmsghdr *nlh;
+	size_t start = b->len;
 
-	snprintf(buf, buflen, "/sys/devices/virtual/net/%s/bridge", name);
-	if (stat(buf, &st) < 0)
-		return false;
+	nlh = nlbuf_reserve(b, NLMSG_HDRLEN + NLMSG_ALIGN(hdrlen));
+	if (!nlh)
+		return;
 
-	return true;
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+	memcpy(NLMSG_DATA(nlh), hdr, hdrlen);
+
+	b->msg = start;
+	b->n_msgs++;
+	nlbuf_update_len(b);
 }
 
-static char *system_get_bridge(const char *name, char *buf, int buflen)
+static void nlbuf_put(struct nlbuf *b, int type, const void *data, size_t len)
 {
-	char *path;
-	ssize_t len = -1;
-	glob_t gl;
+	struct nlattr *nla;
 
-	snprintf(buf, buflen, "/sys/devices/virtual/net/*/brif/%s/bridge", name);
-	if (glob(buf, GLOB_NOSORT, NULL, &gl) < 0)
-		return NULL;
+	nla = nlbuf_reserve(b, NLA_HDRLEN + NLA_ALIGN(len));
+	if (!nla)
+		return;
 
-	if (gl.gl_pathc > 0)
-		len = readlink(gl.gl_pathv[0], buf, buflen);
+	nla->nla_type = type;
+	nla->nla_len = NLA_HDRLEN + len;
+	if (len)
+		memcpy((char *) nla + NLA_HDRLEN, data, len);
+	nlbuf_update_len(b);
+}
 
-	globfree(&gl);
+static void nlbuf_put_u32(struct nlbuf *b, int type, uint32_t val)
+{
+	nlbuf_put(b, type, &val, sizeof(val));
+}
 
-	if (len < 0)
-		return NULL;
+static size_t nlbuf_nest_start(struct nlbuf *b, int type)
+{
+	size_t start = b->len;
 
-	buf[len] = 0;
-	path = strrchr(buf, '/');
-	if (!path)
-		return NULL;
+	nlbuf_put(b, type | NLA_F_NESTED, NULL, 0);
 
-	return path + 1;
+	return start;
 }
 
-static void
-system_bridge_set_wireless(struct device *bridge, struct device *dev)
+static void nlbuf_nest_end(struct nlbuf *b, size_t start)
 {
-	bool mcast_to_ucast = dev->wireless_ap;
-	bool hairpin = true;
+	struct nlattr *nla;
 
-	if (bridge->settings.flags & DEV_OPT_MULTICAST_TO_UNICAST &&
-	    !bridge->settings.multicast_to_unicast)
-		mcast_to_ucast = false;
+	if (b->error)
+		return;
 
-	if (!mcast_to_ucast || dev->wireless_isolate)
-		hairpin = false;
+	nla = (struct nlattr *) (b->data + start);
+	nla->nla_len = b->len - start;
+}
+
+/* drop the message being built, e.g. when its contents turn out invalid */
+static void nlbuf_cancel_msg(struct nlbuf *b)
+{
+	if (b->error || !b->n_msgs)
+		return;
+
+	b->len = b->msg;
+	b->n_msgs--;
+}
+
+/*
+ * Send all queued requests at once, then collect one ack per request.
+ * results (optional) receives the status of each request; the return
+ * value is the first error seen.
+ */
+static int nlbuf_send(struct nlbuf *b, int *results)
+{
+	struct nlmsghdr *nlh;
+	int i, err, ret = 0;
+	int n = b->n_msgs;
+	size_t pos;
+
+	/* sequence numbers are only taken once the requests are final */
+	for (pos = 0; !b->error && pos < b->len; pos += NLMSG_ALIGN(nlh->nlmsg_len)) {
+		nlh = (struct nlmsghdr *) (b->data + pos);
+		nlh->nlmsg_seq = nl_socket_use_seq(sock_rtnl);
+		nlh->nlmsg_pid = nl_socket_get_local_port(sock_rtnl);
+	}
+
+	if (b->error) {
+		ret = -ENOMEM;
+		n = 0;
+	} else if (n && nl_sendto(sock_rtnl, b->data, b->len) < 0) {
+		ret = -1;
+		n = 0;
+	}
+
+	for (i = 0; i < b->n_msgs; i++) {
+		err = i < n ? nl_wait_for_ack(sock_rtnl) : ret;
+		if (results)
+			results[i] = err;
+		if (err && !ret)
+			ret = err;
+	}
 
+	b->len = 0;
+	b->n_msgs = 0;
+	b->error = false;
+
+	return ret;
+}
+
+int system_bridge_delbr(struct device *bridge)
+{
+	return ioctl(sock_ioctl, SIOCBRDELBR, bridge->ifname);
+}
+
+static int system_bridge_if(const char *bridge, struct device *dev, int cmd, void *data)
+{
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	if (dev)
+		ifr.ifr_ifindex = dev->ifindex;
+	else
+		ifr.ifr_data = data;
+	strncpy(ifr.ifr_name, bridge, sizeof(ifr.ifr_name) - 1);
+	return ioctl(sock_ioctl, cmd, &ifr);
+}
+
+static bool system_is_bridge(const char *name, char *buf, int buflen)
+{
+	struct stat st;
+
+	snprintf(buf, buflen, "/sys/devices/virtual/net/%s/bridge", name);
+	if (stat(buf, &st) < 0)
+		return false;
+
+	return true;
+}
+
+static char *system_get_bridge(const char *name, char *buf, int buflen)
+{
+	char *path;
+	ssize_t len = -1;
+	glob_t gl;
+
+	snprintf(buf, buflen, "/sys/devices/virtual/net/*/brif/%s/bridge", name);
+	if (glob(buf, GLOB_NOSORT, NULL, &gl) < 0)
+		return NULL;
+
+	if (gl.gl_pathc > 0)
+		len = readlink(gl.gl_pathv[0], buf, buflen);
+
+	globfree(&gl);
+
+	if (len < 0)
+		return NULL;
+
+	buf[len] = 0;
+	path = strrchr(buf, '/');
+	if (!path)
+		return NULL;
+
+	return path + 1;
+}
+
+static void
+system_bridge_wireless_opts(struct device *bridge, struct device *dev,
+			    bool *mcast_to_ucast, bool *hairpin)
+{
+	*mcast_to_ucast = dev->wireless_ap;
+	*hairpin = true;
+
+	if (bridge->settings.flags & DEV_OPT_MULTICAST_TO_UNICAST &&
+	    !bridge->settings.multicast_to_unicast)
+		*mcast_to_ucast = false;
+
+	if (!*mcast_to_ucast || dev->wireless_isolate)
+		*hairpin = false;
+}
+
+static void
+system_bridge_set_wireless(struct device *bridge, struct device *dev)
+{
+	bool mcast_to_ucast, hairpin;
+
+	system_bridge_wireless_opts(bridge, dev, &mcast_to_ucast, &hairpin);
 	system_bridge_set_multicast_to_unicast(dev, mcast_to_ucast ? "1" : "0");
 	system_bridge_set_hairpin_mode(dev, hairpin ? "1" : "0");
 }
@@ -849,6 +1530,201 @@ int system_bridge_addif(struct device *bridge, struct device *dev)
 	return ret;
 }
 
+static void nlbuf_put_u8(struct nlbuf *b, int type, uint8_t val)
+{
+	nlbuf_put(b, type, &val, sizeof(val));
+}
+
+/* the brport options system_bridge_addif() writes through sysfs */
+static void system_bridge_put_port_opts(struct nlbuf *b, struct device *bridge,
+					struct device *dev)
+{
+	struct ifinfomsg ifi = { .ifi_family = AF_BRIDGE, .ifi_index = dev->ifindex };
+	struct device_settings *s = &dev->settings;
+	bool mcast_to_ucast, hairpin;
+	size_t nest;
+
+	nlbuf_msg(b, RTM_SETLINK, 0, &ifi, sizeof(ifi));
+	nest = nlbuf_nest_start(b, IFLA_PROTINFO);
+
+	if (dev->wireless) {
+		system_bridge_wireless_opts(bridge, dev, &mcast_to_ucast, &hairpin);
+		nlbuf_put_u8(b, IFLA_BRPORT_MCAST_TO_UCAST, mcast_to_ucast);
+		nlbuf_put_u8(b, IFLA_BRPORT_MODE, hairpin);
+	}
+
+	if (s->flags & DEV_OPT_MULTICAST_ROUTER)
+		nlbuf_put_u8(b, IFLA_BRPORT_MULTICAST_ROUTER, s->multicast_router);
+
+	if (s->flags & DEV_OPT_MULTICAST_FAST_LEAVE && s->multicast_fast_leave)
+		nlbuf_put_u8(b, IFLA_BRPORT_FAST_LEAVE, 1);
+
+	if (s->flags & DEV_OPT_LEARNING && !s->learning)
+		nlbuf_put_u8(b, IFLA_BRPORT_LEARNING, 0);
+
+	if (s->flags & DEV_OPT_UNICAST_FLOOD && !s->unicast_flood)
+		nlbuf_put_u8(b, IFLA_BRPORT_UNICAST_FLOOD, 0);
+
+	if (s->flags & DEV_OPT_ISOLATE && s->isolate)
+		nlbuf_put_u8(b, IFLA_BRPORT_ISOLATED, 1);
+
+	nlbuf_nest_end(b, nest);
+}
+
+/*
+ * Same as system_bridge_addif() for n ports at once: the master change and
+ * the port options of every port go out as one batch of requests.
+ * results[i] receives the status of devs[i].
+ */
+int system_bridge_addif_batch(struct device *bridge, struct device **devs,
+			      int *results, int n)
+{
+	struct ifinfomsg ifi = { .ifi_family = AF_UNSPEC };
+	struct nlbuf *b = &rtnl_buf;
+	int *status;
+	int i, ret;
+
+	status = calloc(2 * n, sizeof(*status));
+	if (!status) {
+		for (i = 0; i < n; i++)
+			results[i] = system_bridge_addif(bridge, devs[i]);
+		return 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		ifi.ifi_index = devs[i]->ifindex;
+		nlbuf_msg(b, RTM_SETLINK, 0, &ifi, sizeof(ifi));
+		nlbuf_put_u32(b, IFLA_MASTER, bridge->ifindex);
+		system_bridge_put_port_opts(b, bridge, devs[i]);
+	}
+
+	ret = nlbuf_send(b, status);
+	for (i = 0; i < n; i++) {
+		/* option failures are ignored, like the sysfs writes they replace */
+		results[i] = status[2 * i];
+		if (results[i])
+			D(SYSTEM, "Failed to add %s to bridge %s: %d\n",
+			  devs[i]->ifname, bridge->ifname, results[i]);
+	}
+
+	free(status);
+
+	return ret;
+}
+
+#define BRIDGE_FDB_BATCH	64
+
+static void system_bridge_mdb_msg(struct nlbuf *b, int br_ifindex, int ifindex,
+				  const struct bridge_fdb_entry *entry, bool add)
+{
+	struct br_port_msg bpm = {
+		.family = AF_BRIDGE,
+		.ifindex = br_ifindex,
+	};
+	struct br_mdb_entry mdb = {
+		.ifindex = ifindex,
+		.state = (entry->flags & BRFDB_F_TEMPORARY) ? MDB_TEMPORARY : MDB_PERMANENT,
+		.vid = entry->vid,
+	};
+
+	switch (entry->family) {
+	case AF_INET:
+		mdb.addr.u.ip4 = entry->addr.in.s_addr;
+		mdb.addr.proto = htons(ETH_P_IP);
+		break;
+	case AF_INET6:
+		mdb.addr.u.ip6 = entry->addr.in6;
+		mdb.addr.proto = htons(ETH_P_IPV6);
+		break;
+	default:
+		memcpy(mdb.addr.u.mac_addr, entry->addr.lladdr, sizeof(mdb.addr.u.mac_addr));
+		break;
+	}
+
+	if (add)
+		nlbuf_msg(b, RTM_NEWMDB, NLM_F_CREATE | NLM_F_REPLACE, &bpm, sizeof(bpm));
+	else
+		nlbuf_msg(b, RTM_DELMDB, 0, &bpm, sizeof(bpm));
+
+	nlbuf_put(b, MDBA_SET_ENTRY, &mdb, sizeof(mdb));
+}
+
+static void system_bridge_fdb_msg(struct nlbuf *b, int br_ifindex, int ifindex,
+				  const struct bridge_fdb_entry *entry, bool add)
+{
+	struct ndmsg ndm = {
+		.ndm_family = AF_BRIDGE,
+		.ndm_ifindex = ifindex,
+		.ndm_state = (entry->flags & BRFDB_F_LOCAL) ? NUD_PERMANENT : NUD_NOARP,
+		.ndm_flags = ifindex == br_ifindex ? NTF_SELF : NTF_MASTER,
+	};
+
+	if (entry->flags & BRFDB_F_MDB) {
+		system_bridge_mdb_msg(b, br_ifindex, ifindex, entry, add);
+		return;
+	}
+
+	if (entry->flags & BRFDB_F_STICKY)
+		ndm.ndm_flags |= NTF_STICKY;
+
+	if (add)
+		nlbuf_msg(b, RTM_NEWNEIGH, NLM_F_CREATE | NLM_F_REPLACE, &ndm, sizeof(ndm));
+	else
+		nlbuf_msg(b, RTM_DELNEIGH, 0, &ndm, sizeof(ndm));
+
+	nlbuf_put(b, NDA_LLADDR, entry->addr.lladdr, sizeof(entry->addr.lladdr));
+	if (entry->vid)
+		nlbuf_put(b, NDA_VLAN, &entry->vid, sizeof(entry->vid));
+}
+
+int system_bridge_fdb_update(struct device *bridge, const struct bridge_fdb_entry *entries,
+			     int n_entries, bool add)
+{
+	int br_ifindex = system_if_resolve(bridge);
+	int results[BRIDGE_FDB_BATCH];
+	const char *port = NULL;
+	int ifindex = 0;
+	int i, j, n, err, ret = 0;
+
+	if (!br_ifindex)
+		return -ENODEV;
+
+	for (i = 0; i < n_entries; i += n) {
+		n = n_entries - i;
+		if (n > BRIDGE_FDB_BATCH)
+			n = BRIDGE_FDB_BATCH;
+
+		for (j = 0; j < n; j++) {
+			const struct bridge_fdb_entry *entry = &entries[i + j];
+
+			/* entries of the same port are usually adjacent */
+			if (!port || strcmp(port, entry->port) != 0) {
+				port = entry->port;
+				ifindex = port[0] ? if_nametoindex(port) : br_ifindex;
+			}
+
+			system_bridge_fdb_msg(&rtnl_buf, br_ifindex, ifindex, entry, add);
+		}
+
+		nlbuf_send(&rtnl_buf, results);
+
+		for (j = 0; j < n; j++) {
+			err = results[j];
+			if (!err || err == -NLE_EXIST || err == -NLE_OBJ_NOTFOUND)
+				continue;
+
+			D(SYSTEM, "Failed to %s %s entry on '%s' port '%s': %d\n",
+			  add ? "add" : "delete",
+			  (entries[i + j].flags & BRFDB_F_MDB) ? "mdb" : "fdb",
+			  bridge->ifname, entries[i + j].port, err);
+			if (!ret)
+				ret = err;
+		}
+	}
+
+	return ret;
+}
+
 int system_bridge_delif(struct device *bridge, struct device *dev)
 {
 	return system_bridge_if(bridge->ifname, dev, SIOCBRDELIF, NULL);
@@ -1213,11 +2089,17 @@ static void system_bridge_conf_multicast(struct device *bridge,
 
 int system_bridge_addbr(struct device *bridge, struct bridge_config *cfg)
 {
-	char buf[64];
-
 	if (ioctl(sock_ioctl, SIOCBRADDBR, bridge->ifname) < 0)
 		return -1;
 
+	return system_bridge_set_config(bridge, cfg);
+}
+
+/* every option written here can be changed on a live bridge */
+int system_bridge_set_config(struct device *bridge, struct bridge_config *cfg)
+{
+	char buf[64];
+
 	system_bridge_set_stp_state(bridge, cfg->stp ? "1" : "0");
 
 	snprintf(buf, sizeof(buf), "%lu", sec_to_jiffies(cfg->forward_delay));
@@ -1247,12 +2129,9 @@ int system_bridge_addbr(struct device *bridge, struct bridge_config *cfg)
 	return 0;
 }
 
-int system_macvlan_add(struct device *macvlan, struct device *dev, struct macvlan_config *cfg)
+static void
+system_macvlan_put_mode(struct nl_msg *msg, const char *mode)
 {
-	struct nl_msg *msg;
-	struct nlattr *linkinfo, *data;
-	struct ifinfomsg iim = { .ifi_family = AF_UNSPEC, };
-	int i, rv;
 	static const struct {
 		const char *name;
 		enum macvlan_mode val;
@@ -1262,6 +2141,26 @@ int system_macvlan_add(struct device *macvlan, struct device *dev, struct macvla
 		{ "bridge", MACVLAN_MODE_BRIDGE },
 		{ "passthru", MACVLAN_MODE_PASSTHRU },
 	};
+	int i;
+
+	if (!mode)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(modes); i++) {
+		if (strcmp(mode, modes[i].name) != 0)
+			continue;
+
+		nla_put_u32(msg, IFLA_MACVLAN_MODE, modes[i].val);
+		break;
+	}
+}
+
+int system_macvlan_add(struct device *macvlan, struct device *dev, struct macvlan_config *cfg)
+{
+	struct nl_msg *msg;
+	struct nlattr *linkinfo, *data;
+	struct ifinfomsg iim = { .ifi_family = AF_UNSPEC, };
+	int rv;
 
 	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL);
 
@@ -1283,15 +2182,7 @@ int system_macvlan_add(struct device *macvlan, struct device *dev, struct macvla
 	if (!(data = nla_nest_start(msg, IFLA_INFO_DATA)))
 		goto nla_put_failure;
 
-	if (cfg->mode) {
-		for (i = 0; i < ARRAY_SIZE(modes); i++) {
-			if (strcmp(cfg->mode, modes[i].name) != 0)
-				continue;
-
-			nla_put_u32(msg, IFLA_MACVLAN_MODE, modes[i].val);
-			break;
-		}
-	}
+	system_macvlan_put_mode(msg, cfg->mode);
 
 	nla_nest_end(msg, data);
 	nla_nest_end(msg, linkinfo);
@@ -1307,6 +2198,48 @@ nla_put_failure:
 	return -ENOMEM;
 }
 
+/* change mode and address of an existing macvlan link */
+int system_macvlan_change(struct device *macvlan, struct macvlan_config *cfg)
+{
+	struct nl_msg *msg;
+	struct nlattr *linkinfo, *data;
+	struct ifinfomsg iim = { .ifi_family = AF_UNSPEC, };
+	int rv;
+
+	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST);
+	if (!msg)
+		return -1;
+
+	nlmsg_append(msg, &iim, sizeof(iim), 0);
+	nla_put_string(msg, IFLA_IFNAME, macvlan->ifname);
+
+	if (cfg->flags & MACVLAN_OPT_MACADDR)
+		nla_put(msg, IFLA_ADDRESS, sizeof(cfg->macaddr), cfg->macaddr);
+
+	if (!(linkinfo = nla_nest_start(msg, IFLA_LINKINFO)))
+		goto nla_put_failure;
+
+	nla_put_string(msg, IFLA_INFO_KIND, "macvlan");
+
+	if (!(data = nla_nest_start(msg, IFLA_INFO_DATA)))
+		goto nla_put_failure;
+
+	system_macvlan_put_mode(msg, cfg->mode ? cfg->mode : "vepa");
+
+	nla_nest_end(msg, data);
+	nla_nest_end(msg, linkinfo);
+
+	rv = system_rtnl_call(msg);
+	if (rv)
+		D(SYSTEM, "Error changing macvlan '%s': %d\n", macvlan->ifname, rv);
+
+	return rv;
+
+nla_put_failure:
+	nlmsg_free(msg);
+	return -ENOMEM;
+}
+
 int system_link_netns_move(struct device *dev, int netns_fd, const char *target_ifname)
 {
 	struct nl_msg *msg;
@@ -1368,23 +2301,40 @@ int system_netns_set(int netns_fd)
 	return setns(netns_fd, CLONE_NEWNET);
 }
 
-int system_veth_add(struct device *veth, struct veth_config *cfg)
+static int system_link_netns_open(const char *netns)
+{
+	char *end;
+	unsigned long pid;
+	int fd;
+
+	pid = strtoul(netns, &end, 10);
+	if (*netns && !*end)
+		fd = system_netns_open(pid);
+	else
+		fd = open(netns, O_RDONLY);
+
+	if (fd >= 0)
+		system_fd_set_cloexec(fd);
+
+	return fd;
+}
+
+static struct nl_msg *system_veth_msg(const char *ifname, struct veth_config *cfg, int netns_fd)
 {
 	struct nl_msg *msg;
 	struct ifinfomsg empty_iim = {};
 	struct nlattr *linkinfo, *data, *veth_info;
-	int rv;
 
 	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL);
 
 	if (!msg)
-		return -1;
+		return NULL;
 
 	nlmsg_append(msg, &empty_iim, sizeof(empty_iim), 0);
 
 	if (cfg->flags & VETH_OPT_MACADDR)
 		nla_put(msg, IFLA_ADDRESS, sizeof(cfg->macaddr), cfg->macaddr);
-	nla_put_string(msg, IFLA_IFNAME, veth->ifname);
+	nla_put_string(msg, IFLA_IFNAME, ifname);
 
 	if (!(linkinfo = nla_nest_start(msg, IFLA_LINKINFO)))
 		goto nla_put_failure;
@@ -1404,28 +2354,306 @@ int system_veth_add(struct device *veth, struct veth_config *cfg)
 	if (cfg->flags & VETH_OPT_PEER_MACADDR)
 		nla_put(msg, IFLA_ADDRESS, sizeof(cfg->peer_macaddr), cfg->peer_macaddr);
 
+	/* create the peer directly in its target namespace */
+	if (netns_fd >= 0)
+		nla_put_u32(msg, IFLA_NET_NS_FD, netns_fd);
+
 	nla_nest_end(msg, veth_info);
 	nla_nest_end(msg, data);
 	nla_nest_end(msg, linkinfo);
 
+	return msg;
+
+nla_put_failure:
+	nlmsg_free(msg);
+	return NULL;
+}
+
+static void system_veth_log_error(const char *ifname, struct veth_config *cfg, int rv)
+{
+	if (cfg->flags & VETH_OPT_PEER_NAME)
+		D(SYSTEM, "Error adding veth '%s' with peer '%s': %d\n", ifname, cfg->peer_name, rv);
+	else
+		D(SYSTEM, "Error adding veth '%s': %d\n", ifname, rv);
+}
+
+int system_veth_add(struct device *veth, struct veth_config *cfg)
+{
+	struct nl_msg *msg;
+	int netns_fd = -1;
+	int rv;
+
+	if (cfg->flags & VETH_OPT_PEER_NETNS) {
+		netns_fd = system_link_netns_open(cfg->peer_netns);
+		if (netns_fd < 0) {
+			D(SYSTEM, "Failed to open netns '%s' for veth '%s'\n",
+			  cfg->peer_netns, veth->ifname);
+			return -1;
+		}
+	}
+
+	msg = system_veth_msg(veth->ifname, cfg, netns_fd);
+	if (!msg) {
+		rv = -ENOMEM;
+		goto out;
+	}
+
 	rv = system_rtnl_call(msg);
-	if (rv) {
-		if (cfg->flags & VETH_OPT_PEER_NAME)
-			D(SYSTEM, "Error adding veth '%s' with peer '%s': %d\n", veth->ifname, cfg->peer_name, rv);
-		else
-			D(SYSTEM, "Error adding veth '%s': %d\n", veth->ifname, rv);
+	if (rv)
+		system_veth_log_error(veth->ifname, cfg, rv);
+
+out:
+	if (netns_fd >= 0)
+		close(netns_fd);
+
+	return rv;
+}
+
+/* number of veth requests in flight before collecting their acks */
+#define VETH_BATCH	32
+
+/* map libnl error codes back to errno for callers that report them */
+static int system_nlerr_to_errno(int err)
+{
+	switch (err) {
+	case 0:
+		return 0;
+	case -NLE_EXIST:
+		return -EEXIST;
+	case -NLE_NOMEM:
+		return -ENOMEM;
+	case -NLE_INVAL:
+	case -NLE_MISSING_ATTR:
+	case -NLE_ATTRSIZE:
+		return -EINVAL;
+	case -NLE_RANGE:
+		return -ERANGE;
+	case -NLE_MSGSIZE:
+		return -EMSGSIZE;
+	case -NLE_OPNOTSUPP:
+		return -EOPNOTSUPP;
+	case -NLE_AF_NOSUPPORT:
+		return -EAFNOSUPPORT;
+	case -NLE_OBJ_NOTFOUND:
+		return -ENOENT;
+	case -NLE_NODEV:
+		return -ENODEV;
+	case -NLE_BUSY:
+		return -EBUSY;
+	case -NLE_AGAIN:
+		return -EAGAIN;
+	case -NLE_INTR:
+		return -EINTR;
+	case -NLE_PERM:
+		return -EPERM;
+	case -NLE_NOACCESS:
+		return -EACCES;
+	case -NLE_NOADDR:
+		return -EADDRNOTAVAIL;
+	default:
+		return -EIO;
 	}
+}
+
+int system_veth_add_batch(const char **ifnames, struct veth_config *cfgs, int *results, int n)
+{
+	int netns_fd[VETH_BATCH];
+	int i, j, n_batch, n_failed = 0;
+
+	for (i = 0; i < n; i += n_batch) {
+		n_batch = n - i;
+		if (n_batch > VETH_BATCH)
+			n_batch = VETH_BATCH;
+
+		for (j = 0; j < n_batch; j++) {
+			struct veth_config *cfg = &cfgs[i + j];
+			struct nl_msg *msg;
+
+			netns_fd[j] = -1;
+			results[i + j] = 0;
+
+			if (cfg->flags & VETH_OPT_PEER_NETNS) {
+				netns_fd[j] = system_link_netns_open(cfg->peer_netns);
+				if (netns_fd[j] < 0) {
+					results[i + j] = -errno;
+					D(SYSTEM, "Failed to open netns '%s' for veth '%s': %s\n",
+					  cfg->peer_netns, ifnames[i + j], strerror(errno));
+					continue;
+				}
+			}
+
+			msg = system_veth_msg(ifnames[i + j], cfg, netns_fd[j]);
+			if (!msg) {
+				results[i + j] = -ENOMEM;
+				continue;
+			}
+
+			if (nl_send_auto_complete(sock_rtnl, msg) < 0)
+				results[i + j] = -EIO;
+			nlmsg_free(msg);
+		}
+
+		/* acks arrive in request order, one for every message sent */
+		for (j = 0; j < n_batch; j++) {
+			if (!results[i + j]) {
+				results[i + j] = system_nlerr_to_errno(nl_wait_for_ack(sock_rtnl));
+				if (results[i + j])
+					system_veth_log_error(ifnames[i + j], &cfgs[i + j],
+							      results[i + j]);
+			}
+
+			if (results[i + j])
+				n_failed++;
+
+			if (netns_fd[j] >= 0)
+				close(netns_fd[j]);
+		}
+	}
+
+	return n_failed ? -1 : 0;
+}
+
+int system_veth_del(struct device *veth)
+{
+	return system_link_del(veth->ifname);
+}
+
+int system_ipvlan_add(struct device *ipvlan, struct device *dev, struct ipvlan_config *cfg)
+{
+	struct nl_msg *msg;
+	struct nlattr *linkinfo, *data;
+	struct ifinfomsg iim = { .ifi_family = AF_UNSPEC, };
+	int netns_fd = -1;
+	int i, rv;
+	static const struct {
+		const char *name;
+		int val;
+	} modes[] = {
+		{ "l2", IPVLAN_MODE_L2 },
+		{ "l3", IPVLAN_MODE_L3 },
+		{ "l3s", IPVLAN_MODE_L3S },
+	}, flags[] = {
+		{ "bridge", 0 },
+		{ "private", IPVLAN_F_PRIVATE },
+		{ "vepa", IPVLAN_F_VEPA },
+	};
+
+	if (cfg->netns) {
+		netns_fd = system_link_netns_open(cfg->netns);
+		if (netns_fd < 0) {
+			D(SYSTEM, "Failed to open netns '%s' for ipvlan '%s'\n",
+			  cfg->netns, ipvlan->ifname);
+			return -1;
+		}
+	}
+
+	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL);
+	if (!msg) {
+		rv = -ENOMEM;
+		goto out;
+	}
+
+	nlmsg_append(msg, &iim, sizeof(iim), 0);
+	nla_put_string(msg, IFLA_IFNAME, ipvlan->ifname);
+	nla_put_u32(msg, IFLA_LINK, dev->ifindex);
+
+	/* create the link directly in its target namespace */
+	if (netns_fd >= 0)
+		nla_put_u32(msg, IFLA_NET_NS_FD, netns_fd);
+
+	if (!(linkinfo = nla_nest_start(msg, IFLA_LINKINFO)))
+		goto nla_put_failure;
+
+	nla_put_string(msg, IFLA_INFO_KIND, "ipvlan");
+
+	if (!(data = nla_nest_start(msg, IFLA_INFO_DATA)))
+		goto nla_put_failure;
+
+	for (i = 0; cfg->mode && i < ARRAY_SIZE(modes); i++) {
+		if (strcmp(cfg->mode, modes[i].name) != 0)
+			continue;
+
+		nla_put_u16(msg, IFLA_IPVLAN_MODE, modes[i].val);
+		break;
+	}
+
+	for (i = 0; cfg->flag && i < ARRAY_SIZE(flags); i++) {
+		if (strcmp(cfg->flag, flags[i].name) != 0)
+			continue;
+
+		nla_put_u16(msg, IFLA_IPVLAN_FLAGS, flags[i].val);
+		break;
+	}
+
+	nla_nest_end(msg, data);
+	nla_nest_end(msg, linkinfo);
+
+	rv = system_rtnl_call(msg);
+	if (rv)
+		D(SYSTEM, "Error adding ipvlan '%s' over '%s': %d\n", ipvlan->ifname, dev->ifname, rv);
+
+out:
+	if (netns_fd >= 0)
+		close(netns_fd);
 
 	return rv;
 
 nla_put_failure:
 	nlmsg_free(msg);
-	return -ENOMEM;
+	rv = -ENOMEM;
+	goto out;
 }
 
-int system_veth_del(struct device *veth)
+/* links in another namespace are only reachable through a socket opened there */
+static int system_link_del_netns(const char *ifname, const char *netns)
 {
-	return system_link_del(veth->ifname);
+	struct ifinfomsg iim = { .ifi_family = AF_UNSPEC, };
+	struct nl_sock *sock = NULL;
+	struct nl_msg *msg;
+	int root_fd, netns_fd;
+	int rv = -1;
+
+	root_fd = open("/proc/self/ns/net", O_RDONLY);
+	if (root_fd < 0)
+		return -1;
+
+	netns_fd = system_link_netns_open(netns);
+	if (netns_fd < 0)
+		goto out;
+
+	if (!system_netns_set(netns_fd)) {
+		sock = create_socket(NETLINK_ROUTE, 0);
+		system_netns_set(root_fd);
+	}
+	close(netns_fd);
+
+	if (!sock)
+		goto out;
+
+	msg = nlmsg_alloc_simple(RTM_DELLINK, NLM_F_REQUEST);
+	if (msg) {
+		nlmsg_append(msg, &iim, sizeof(iim), 0);
+		nla_put_string(msg, IFLA_IFNAME, ifname);
+
+		rv = nl_send_auto_complete(sock, msg);
+		nlmsg_free(msg);
+		if (rv >= 0)
+			rv = nl_wait_for_ack(sock);
+	}
+
+	nl_socket_free(sock);
+
+out:
+	close(root_fd);
+	return rv;
+}
+
+int system_ipvlan_del(struct device *ipvlan, const char *netns)
+{
+	if (netns)
+		return system_link_del_netns(ipvlan->ifname, netns);
+
+	return system_link_del(ipvlan->ifname);
 }
 
 static int system_vlan(struct device *dev, int id)
@@ -1449,33 +2677,106 @@ static int system_vlan(struct device *dev, int id)
 	return ioctl(sock_ioctl, SIOCSIFVLAN, &ifr);
 }
 
-int system_vlan_add(struct device *dev, int id)
-{
-	return system_vlan(dev, id);
-}
+int system_vlan_add(struct device *dev, int id)
+{
+	return system_vlan(dev, id);
+}
+
+int system_vlan_del(struct device *dev)
+{
+	return system_vlan(dev, -1);
+}
+
+static void
+system_vlandev_put_qos(struct nl_msg *msg, struct vlist_simple_tree *list, bool clear)
+{
+	struct vlan_qos_mapping *elem;
+	struct ifla_vlan_qos_mapping nl_qos_map;
+
+	vlist_simple_for_each_element(list, elem, node) {
+		nl_qos_map.from = elem->from;
+		nl_qos_map.to = clear ? 0 : elem->to;
+		nla_put(msg, IFLA_VLAN_QOS_MAPPING, sizeof(nl_qos_map), &nl_qos_map);
+	}
+}
+
+int system_vlandev_add(struct device *vlandev, struct device *dev, struct vlandev_config *cfg)
+{
+	struct nl_msg *msg;
+	struct nlattr *linkinfo, *data, *qos;
+	struct ifinfomsg iim = { .ifi_family = AF_UNSPEC };
+	int rv;
+
+	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL);
+
+	if (!msg)
+		return -1;
+
+	nlmsg_append(msg, &iim, sizeof(iim), 0);
+	nla_put_string(msg, IFLA_IFNAME, vlandev->ifname);
+	nla_put_u32(msg, IFLA_LINK, dev->ifindex);
+
+	if (!(linkinfo = nla_nest_start(msg, IFLA_LINKINFO)))
+		goto nla_put_failure;
+
+	nla_put_string(msg, IFLA_INFO_KIND, "vlan");
+
+	if (!(data = nla_nest_start(msg, IFLA_INFO_DATA)))
+		goto nla_put_failure;
+
+	nla_put_u16(msg, IFLA_VLAN_ID, cfg->vid);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
+	nla_put_u16(msg, IFLA_VLAN_PROTOCOL, htons(cfg->proto));
+#else
+	if(cfg->proto == VLAN_PROTO_8021AD)
+		netifd_log_message(L_WARNING, "%s Your kernel is older than linux 3.10.0, 802.1ad is not supported defaulting to 802.1q", vlandev->type->name);
+#endif
+
+	if (!(qos = nla_nest_start(msg, IFLA_VLAN_INGRESS_QOS)))
+		goto nla_put_failure;
+
+	system_vlandev_put_qos(msg, &cfg->ingress_qos_mapping_list, false);
+	nla_nest_end(msg, qos);
+
+	if (!(qos = nla_nest_start(msg, IFLA_VLAN_EGRESS_QOS)))
+		goto nla_put_failure;
+
+	system_vlandev_put_qos(msg, &cfg->egress_qos_mapping_list, false);
+	nla_nest_end(msg, qos);
+
+	nla_nest_end(msg, data);
+	nla_nest_end(msg, linkinfo);
+
+	rv = system_rtnl_call(msg);
+	if (rv)
+		D(SYSTEM, "Error adding vlandev '%s' over '%s': %d\n", vlandev->ifname, dev->ifname, rv);
+
+	return rv;
 
-int system_vlan_del(struct device *dev)
-{
-	return system_vlan(dev, -1);
+nla_put_failure:
+	nlmsg_free(msg);
+	return -ENOMEM;
 }
 
-int system_vlandev_add(struct device *vlandev, struct device *dev, struct vlandev_config *cfg)
+/*
+ * Replace the qos maps of an existing vlan link. Mappings only present in
+ * ocfg are reset to 0 first; the kernel applies the entries in order.
+ */
+int system_vlandev_change(struct device *vlandev, struct vlandev_config *cfg,
+			  struct vlandev_config *ocfg)
 {
 	struct nl_msg *msg;
 	struct nlattr *linkinfo, *data, *qos;
 	struct ifinfomsg iim = { .ifi_family = AF_UNSPEC };
-	struct vlan_qos_mapping *elem;
-	struct ifla_vlan_qos_mapping nl_qos_map;
 	int rv;
 
-	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL);
-
+	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST);
 	if (!msg)
 		return -1;
 
 	nlmsg_append(msg, &iim, sizeof(iim), 0);
 	nla_put_string(msg, IFLA_IFNAME, vlandev->ifname);
-	nla_put_u32(msg, IFLA_LINK, dev->ifindex);
 
 	if (!(linkinfo = nla_nest_start(msg, IFLA_LINKINFO)))
 		goto nla_put_failure;
@@ -1485,33 +2786,18 @@ int system_vlandev_add(struct device *vlandev, struct device *dev, struct vlande
 	if (!(data = nla_nest_start(msg, IFLA_INFO_DATA)))
 		goto nla_put_failure;
 
-	nla_put_u16(msg, IFLA_VLAN_ID, cfg->vid);
-
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
-	nla_put_u16(msg, IFLA_VLAN_PROTOCOL, htons(cfg->proto));
-#else
-	if(cfg->proto == VLAN_PROTO_8021AD)
-		netifd_log_message(L_WARNING, "%s Your kernel is older than linux 3.10.0, 802.1ad is not supported defaulting to 802.1q", vlandev->type->name);
-#endif
-
 	if (!(qos = nla_nest_start(msg, IFLA_VLAN_INGRESS_QOS)))
 		goto nla_put_failure;
 
-	vlist_simple_for_each_element(&cfg->ingress_qos_mapping_list, elem, node) {
-		nl_qos_map.from = elem->from;
-		nl_qos_map.to = elem->to;
-		nla_put(msg, IFLA_VLAN_QOS_MAPPING, sizeof(nl_qos_map), &nl_qos_map);
-	}
+	system_vlandev_put_qos(msg, &ocfg->ingress_qos_mapping_list, true);
+	system_vlandev_put_qos(msg, &cfg->ingress_qos_mapping_list, false);
 	nla_nest_end(msg, qos);
 
 	if (!(qos = nla_nest_start(msg, IFLA_VLAN_EGRESS_QOS)))
 		goto nla_put_failure;
 
-	vlist_simple_for_each_element(&cfg->egress_qos_mapping_list, elem, node) {
-		nl_qos_map.from = elem->from;
-		nl_qos_map.to = elem->to;
-		nla_put(msg, IFLA_VLAN_QOS_MAPPING, sizeof(nl_qos_map), &nl_qos_map);
-	}
+	system_vlandev_put_qos(msg, &ocfg->egress_qos_mapping_list, true);
+	system_vlandev_put_qos(msg, &cfg->egress_qos_mapping_list, false);
 	nla_nest_end(msg, qos);
 
 	nla_nest_end(msg, data);
@@ -1519,7 +2805,7 @@ int system_vlandev_add(struct device *vlandev, struct device *dev, struct vlande
 
 	rv = system_rtnl_call(msg);
 	if (rv)
-		D(SYSTEM, "Error adding vlandev '%s' over '%s': %d\n", vlandev->ifname, dev->ifname, rv);
+		D(SYSTEM, "Error changing vlandev '%s': %d\n", vlandev->ifname, rv);
 
 	return rv;
 
@@ -1628,6 +2914,318 @@ system_if_get_settings(struct device *dev, struct device_settings *s)
 		s->sendredirects = strtoul(buf, NULL, 0);
 		s->flags |= DEV_OPT_SENDREDIRECTS;
 	}
+
+	/* masks are saved for every queue and irq and restored to each of them */
+	free(s->rps_cpus);
+	if ((s->rps_cpus = system_get_queue_cpumasks(dev, "rx", "rps_cpus")))
+		s->flags |= DEV_OPT_RPS_CPUS;
+
+	free(s->xps_cpus);
+	if ((s->xps_cpus = system_get_queue_cpumasks(dev, "tx", "xps_cpus")))
+		s->flags |= DEV_OPT_XPS_CPUS;
+
+	if (!system_get_queue_sysctl(dev, "rx-0", "rps_flow_cnt", buf, sizeof(buf))) {
+		s->rps_flow_cnt = strtoul(buf, NULL, 0);
+		s->flags |= DEV_OPT_RPS_FLOW_CNT;
+	}
+
+	free(s->irq_affinity);
+	if ((s->irq_affinity = system_if_get_irq_affinity(dev)))
+		s->flags |= DEV_OPT_IRQ_AFFINITY;
+
+	system_ethtool_get_settings(dev, s);
+
+	/* the original qdisc is restored by deleting the configured one */
+	memset(&s->qdisc, 0, sizeof(s->qdisc));
+	s->qdisc.ecn = -1;
+	s->flags |= DEV_OPT_QDISC;
+
+	/*
+	 * only programs attached by netifd are detached again, so there is
+	 * nothing to restore unless one is attached or about to be
+	 */
+	memset(&s->bpf, 0, sizeof(s->bpf));
+	if (dev->bpf_attached || (dev->settings.flags & DEV_OPT_BPF))
+		s->flags |= DEV_OPT_BPF;
+}
+
+static void system_qdisc_put_options(struct nl_msg *msg, const char *kind,
+				     struct device_qdisc *q)
+{
+	struct nlattr *opts;
+
+	if (!(opts = nla_nest_start(msg, TCA_OPTIONS)))
+		return;
+
+	if (!strcmp(kind, "fq_codel")) {
+		if (q->limit)
+			nla_put_u32(msg, TCA_FQ_CODEL_LIMIT, q->limit);
+		if (q->target)
+			nla_put_u32(msg, TCA_FQ_CODEL_TARGET, q->target);
+		if (q->interval)
+			nla_put_u32(msg, TCA_FQ_CODEL_INTERVAL, q->interval);
+		if (q->ecn >= 0)
+			nla_put_u32(msg, TCA_FQ_CODEL_ECN, q->ecn);
+#ifdef TCA_CAKE_MAX
+	} else if (!strcmp(kind, "cake")) {
+		if (q->bandwidth)
+			nla_put_u64(msg, TCA_CAKE_BASE_RATE64, (uint64_t) q->bandwidth * 1000 / 8);
+		if (q->target)
+			nla_put_u32(msg, TCA_CAKE_TARGET, q->target);
+		if (q->interval)
+			nla_put_u32(msg, TCA_CAKE_RTT, q->interval);
+		if (q->memory)
+			nla_put_u32(msg, TCA_CAKE_MEMORY, q->memory);
+#endif
+	}
+
+	nla_nest_end(msg, opts);
+}
+
+static int system_qdisc_msg(int cmd, int flags, int ifindex, __u32 parent, __u32 handle,
+			    const char *kind, struct device_qdisc *q)
+{
+	struct tcmsg tcm = {
+		.tcm_family = AF_UNSPEC,
+		.tcm_ifindex = ifindex,
+		.tcm_parent = parent,
+		.tcm_handle = handle,
+	};
+	struct nl_msg *msg;
+
+	msg = nlmsg_alloc_simple(cmd, NLM_F_REQUEST | flags);
+	if (!msg)
+		return -1;
+
+	nlmsg_append(msg, &tcm, sizeof(tcm), 0);
+	if (kind) {
+		nla_put_string(msg, TCA_KIND, kind);
+		if (q)
+			system_qdisc_put_options(msg, kind, q);
+	}
+
+	return system_rtnl_call(msg);
+}
+
+/*
+ * Replace the root qdisc. Replacing an identical qdisc is cheap, so a reload
+ * only changes what actually differs. For mq, every tx queue gets its own
+ * leaf qdisc.
+ */
+static void system_if_set_qdisc(struct device *dev, struct device_qdisc *q)
+{
+	int ifindex = system_if_resolve(dev);
+	char path[PATH_MAX];
+	glob_t g;
+	int i, ret;
+
+	if (!ifindex)
+		return;
+
+	if (!q->kind[0]) {
+		system_qdisc_msg(RTM_DELQDISC, 0, ifindex, TC_H_ROOT, 0, NULL, NULL);
+		return;
+	}
+
+	if (strcmp(q->kind, "mq") != 0) {
+		ret = system_qdisc_msg(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_REPLACE, ifindex,
+				       TC_H_ROOT, 0, q->kind, q);
+		if (ret)
+			D(SYSTEM, "Failed to set qdisc %s on '%s': %d\n", q->kind, dev->ifname, ret);
+		return;
+	}
+
+	ret = system_qdisc_msg(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_REPLACE, ifindex,
+			       TC_H_ROOT, TC_H_MAKE(1 << 16, 0), "mq", NULL);
+	if (ret) {
+		D(SYSTEM, "Failed to set qdisc mq on '%s': %d\n", dev->ifname, ret);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/queues/tx-*", dev->ifname);
+	if (glob(path, 0, NULL, &g))
+		return;
+
+	for (i = 0; i < g.gl_pathc; i++) {
+		ret = system_qdisc_msg(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_REPLACE, ifindex,
+				       TC_H_MAKE(1 << 16, i + 1), 0, q->child, q);
+		if (ret)
+			D(SYSTEM, "Failed to set qdisc %s on '%s' queue %d: %d\n",
+			  q->child, dev->ifname, i, ret);
+	}
+
+	globfree(&g);
+}
+
+/* tc filter priority used for the programs attached by netifd */
+#define SYSTEM_TC_BPF_PRIO	1
+
+static int system_bpf_obj_get(const char *path)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.pathname = (uintptr_t) path;
+
+	return syscall(__NR_bpf, BPF_OBJ_GET, &attr, sizeof(attr));
+}
+
+static int system_if_xdp_msg(int ifindex, int fd, bool generic)
+{
+	struct ifinfomsg iim = {
+		.ifi_family = AF_UNSPEC,
+		.ifi_index = ifindex,
+	};
+	struct nlattr *xdp;
+	struct nl_msg *msg;
+
+	msg = nlmsg_alloc_simple(RTM_SETLINK, NLM_F_REQUEST);
+	if (!msg)
+		return -1;
+
+	nlmsg_append(msg, &iim, sizeof(iim), 0);
+	if (!(xdp = nla_nest_start(msg, IFLA_XDP)))
+		goto nla_put_failure;
+
+	nla_put_u32(msg, IFLA_XDP_FD, fd);
+	nla_put_u32(msg, IFLA_XDP_FLAGS, generic ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE);
+	nla_nest_end(msg, xdp);
+
+	return system_rtnl_call(msg);
+
+nla_put_failure:
+	nlmsg_free(msg);
+	return -1;
+}
+
+static int system_if_tc_bpf_msg(int cmd, int flags, int ifindex, bool egress,
+				int fd, const char *path)
+{
+	struct tcmsg tcm = {
+		.tcm_family = AF_UNSPEC,
+		.tcm_ifindex = ifindex,
+		.tcm_parent = TC_H_MAKE(TC_H_CLSACT,
+					egress ? TC_H_MIN_EGRESS : TC_H_MIN_INGRESS),
+		.tcm_handle = 1,
+		.tcm_info = TC_H_MAKE(SYSTEM_TC_BPF_PRIO << 16, htons(ETH_P_ALL)),
+	};
+	struct nlattr *opts;
+	struct nl_msg *msg;
+	const char *name;
+
+	msg = nlmsg_alloc_simple(cmd, NLM_F_REQUEST | flags);
+	if (!msg)
+		return -1;
+
+	nlmsg_append(msg, &tcm, sizeof(tcm), 0);
+	nla_put_string(msg, TCA_KIND, "bpf");
+
+	if (fd >= 0) {
+		if (!(opts = nla_nest_start(msg, TCA_OPTIONS)))
+			goto nla_put_failure;
+
+		name = strrchr(path, '/');
+		nla_put_u32(msg, TCA_BPF_FD, fd);
+		nla_put_string(msg, TCA_BPF_NAME, name ? name + 1 : path);
+		nla_put_u32(msg, TCA_BPF_FLAGS, TCA_BPF_FLAG_ACT_DIRECT);
+		nla_nest_end(msg, opts);
+	}
+
+	return system_rtnl_call(msg);
+
+nla_put_failure:
+	nlmsg_free(msg);
+	return -1;
+}
+
+static void system_if_set_xdp(struct device *dev, int ifindex, struct device_bpf *b)
+{
+	bool generic = !!(dev->bpf_attached & DEV_BPF_XDP_GENERIC);
+	int fd, ret;
+
+	/* the kernel refuses to switch modes while a program is attached */
+	if ((dev->bpf_attached & DEV_BPF_XDP) &&
+	    (!b->xdp[0] || generic != b->xdp_generic))
+		system_if_xdp_msg(ifindex, -1, generic);
+
+	dev->bpf_attached &= ~(DEV_BPF_XDP | DEV_BPF_XDP_GENERIC);
+	if (!b->xdp[0])
+		return;
+
+	fd = system_bpf_obj_get(b->xdp);
+	if (fd < 0) {
+		netifd_log_message(L_WARNING, "Failed to open XDP program %s for '%s': %s\n",
+				   b->xdp, dev->ifname, strerror(errno));
+		return;
+	}
+
+	ret = system_if_xdp_msg(ifindex, fd, b->xdp_generic);
+	close(fd);
+
+	if (ret) {
+		netifd_log_message(L_WARNING, "Failed to attach XDP program %s to '%s': %d\n",
+				   b->xdp, dev->ifname, ret);
+		return;
+	}
+
+	dev->bpf_attached |= DEV_BPF_XDP;
+	if (b->xdp_generic)
+		dev->bpf_attached |= DEV_BPF_XDP_GENERIC;
+}
+
+static void system_if_set_tc_bpf(struct device *dev, int ifindex, bool egress,
+				 const char *path)
+{
+	unsigned int attached = egress ? DEV_BPF_TC_EGRESS : DEV_BPF_TC_INGRESS;
+	int fd, ret;
+
+	if (!path[0]) {
+		if (dev->bpf_attached & attached)
+			system_if_tc_bpf_msg(RTM_DELTFILTER, 0, ifindex, egress, -1, NULL);
+		dev->bpf_attached &= ~attached;
+		return;
+	}
+
+	/* clsact carries no options, so an existing instance is left alone */
+	system_qdisc_msg(RTM_NEWQDISC, NLM_F_CREATE, ifindex, TC_H_CLSACT,
+			 TC_H_MAKE(TC_H_CLSACT, 0), "clsact", NULL);
+
+	fd = system_bpf_obj_get(path);
+	if (fd < 0) {
+		netifd_log_message(L_WARNING, "Failed to open tc program %s for '%s': %s\n",
+				   path, dev->ifname, strerror(errno));
+		dev->bpf_attached &= ~attached;
+		return;
+	}
+
+	ret = system_if_tc_bpf_msg(RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_REPLACE,
+				   ifindex, egress, fd, path);
+	close(fd);
+
+	if (ret) {
+		netifd_log_message(L_WARNING, "Failed to attach tc program %s to '%s': %d\n",
+				   path, dev->ifname, ret);
+		dev->bpf_attached &= ~attached;
+		return;
+	}
+
+	dev->bpf_attached |= attached;
+}
+
+/*
+ * Attach the configured programs. This runs on every bring-up, so a device
+ * that was re-created gets its programs back without outside help.
+ */
+static void system_if_set_bpf(struct device *dev, struct device_bpf *b)
+{
+	int ifindex = system_if_resolve(dev);
+
+	if (!ifindex)
+		return;
+
+	system_if_set_xdp(dev, ifindex, b);
+	system_if_set_tc_bpf(dev, ifindex, false, b->tc_ingress);
+	system_if_set_tc_bpf(dev, ifindex, true, b->tc_egress);
 }
 
 void
@@ -1705,6 +3303,20 @@ system_if_apply_settings(struct device *dev, struct device_settings *s, unsigned
 	}
 	if (s->flags & DEV_OPT_SENDREDIRECTS & apply_mask)
 		system_set_sendredirects(dev, s->sendredirects ? "1" : "0");
+	if (s->flags & DEV_OPT_RPS_CPUS & apply_mask)
+		system_if_set_queue_attr(dev, "rx", "rps_cpus", s->rps_cpus);
+	if (s->flags & DEV_OPT_XPS_CPUS & apply_mask)
+		system_if_set_queue_attr(dev, "tx", "xps_cpus", s->xps_cpus);
+	if (s->flags & DEV_OPT_RPS_FLOW_CNT & apply_mask)
+		system_if_set_rps_flow_cnt(dev, s->rps_flow_cnt);
+	if (s->flags & DEV_OPT_IRQ_AFFINITY & apply_mask)
+		system_if_set_irq_affinity(dev, s->irq_affinity);
+	if (s->flags & DEV_OPT_ETHTOOL & apply_mask)
+		system_ethtool_apply_settings(dev, s);
+	if (s->flags & DEV_OPT_QDISC & apply_mask)
+		system_if_set_qdisc(dev, &s->qdisc);
+	if (s->flags & DEV_OPT_BPF & apply_mask)
+		system_if_set_bpf(dev, &s->bpf);
 }
 
 int system_if_up(struct device *dev)
@@ -1713,6 +3325,7 @@ int system_if_up(struct device *dev)
 	/* Only keep orig settings based on what needs to be set */
 	dev->orig_settings.valid_flags = dev->orig_settings.flags;
 	dev->orig_settings.flags &= dev->settings.flags;
+	dev->orig_settings.ethtool_flags &= dev->settings.ethtool_flags;
 	system_if_apply_settings(dev, &dev->settings, dev->settings.flags);
 	return system_if_flags(dev->ifname, IFF_UP, 0);
 }
@@ -2016,21 +3629,18 @@ static int system_addr(struct device *dev, struct device_addr *addr, int cmd)
 		.ifa_index = dev->ifindex,
 	};
 
-	struct nl_msg *msg;
+	struct nlbuf *b = &rtnl_buf;
+
 	if (cmd == RTM_NEWADDR)
 		flags |= NLM_F_CREATE | NLM_F_REPLACE;
 
-	msg = nlmsg_alloc_simple(cmd, flags);
-	if (!msg)
-		return -1;
-
-	nlmsg_append(msg, &ifa, sizeof(ifa), 0);
-	nla_put(msg, IFA_LOCAL, alen, &addr->addr);
+	nlbuf_msg(b, cmd, flags, &ifa, sizeof(ifa));
+	nlbuf_put(b, IFA_LOCAL, &addr->addr, alen);
 	if (v4) {
 		if (addr->broadcast)
-			nla_put_u32(msg, IFA_BROADCAST, addr->broadcast);
+			nlbuf_put_u32(b, IFA_BROADCAST, addr->broadcast);
 		if (addr->point_to_point)
-			nla_put_u32(msg, IFA_ADDRESS, addr->point_to_point);
+			nlbuf_put_u32(b, IFA_ADDRESS, addr->point_to_point);
 	} else {
 		time_t now = system_get_rtime();
 		struct ifa_cacheinfo cinfo = {0xffffffffU, 0xffffffffU, 0, 0};
@@ -2048,7 +3658,7 @@ static int system_addr(struct device *dev, struct device_addr *addr, int cmd)
 		if (addr->valid_until) {
 			int64_t valid = addr->valid_until - now;
 			if (valid <= 0) {
-				nlmsg_free(msg);
+				nlbuf_cancel_msg(b);
 				return -1;
 			}
 			else if (valid > UINT32_MAX)
@@ -2057,13 +3667,13 @@ static int system_addr(struct device *dev, struct device_addr *addr, int cmd)
 			cinfo.ifa_valid = valid;
 		}
 
-		nla_put(msg, IFA_CACHEINFO, sizeof(cinfo), &cinfo);
+		nlbuf_put(b, IFA_CACHEINFO, &cinfo, sizeof(cinfo));
 
 		if (cmd == RTM_NEWADDR && (addr->flags & DEVADDR_OFFLINK))
-			nla_put_u32(msg, IFA_FLAGS, IFA_F_NOPREFIXROUTE);
+			nlbuf_put_u32(b, IFA_FLAGS, IFA_F_NOPREFIXROUTE);
 	}
 
-	return system_rtnl_call(msg);
+	return nlbuf_send(b, NULL);
 }
 
 int system_add_address(struct device *dev, struct device_addr *addr)
@@ -2086,24 +3696,17 @@ static int system_neigh(struct device *dev, struct device_neighbor *neighbor, in
 		.ndm_state = NUD_PERMANENT,
 		.ndm_flags = (neighbor->proxy ? NTF_PROXY : 0) | (neighbor->router ? NTF_ROUTER : 0),
 	};
-	struct nl_msg *msg;
+	struct nlbuf *b = &rtnl_buf;
 
 	if (cmd == RTM_NEWNEIGH)
 		flags |= NLM_F_CREATE | NLM_F_REPLACE;
 
-	msg = nlmsg_alloc_simple(cmd, flags);
-
-	if (!msg)
-		return -1;
-
-	nlmsg_append(msg, &ndm, sizeof(ndm), 0);
-
-	nla_put(msg, NDA_DST, alen, &neighbor->addr);
+	nlbuf_msg(b, cmd, flags, &ndm, sizeof(ndm));
+	nlbuf_put(b, NDA_DST, &neighbor->addr, alen);
 	if (neighbor->flags & DEVNEIGH_MAC)
-		nla_put(msg, NDA_LLADDR, sizeof(neighbor->macaddr), &neighbor->macaddr);
-
+		nlbuf_put(b, NDA_LLADDR, &neighbor->macaddr, sizeof(neighbor->macaddr));
 
-	return system_rtnl_call(msg);
+	return nlbuf_send(b, NULL);
 }
 
 int system_add_neighbor(struct device *dev, struct device_neighbor *neighbor)
@@ -2116,6 +3719,65 @@ int system_del_neighbor(struct device *dev, struct device_neighbor *neighbor)
 	return system_neigh(dev, neighbor, RTM_DELNEIGH);
 }
 
+/* number of fdb requests in flight before collecting their acks */
+#define VXLAN_FDB_BATCH	64
+
+static void system_vxlan_fdb_msg(struct nlbuf *b, int ifindex,
+				 const struct vxlan_fdb_entry *entry, bool add)
+{
+	struct ndmsg ndm = {
+		.ndm_family = AF_BRIDGE,
+		.ndm_ifindex = ifindex,
+		.ndm_state = NUD_NOARP | NUD_PERMANENT,
+		.ndm_flags = NTF_SELF,
+	};
+
+	if (add)
+		nlbuf_msg(b, RTM_NEWNEIGH, NLM_F_CREATE | NLM_F_APPEND, &ndm, sizeof(ndm));
+	else
+		nlbuf_msg(b, RTM_DELNEIGH, 0, &ndm, sizeof(ndm));
+
+	nlbuf_put(b, NDA_LLADDR, entry->lladdr, sizeof(entry->lladdr));
+	nlbuf_put(b, NDA_DST, &entry->dst,
+		  entry->v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr));
+}
+
+int system_vxlan_fdb_update(struct device *dev, const struct vxlan_fdb_entry *entries,
+			    int n_entries, bool add)
+{
+	int ifindex = system_if_resolve(dev);
+	int results[VXLAN_FDB_BATCH];
+	int i, j, n, err, ret = 0;
+
+	if (!ifindex)
+		return -ENODEV;
+
+	for (i = 0; i < n_entries; i += n) {
+		/* queue a batch of requests, send them at once, then collect the acks */
+		n = n_entries - i;
+		if (n > VXLAN_FDB_BATCH)
+			n = VXLAN_FDB_BATCH;
+
+		for (j = 0; j < n; j++)
+			system_vxlan_fdb_msg(&rtnl_buf, ifindex, &entries[i + j], add);
+
+		nlbuf_send(&rtnl_buf, results);
+
+		for (j = 0; j < n; j++) {
+			err = results[j];
+			if (!err || err == -NLE_EXIST || err == -NLE_OBJ_NOTFOUND)
+				continue;
+
+			D(SYSTEM, "Failed to %s fdb entry on '%s': %d\n",
+			  add ? "add" : "delete", dev->ifname, err);
+			if (!ret)
+				ret = err;
+		}
+	}
+
+	return ret;
+}
+
 static int system_rt(struct device *dev, struct device_route *route, int cmd)
 {
 	int alen = ((route->flags & DEVADDR_FAMILY) == DEVADDR_INET4) ? 4 : 16;
@@ -2143,7 +3805,7 @@ static int system_rt(struct device *dev, struct device_route *route, int cmd)
 		.rtm_type = (cmd == RTM_DELROUTE) ? 0: RTN_UNICAST,
 		.rtm_flags = (route->flags & DEVROUTE_ONLINK) ? RTNH_F_ONLINK : 0,
 	};
-	struct nl_msg *msg;
+	struct nlbuf *b = &rtnl_buf;
 
 	if (cmd == RTM_NEWROUTE) {
 		flags |= NLM_F_CREATE | NLM_F_REPLACE;
@@ -2177,50 +3839,38 @@ static int system_rt(struct device *dev, struct device_route *route, int cmd)
 		}
 	}
 
-	msg = nlmsg_alloc_simple(cmd, flags);
-	if (!msg)
-		return -1;
-
-	nlmsg_append(msg, &rtm, sizeof(rtm), 0);
+	nlbuf_msg(b, cmd, flags, &rtm, sizeof(rtm));
 
 	if (route->mask)
-		nla_put(msg, RTA_DST, alen, &route->addr);
+		nlbuf_put(b, RTA_DST, &route->addr, alen);
 
 	if (route->sourcemask) {
 		if (rtm.rtm_family == AF_INET)
-			nla_put(msg, RTA_PREFSRC, alen, &route->source);
+			nlbuf_put(b, RTA_PREFSRC, &route->source, alen);
 		else
-			nla_put(msg, RTA_SRC, alen, &route->source);
+			nlbuf_put(b, RTA_SRC, &route->source, alen);
 	}
 
 	if (route->metric > 0)
-		nla_put_u32(msg, RTA_PRIORITY, route->metric);
+		nlbuf_put_u32(b, RTA_PRIORITY, route->metric);
 
 	if (have_gw)
-		nla_put(msg, RTA_GATEWAY, alen, &route->nexthop);
+		nlbuf_put(b, RTA_GATEWAY, &route->nexthop, alen);
 
 	if (dev)
-		nla_put_u32(msg, RTA_OIF, dev->ifindex);
+		nlbuf_put_u32(b, RTA_OIF, dev->ifindex);
 
 	if (table >= 256)
-		nla_put_u32(msg, RTA_TABLE, table);
+		nlbuf_put_u32(b, RTA_TABLE, table);
 
 	if (route->flags & DEVROUTE_MTU) {
-		struct nlattr *metrics;
+		size_t metrics = nlbuf_nest_start(b, RTA_METRICS);
 
-		if (!(metrics = nla_nest_start(msg, RTA_METRICS)))
-			goto nla_put_failure;
-
-		nla_put_u32(msg, RTAX_MTU, route->mtu);
-
-		nla_nest_end(msg, metrics);
+		nlbuf_put_u32(b, RTAX_MTU, route->mtu);
+		nlbuf_nest_end(b, metrics);
 	}
 
-	return system_rtnl_call(msg);
-
-nla_put_failure:
-	nlmsg_free(msg);
-	return -ENOMEM;
+	return nlbuf_send(b, NULL);
 }
 
 int system_add_route(struct device *dev, struct device_route *route)
@@ -2370,7 +4020,7 @@ static int system_iprule(struct iprule *rule, int cmd)
 {
 	int alen = ((rule->flags & IPRULE_FAMILY) == IPRULE_INET4) ? 4 : 16;
 
-	struct nl_msg *msg;
+	struct nlbuf *b = &rtnl_buf;
 	struct rtmsg rtm = {
 		.rtm_family = (alen == 4) ? AF_INET : AF_INET6,
 		.rtm_protocol = RTPROT_STATIC,
@@ -2407,48 +4057,43 @@ static int system_iprule(struct iprule *rule, int cmd)
 	else if (!(rule->flags & (IPRULE_LOOKUP | IPRULE_ACTION | IPRULE_GOTO)))
 		rtm.rtm_type = FR_ACT_NOP;
 
-	msg = nlmsg_alloc_simple(cmd, NLM_F_REQUEST);
-
-	if (!msg)
-		return -1;
-
-	nlmsg_append(msg, &rtm, sizeof(rtm), 0);
+	nlbuf_msg(b, cmd, 0, &rtm, sizeof(rtm));
 
 	if (rule->flags & IPRULE_IN)
-		nla_put(msg, FRA_IFNAME, strlen(rule->in_dev) + 1, rule->in_dev);
+		nlbuf_put(b, FRA_IFNAME, rule->in_dev, strlen(rule->in_dev) + 1);
 
 	if (rule->flags & IPRULE_OUT)
-		nla_put(msg, FRA_OIFNAME, strlen(rule->out_dev) + 1, rule->out_dev);
+		nlbuf_put(b, FRA_OIFNAME, rule->out_dev, strlen(rule->out_dev) + 1);
 
 	if (rule->flags & IPRULE_SRC)
-		nla_put(msg, FRA_SRC, alen, &rule->src_addr);
+		nlbuf_put(b, FRA_SRC, &rule->src_addr, alen);
 
 	if (rule->flags & IPRULE_DEST)
-		nla_put(msg, FRA_DST, alen, &rule->dest_addr);
+		nlbuf_put(b, FRA_DST, &rule->dest_addr, alen);
 
 	if (rule->flags & IPRULE_PRIORITY)
-		nla_put_u32(msg, FRA_PRIORITY, rule->priority);
+		nlbuf_put_u32(b, FRA_PRIORITY, rule->priority);
 	else if (cmd == RTM_NEWRULE)
-		nla_put_u32(msg, FRA_PRIORITY, rule->order);
+		nlbuf_put_u32(b, FRA_PRIORITY, rule->order);
 
 	if (rule->flags & IPRULE_FWMARK)
-		nla_put_u32(msg, FRA_FWMARK, rule->fwmark);
+		nlbuf_put_u32(b, FRA_FWMARK, rule->fwmark);
 
 	if (rule->flags & IPRULE_FWMASK)
-		nla_put_u32(msg, FRA_FWMASK, rule->fwmask);
+		nlbuf_put_u32(b, FRA_FWMASK, rule->fwmask);
 
 	if (rule->flags & IPRULE_LOOKUP) {
 		if (rule->lookup >= 256)
-			nla_put_u32(msg, FRA_TABLE, rule->lookup);
+			nlbuf_put_u32(b, FRA_TABLE, rule->lookup);
 	}
 
 	if (rule->flags & IPRULE_SUP_PREFIXLEN)
-		nla_put_u32(msg, FRA_SUPPRESS_PREFIXLEN, rule->sup_prefixlen);
+		nlbuf_put_u32(b, FRA_SUPPRESS_PREFIXLEN, rule->sup_prefixlen);
 
 	if (rule->flags & IPRULE_GOTO)
-		nla_put_u32(msg, FRA_GOTO, rule->gotoid);
+		nlbuf_put_u32(b, FRA_GOTO, rule->gotoid);
 
-	return system_rtnl_call(msg);
+	return nlbuf_send(b, NULL);
 }
 
 int system_add_iprule(struct iprule *rule)
@@ -3090,7 +4735,8 @@ static void system_vxlan_map_bool_attr(struct nl_msg *msg, struct blob_attr **tb
 	}
 }
 
-static int system_add_vxlan(const char *name, const unsigned int link, struct blob_attr **tb, bool v6)
+static int system_add_vxlan(const char *name, const unsigned int link, struct blob_attr **tb,
+			    bool v6, bool change)
 {
 	struct blob_attr *tb_data[__VXLAN_DATA_ATTR_MAX];
 	struct nl_msg *msg;
@@ -3105,7 +4751,8 @@ static int system_add_vxlan(const char *name, const unsigned int link, struct bl
 	else
 		return -EINVAL;
 
-	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL);
+	msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_REQUEST |
+				  (change ? 0 : NLM_F_CREATE | NLM_F_EXCL));
 
 	if (!msg)
 		return -1;
@@ -3456,17 +5103,15 @@ out:
 	return ret;
 }
 
-int system_add_ip_tunnel(const char *name, struct blob_attr *attr)
+/*
+ * with change set, the netlink based tunnel types are updated in place and
+ * the ioctl based ones (sit, ipip) are refused
+ */
+static int __system_add_ip_tunnel(const char *name, struct blob_attr **tb, bool change)
 {
-	struct blob_attr *tb[__TUNNEL_ATTR_MAX];
 	struct blob_attr *cur;
 	const char *str;
 
-	blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, tb,
-		blob_data(attr), blob_len(attr));
-
-	__system_del_ip_tunnel(name, tb);
-
 	if (!(cur = tb[TUNNEL_ATTR_TYPE]))
 		return -EINVAL;
 	str = blobmsg_data(cur);
@@ -3488,6 +5133,9 @@ int system_add_ip_tunnel(const char *name, struct blob_attr *attr)
 			link = iface->l3_dev.dev->ifindex;
 	}
 
+	if (change && (!strcmp(str, "sit") || !strcmp(str, "ipip")))
+		return -EOPNOTSUPP;
+
 	if (!strcmp(str, "sit"))
 		return system_add_sit_tunnel(name, link, tb);
 #ifdef IFLA_IPTUN_MAX
@@ -3513,9 +5161,9 @@ int system_add_ip_tunnel(const char *name, struct blob_attr *attr)
 #endif
 #ifdef IFLA_VXLAN_MAX
 	} else if(!strcmp(str, "vxlan")) {
-		return system_add_vxlan(name, link, tb, false);
+		return system_add_vxlan(name, link, tb, false, change);
 	} else if(!strcmp(str, "vxlan6")) {
-		return system_add_vxlan(name, link, tb, true);
+		return system_add_vxlan(name, link, tb, true, change);
 #endif
 #endif
 	} else if (!strcmp(str, "ipip")) {
@@ -3526,3 +5174,25 @@ int system_add_ip_tunnel(const char *name, struct blob_attr *attr)
 
 	return 0;
 }
+
+int system_add_ip_tunnel(const char *name, struct blob_attr *attr)
+{
+	struct blob_attr *tb[__TUNNEL_ATTR_MAX];
+
+	blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, tb,
+		blob_data(attr), blob_len(attr));
+
+	__system_del_ip_tunnel(name, tb);
+
+	return __system_add_ip_tunnel(name, tb, false);
+}
+
+int system_change_ip_tunnel(const char *name, struct blob_attr *attr)
+{
+	struct blob_attr *tb[__TUNNEL_ATTR_MAX];
+
+	blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, tb,
+		blob_data(attr), blob_len(attr));
+
+	return __system_add_ip_tunnel(name, tb, true);
+}
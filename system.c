@@ -48,6 +48,8 @@ static const struct blobmsg_policy vxlan_data_attrs[__VXLAN_DATA_ATTR_MAX] = {
 	[VXLAN_DATA_ATTR_GBP] = { .name = "gbp", .type = BLOBMSG_TYPE_BOOL },
 	[VXLAN_DATA_ATTR_AGEING] = { .name = "ageing", .type = BLOBMSG_TYPE_INT32 },
 	[VXLAN_DATA_ATTR_LIMIT] = { .name = "maxaddress", .type = BLOBMSG_TYPE_INT32 },
+	[VXLAN_DATA_ATTR_PEERS] = { .name = "peers", .type = BLOBMSG_TYPE_ARRAY },
+	[VXLAN_DATA_ATTR_FDB] = { .name = "fdb", .type = BLOBMSG_TYPE_ARRAY },
 };
 
 const struct uci_blob_param_list vxlan_data_attr_list = {
@@ -54,6 +54,8 @@ enum vxlan_data {
 	VXLAN_DATA_ATTR_GBP,
 	VXLAN_DATA_ATTR_AGEING,
 	VXLAN_DATA_ATTR_LIMIT,
+	VXLAN_DATA_ATTR_PEERS,
+	VXLAN_DATA_ATTR_FDB,
 	__VXLAN_DATA_ATTR_MAX
 };
 
@@ -152,10 +154,17 @@ struct macvlan_config {
 	unsigned char macaddr[6];
 };
 
+struct ipvlan_config {
+	const char *mode; /* l2, l3 or l3s */
+	const char *flag; /* bridge, private or vepa */
+	const char *netns; /* pid or netns path */
+};
+
 enum veth_opt {
 	VETH_OPT_MACADDR = (1 << 0),
 	VETH_OPT_PEER_NAME = (1 << 1),
 	VETH_OPT_PEER_MACADDR = (1 << 2),
+	VETH_OPT_PEER_NETNS = (1 << 3),
 };
 
 struct veth_config {
@@ -164,6 +173,13 @@ struct veth_config {
 	unsigned char macaddr[6];
 	char peer_name[IFNAMSIZ];
 	unsigned char peer_macaddr[6];
+	const char *peer_netns; /* pid or netns path */
+};
+
+struct vxlan_fdb_entry {
+	unsigned char lladdr[6];
+	bool v6;
+	union if_addr dst;
 };
 
 enum vlan_proto {
@@ -204,21 +220,32 @@ int system_init(void);
 
 int system_bridge_addbr(struct device *bridge, struct bridge_config *cfg);
 int system_bridge_delbr(struct device *bridge);
+int system_bridge_set_config(struct device *bridge, struct bridge_config *cfg);
 int system_bridge_addif(struct device *bridge, struct device *dev);
+int system_bridge_addif_batch(struct device *bridge, struct device **devs,
+			      int *results, int n);
 int system_bridge_delif(struct device *bridge, struct device *dev);
 int system_bridge_vlan(const char *iface, uint16_t vid, bool add, unsigned int vflags);
 
 int system_macvlan_add(struct device *macvlan, struct device *dev, struct macvlan_config *cfg);
 int system_macvlan_del(struct device *macvlan);
+int system_macvlan_change(struct device *macvlan, struct macvlan_config *cfg);
 
 int system_veth_add(struct device *veth, struct veth_config *cfg);
+/* results[i] is 0 or a negative errno value */
+int system_veth_add_batch(const char **ifnames, struct veth_config *cfgs, int *results, int n);
 int system_veth_del(struct device *veth);
 
+int system_ipvlan_add(struct device *ipvlan, struct device *dev, struct ipvlan_config *cfg);
+int system_ipvlan_del(struct device *ipvlan, const char *netns);
+
 int system_vlan_add(struct device *dev, int id);
 int system_vlan_del(struct device *dev);
 
 int system_vlandev_add(struct device *vlandev, struct device *dev, struct vlandev_config *cfg);
 int system_vlandev_del(struct device *vlandev);
+int system_vlandev_change(struct device *vlandev, struct vlandev_config *cfg,
+			  struct vlandev_config *ocfg);
 
 void system_if_get_settings(struct device *dev, struct device_settings *s);
 void system_if_clear_state(struct device *dev);
@@ -252,6 +279,11 @@ bool system_resolve_rpfilter(const char *filter, unsigned int *id);
 
 int system_del_ip_tunnel(const char *name, struct blob_attr *attr);
 int system_add_ip_tunnel(const char *name, struct blob_attr *attr);
+int system_change_ip_tunnel(const char *name, struct blob_attr *attr);
+int system_bridge_fdb_update(struct device *bridge, const struct bridge_fdb_entry *entries,
+			     int n_entries, bool add);
+int system_vxlan_fdb_update(struct device *dev, const struct vxlan_fdb_entry *entries,
+			    int n_entries, bool add);
 
 int system_add_iprule(struct iprule *rule);
 int system_del_iprule(struct iprule *rule);
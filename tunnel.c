@@ -11,16 +11,307 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
  */
+#include <netinet/ether.h>
+
 #include "netifd.h"
 #include "device.h"
 #include "config.h"
 #include "system.h"
 
+struct tunnel_fdb {
+	struct vlist_node node;
+	struct vxlan_fdb_entry entry;
+};
+
+struct tunnel_fdb_queue {
+	struct vxlan_fdb_entry *entries;
+	int n_entries;
+	int size;
+};
+
 struct tunnel {
 	struct device dev;
 	device_state_cb set_state;
+
+	/* vxlan forwarding entries from the config and added via ubus */
+	struct vlist_tree fdb;
+	struct vlist_tree fdb_dynamic;
+
+	/* changes collected during a vlist flush, sent as one batch */
+	struct tunnel_fdb_queue fdb_add;
+	struct tunnel_fdb_queue fdb_del;
+	bool fdb_active;
 };
 
+static bool
+tunnel_is_vxlan(struct blob_attr *config)
+{
+	struct blob_attr *tb[__TUNNEL_ATTR_MAX];
+	const char *mode;
+
+	if (!config)
+		return false;
+
+	blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, tb,
+		blob_data(config), blob_len(config));
+
+	if (!tb[TUNNEL_ATTR_TYPE])
+		return false;
+
+	mode = blobmsg_data(tb[TUNNEL_ATTR_TYPE]);
+	return !strcmp(mode, "vxlan") || !strcmp(mode, "vxlan6");
+}
+
+static void
+tunnel_fdb_queue_add(struct tunnel_fdb_queue *q, const struct vxlan_fdb_entry *entry)
+{
+	if (q->n_entries == q->size) {
+		struct vxlan_fdb_entry *entries;
+		int size = q->size ? q->size * 2 : 16;
+
+		entries = realloc(q->entries, size * sizeof(*entries));
+		if (!entries)
+			return;
+
+		q->entries = entries;
+		q->size = size;
+	}
+
+	q->entries[q->n_entries++] = *entry;
+}
+
+static void
+tunnel_fdb_queue_free(struct tunnel_fdb_queue *q)
+{
+	free(q->entries);
+	memset(q, 0, sizeof(*q));
+}
+
+static void
+tunnel_fdb_sync(struct tunnel *tun)
+{
+	if (tun->fdb_active) {
+		if (tun->fdb_del.n_entries)
+			system_vxlan_fdb_update(&tun->dev, tun->fdb_del.entries,
+						tun->fdb_del.n_entries, false);
+		if (tun->fdb_add.n_entries)
+			system_vxlan_fdb_update(&tun->dev, tun->fdb_add.entries,
+						tun->fdb_add.n_entries, true);
+	}
+
+	tun->fdb_del.n_entries = 0;
+	tun->fdb_add.n_entries = 0;
+}
+
+static void
+tunnel_fdb_update(struct tunnel *tun, struct vlist_tree *other,
+		  struct vlist_node *node_new, struct vlist_node *node_old)
+{
+	struct tunnel_fdb *fdb, *dup;
+
+	if (node_new && node_old) {
+		free(container_of(node_new, struct tunnel_fdb, node));
+		return;
+	}
+
+	fdb = container_of(node_new ? node_new : node_old, struct tunnel_fdb, node);
+
+	/* entries present in both trees stay in the kernel until both drop them */
+	if (!vlist_find(other, &fdb->entry, dup, node)) {
+		if (node_new)
+			tunnel_fdb_queue_add(&tun->fdb_add, &fdb->entry);
+		else
+			tunnel_fdb_queue_add(&tun->fdb_del, &fdb->entry);
+	}
+
+	if (node_old)
+		free(fdb);
+}
+
+static void
+tunnel_fdb_config_update(struct vlist_tree *tree, struct vlist_node *node_new,
+			 struct vlist_node *node_old)
+{
+	struct tunnel *tun = container_of(tree, struct tunnel, fdb);
+
+	tunnel_fdb_update(tun, &tun->fdb_dynamic, node_new, node_old);
+}
+
+static void
+tunnel_fdb_dynamic_update(struct vlist_tree *tree, struct vlist_node *node_new,
+			  struct vlist_node *node_old)
+{
+	struct tunnel *tun = container_of(tree, struct tunnel, fdb_dynamic);
+
+	tunnel_fdb_update(tun, &tun->fdb, node_new, node_old);
+}
+
+static int
+tunnel_fdb_cmp(const void *k1, const void *k2, void *ptr)
+{
+	return memcmp(k1, k2, sizeof(struct vxlan_fdb_entry));
+}
+
+static bool
+tunnel_fdb_parse_addr(struct vxlan_fdb_entry *entry, const char *str)
+{
+	if (inet_pton(AF_INET, str, &entry->dst.in) == 1)
+		return true;
+
+	if (inet_pton(AF_INET6, str, &entry->dst.in6) == 1) {
+		entry->v6 = true;
+		return true;
+	}
+
+	return false;
+}
+
+static void
+tunnel_fdb_add(struct vlist_tree *tree, const struct vxlan_fdb_entry *entry)
+{
+	struct tunnel_fdb *fdb;
+
+	fdb = calloc(1, sizeof(*fdb));
+	if (!fdb)
+		return;
+
+	fdb->entry = *entry;
+	vlist_add(tree, &fdb->node, &fdb->entry);
+}
+
+static void
+tunnel_fdb_del(struct vlist_tree *tree, const struct vxlan_fdb_entry *entry)
+{
+	struct tunnel_fdb *fdb;
+
+	fdb = vlist_find(tree, entry, fdb, node);
+	if (fdb)
+		vlist_delete(tree, &fdb->node);
+}
+
+/*
+ * peers: list of remote VTEP addresses, added to the all-zeros flood entry
+ * fdb: list of "<macaddr> <address>" static forwarding entries
+ */
+static int
+tunnel_fdb_apply_list(struct vlist_tree *tree, struct blob_attr *peers,
+		      struct blob_attr *fdb, bool add)
+{
+	struct vxlan_fdb_entry entry;
+	struct blob_attr *cur;
+	int rem, ret = 0;
+
+	blobmsg_for_each_attr(cur, peers, rem) {
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING)
+			continue;
+
+		memset(&entry, 0, sizeof(entry));
+		if (!tunnel_fdb_parse_addr(&entry, blobmsg_data(cur))) {
+			ret = -EINVAL;
+			continue;
+		}
+
+		if (add)
+			tunnel_fdb_add(tree, &entry);
+		else
+			tunnel_fdb_del(tree, &entry);
+	}
+
+	blobmsg_for_each_attr(cur, fdb, rem) {
+		struct ether_addr *ea;
+		char *str, *sep;
+
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING)
+			continue;
+
+		str = strdup(blobmsg_data(cur));
+		if (!str)
+			continue;
+
+		memset(&entry, 0, sizeof(entry));
+		sep = strchr(str, ' ');
+		if (sep)
+			*sep++ = 0;
+
+		ea = ether_aton(str);
+		if (!ea || !sep || !tunnel_fdb_parse_addr(&entry, sep)) {
+			free(str);
+			ret = -EINVAL;
+			continue;
+		}
+
+		memcpy(entry.lladdr, ea, sizeof(entry.lladdr));
+		free(str);
+
+		if (add)
+			tunnel_fdb_add(tree, &entry);
+		else
+			tunnel_fdb_del(tree, &entry);
+	}
+
+	return ret;
+}
+
+static void
+tunnel_fdb_set_config(struct tunnel *tun, struct blob_attr *config)
+{
+	struct blob_attr *tb[__TUNNEL_ATTR_MAX];
+	struct blob_attr *tb_data[__VXLAN_DATA_ATTR_MAX];
+
+	vlist_update(&tun->fdb);
+
+	if (tunnel_is_vxlan(config)) {
+		blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, tb,
+			blob_data(config), blob_len(config));
+
+		if (tb[TUNNEL_ATTR_DATA]) {
+			blobmsg_parse(vxlan_data_attr_list.params, __VXLAN_DATA_ATTR_MAX, tb_data,
+				blobmsg_data(tb[TUNNEL_ATTR_DATA]), blobmsg_len(tb[TUNNEL_ATTR_DATA]));
+			tunnel_fdb_apply_list(&tun->fdb, tb_data[VXLAN_DATA_ATTR_PEERS],
+					      tb_data[VXLAN_DATA_ATTR_FDB], true);
+		}
+	}
+
+	vlist_flush(&tun->fdb);
+	tunnel_fdb_sync(tun);
+}
+
+static void
+tunnel_fdb_set_active(struct tunnel *tun, bool active)
+{
+	struct tunnel_fdb *fdb;
+
+	tun->fdb_active = active;
+	if (!active)
+		return;
+
+	vlist_for_each_element(&tun->fdb, fdb, node)
+		tunnel_fdb_queue_add(&tun->fdb_add, &fdb->entry);
+
+	vlist_for_each_element(&tun->fdb_dynamic, fdb, node)
+		if (!vlist_find(&tun->fdb, &fdb->entry, fdb, node))
+			tunnel_fdb_queue_add(&tun->fdb_add, &fdb->entry);
+
+	tunnel_fdb_sync(tun);
+}
+
+int
+tunnel_fdb_update_dynamic(struct device *dev, struct blob_attr *peers,
+			  struct blob_attr *fdb, bool add)
+{
+	struct tunnel *tun;
+	int ret;
+
+	if (dev->type != &tunnel_device_type || !tunnel_is_vxlan(dev->config))
+		return -ENOTSUP;
+
+	tun = container_of(dev, struct tunnel, dev);
+	ret = tunnel_fdb_apply_list(&tun->fdb_dynamic, peers, fdb, add);
+	tunnel_fdb_sync(tun);
+
+	return ret;
+}
+
 static int
 tunnel_set_state(struct device *dev, bool up)
 {
@@ -34,17 +325,131 @@ tunnel_set_state(struct device *dev, bool up)
 	}
 
 	ret = tun->set_state(dev, up);
-	if (ret || !up)
+	if (ret || !up) {
+		tunnel_fdb_set_active(tun, false);
 		system_del_ip_tunnel(dev->ifname, dev->config);
+	} else if (tunnel_is_vxlan(dev->config)) {
+		tunnel_fdb_set_active(tun, true);
+	}
 
 	return ret;
 }
 
+/* only the vxlan peers/fdb lists changed, which can be applied without a restart */
+static bool
+tunnel_fdb_only_change(struct blob_attr *old, struct blob_attr *new)
+{
+	struct blob_attr *otb[__TUNNEL_ATTR_MAX], *ntb[__TUNNEL_ATTR_MAX];
+	struct blob_attr *otb_data[__VXLAN_DATA_ATTR_MAX], *ntb_data[__VXLAN_DATA_ATTR_MAX];
+	unsigned long diff = 0;
+
+	if (!tunnel_is_vxlan(old) || !tunnel_is_vxlan(new))
+		return false;
+
+	blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, otb,
+		blob_data(old), blob_len(old));
+	blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, ntb,
+		blob_data(new), blob_len(new));
+
+	uci_blob_diff(ntb, otb, &tunnel_attr_list, &diff);
+	if (diff & ~(1 << TUNNEL_ATTR_DATA))
+		return false;
+
+	if (!otb[TUNNEL_ATTR_DATA] || !ntb[TUNNEL_ATTR_DATA])
+		return false;
+
+	blobmsg_parse(vxlan_data_attr_list.params, __VXLAN_DATA_ATTR_MAX, otb_data,
+		blobmsg_data(otb[TUNNEL_ATTR_DATA]), blobmsg_len(otb[TUNNEL_ATTR_DATA]));
+	blobmsg_parse(vxlan_data_attr_list.params, __VXLAN_DATA_ATTR_MAX, ntb_data,
+		blobmsg_data(ntb[TUNNEL_ATTR_DATA]), blobmsg_len(ntb[TUNNEL_ATTR_DATA]));
+
+	diff = 0;
+	uci_blob_diff(ntb_data, otb_data, &vxlan_data_attr_list, &diff);
+
+	return !(diff & ~((1 << VXLAN_DATA_ATTR_PEERS) | (1 << VXLAN_DATA_ATTR_FDB)));
+}
+
+static bool
+tunnel_option_removed(struct blob_attr *odata, unsigned int olen,
+		      struct blob_attr *ndata, unsigned int nlen)
+{
+	struct blob_attr *cur, *ncur;
+	unsigned int rem, nrem;
+
+	__blob_for_each_attr(cur, odata, rem) {
+		bool found = false;
+
+		nrem = nlen;
+		__blob_for_each_attr(ncur, ndata, nrem) {
+			if (!strcmp(blobmsg_name(cur), blobmsg_name(ncur))) {
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Update the tunnel parameters (ttl, tos, keys, vxlan options, ...) of the
+ * live link. Returns false if the link has to be recreated instead: the
+ * type, underlying link or device settings changed, an option was dropped
+ * and can't be reset in place, or the kernel refused the change.
+ */
+static bool
+tunnel_changelink(struct device *dev, struct blob_attr *old, struct blob_attr *new,
+		  struct blob_attr **tb_dev)
+{
+	struct blob_attr *otb[__TUNNEL_ATTR_MAX], *ntb[__TUNNEL_ATTR_MAX];
+	struct blob_attr *otb_dev[__DEV_ATTR_MAX];
+	unsigned long diff = 0;
+
+	if (!dev->active || !old || !new)
+		return false;
+
+	blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
+		blob_data(old), blob_len(old));
+	if (uci_blob_diff(tb_dev, otb_dev, &device_attr_list, NULL))
+		return false;
+
+	blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, otb,
+		blob_data(old), blob_len(old));
+	blobmsg_parse(tunnel_attr_list.params, __TUNNEL_ATTR_MAX, ntb,
+		blob_data(new), blob_len(new));
+
+	uci_blob_diff(ntb, otb, &tunnel_attr_list, &diff);
+	if (diff & ((1 << TUNNEL_ATTR_TYPE) | (1 << TUNNEL_ATTR_LINK)))
+		return false;
+
+	if (tunnel_option_removed(blob_data(old), blob_len(old),
+				  blob_data(new), blob_len(new)))
+		return false;
+
+	if (otb[TUNNEL_ATTR_DATA] &&
+	    tunnel_option_removed(blobmsg_data(otb[TUNNEL_ATTR_DATA]),
+				  blobmsg_data_len(otb[TUNNEL_ATTR_DATA]),
+				  blobmsg_data(ntb[TUNNEL_ATTR_DATA]),
+				  blobmsg_data_len(ntb[TUNNEL_ATTR_DATA])))
+		return false;
+
+	if (system_change_ip_tunnel(dev->ifname, new))
+		return false;
+
+	D(DEVICE, "Tunnel '%s': parameters changed in place\n", dev->ifname);
+	return true;
+}
+
 static enum dev_change_type
 tunnel_reload(struct device *dev, struct blob_attr *attr)
 {
+	struct tunnel *tun = container_of(dev, struct tunnel, dev);
 	struct blob_attr *tb_dev[__DEV_ATTR_MAX];
 	const struct uci_blob_param_list *cfg = dev->type->config_params;
+	enum dev_change_type ret = DEV_CONFIG_RESTART;
 
 	if (uci_blob_check_equal(dev->config, attr, cfg))
 		return DEV_CONFIG_NO_CHANGE;
@@ -52,12 +457,22 @@ tunnel_reload(struct device *dev, struct blob_attr *attr)
 	memset(tb_dev, 0, sizeof(tb_dev));
 
 	if (attr)
-		blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
+		blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
 			blob_data(attr), blob_len(attr));
 
 	device_init_settings(dev, tb_dev);
 
-	return DEV_CONFIG_RESTART;
+	if (dev->config && tunnel_fdb_only_change(dev->config, attr))
+		ret = DEV_CONFIG_APPLIED;
+	else if (tunnel_changelink(dev, dev->config, attr, tb_dev))
+		ret = DEV_CONFIG_APPLIED;
+	else
+		/* the link is recreated and fully reprogrammed on restart */
+		tunnel_fdb_set_active(tun, false);
+
+	tunnel_fdb_set_config(tun, attr);
+
+	return ret;
 }
 
 static struct device *
@@ -79,6 +494,11 @@ tunnel_create(const char *name, struct device_type *devtype,
 		return NULL;
 	}
 
+	vlist_init(&tun->fdb, tunnel_fdb_cmp, tunnel_fdb_config_update);
+	tun->fdb.keep_old = true;
+	vlist_init(&tun->fdb_dynamic, tunnel_fdb_cmp, tunnel_fdb_dynamic_update);
+	tun->fdb_dynamic.keep_old = true;
+
 	tun->set_state = dev->set_state;
 	dev->set_state = tunnel_set_state;
 	device_apply_config(dev, devtype, attr);
@@ -92,6 +512,11 @@ tunnel_free(struct device *dev)
 {
 	struct tunnel *tun = container_of(dev, struct tunnel, dev);
 
+	tun->fdb_active = false;
+	vlist_flush_all(&tun->fdb);
+	vlist_flush_all(&tun->fdb_dynamic);
+	tunnel_fdb_queue_free(&tun->fdb_add);
+	tunnel_fdb_queue_free(&tun->fdb_del);
 	free(tun);
 }
 
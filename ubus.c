@@ -23,6 +23,7 @@
 #include "ubus.h"
 #include "system.h"
 #include "wireless.h"
+#include "shard.h"
 
 struct ubus_context *ubus_ctx = NULL;
 static struct blob_buf b;
@@ -111,6 +112,17 @@ netifd_get_proto_handlers(struct ubus_context *ctx, struct ubus_object *obj,
 	return 0;
 }
 
+static int
+netifd_get_slab_stats(struct ubus_context *ctx, struct ubus_object *obj,
+		      struct ubus_request_data *req, const char *method,
+		      struct blob_attr *msg)
+{
+	blob_buf_init(&b, 0);
+	slab_dump_stats(&b);
+	ubus_send_reply(ctx, req, b.head);
+
+	return 0;
+}
 
 enum {
 	DI_NAME,
@@ -153,6 +165,7 @@ netifd_add_dynamic(struct ubus_context *ctx, struct ubus_object *obj,
 error_free_config:
 	free(config);
 error:
+	str_release(iface->name);
 	free(iface);
 	return UBUS_STATUS_UNKNOWN_ERROR;
 }
@@ -196,13 +209,53 @@ netifd_netns_updown(struct ubus_context *ctx, struct ubus_object *obj,
 	return UBUS_STATUS_OK;
 }
 
+enum {
+	SHARD_DNS_OWNER,
+	SHARD_DNS_JAIL,
+	SHARD_DNS_DATA,
+	__SHARD_DNS_MAX
+};
+
+static const struct blobmsg_policy shard_dns_policy[__SHARD_DNS_MAX] = {
+	[SHARD_DNS_OWNER] = { .name = "owner", .type = BLOBMSG_TYPE_STRING },
+	[SHARD_DNS_JAIL] = { .name = "jail", .type = BLOBMSG_TYPE_STRING },
+	[SHARD_DNS_DATA] = { .name = "dns", .type = BLOBMSG_TYPE_STRING },
+};
+
+static int
+netifd_shard_dns(struct ubus_context *ctx, struct ubus_object *obj,
+		 struct ubus_request_data *req, const char *method,
+		 struct blob_attr *msg)
+{
+	struct blob_attr *tb[__SHARD_DNS_MAX];
+	int ret;
+
+	blobmsg_parse(shard_dns_policy, __SHARD_DNS_MAX, tb, blob_data(msg), blob_len(msg));
+	if (!tb[SHARD_DNS_OWNER] || !tb[SHARD_DNS_DATA])
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	ret = shard_set_dns(blobmsg_get_string(tb[SHARD_DNS_OWNER]),
+			    tb[SHARD_DNS_JAIL] ? blobmsg_get_string(tb[SHARD_DNS_JAIL]) : NULL,
+			    blobmsg_get_string(tb[SHARD_DNS_DATA]));
+	if (ret == -ENOENT)
+		return UBUS_STATUS_NOT_FOUND;
+	else if (ret == -EINVAL)
+		return UBUS_STATUS_INVALID_ARGUMENT;
+	else if (ret)
+		return UBUS_STATUS_UNKNOWN_ERROR;
+
+	return 0;
+}
+
 static struct ubus_method main_object_methods[] = {
 	{ .name = "restart", .handler = netifd_handle_restart },
 	{ .name = "reload", .handler = netifd_handle_reload },
 	UBUS_METHOD("add_host_route", netifd_add_host_route, route_policy),
 	{ .name = "get_proto_handlers", .handler = netifd_get_proto_handlers },
+	{ .name = "get_slab_stats", .handler = netifd_get_slab_stats },
 	UBUS_METHOD("add_dynamic", netifd_add_dynamic, dynamic_policy),
 	UBUS_METHOD("netns_updown", netifd_netns_updown, netns_updown_policy),
+	UBUS_METHOD("shard_dns", netifd_shard_dns, shard_dns_policy),
 };
 
 static struct ubus_object_type main_object_type =
@@ -332,10 +385,127 @@ netifd_handle_set_state(struct ubus_context *ctx, struct ubus_object *obj,
 	return 0;
 }
 
+enum {
+	DEV_FDB_NAME,
+	DEV_FDB_PEERS,
+	DEV_FDB_FDB,
+	__DEV_FDB_MAX,
+};
+
+static const struct blobmsg_policy dev_fdb_policy[__DEV_FDB_MAX] = {
+	[DEV_FDB_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+	[DEV_FDB_PEERS] = { .name = "peers", .type = BLOBMSG_TYPE_ARRAY },
+	[DEV_FDB_FDB] = { .name = "fdb", .type = BLOBMSG_TYPE_ARRAY },
+};
+
+static int
+netifd_handle_fdb(struct ubus_context *ctx, struct ubus_object *obj,
+		  struct ubus_request_data *req, const char *method,
+		  struct blob_attr *msg)
+{
+	struct blob_attr *tb[__DEV_FDB_MAX];
+	struct device *dev;
+	bool add = !strncmp(method, "add", 3);
+	int ret;
+
+	blobmsg_parse(dev_fdb_policy, __DEV_FDB_MAX, tb, blob_data(msg), blob_len(msg));
+
+	if (!tb[DEV_FDB_NAME] || (!tb[DEV_FDB_PEERS] && !tb[DEV_FDB_FDB]))
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	dev = device_find(blobmsg_data(tb[DEV_FDB_NAME]));
+	if (!dev)
+		return UBUS_STATUS_NOT_FOUND;
+
+	ret = tunnel_fdb_update_dynamic(dev, tb[DEV_FDB_PEERS], tb[DEV_FDB_FDB], add);
+	if (ret == -ENOTSUP)
+		return UBUS_STATUS_NOT_SUPPORTED;
+	else if (ret)
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	return 0;
+}
+
+enum {
+	DEV_VETH_LIST,
+	__DEV_VETH_MAX,
+};
+
+static const struct blobmsg_policy dev_veth_policy[__DEV_VETH_MAX] = {
+	[DEV_VETH_LIST] = { .name = "veths", .type = BLOBMSG_TYPE_ARRAY },
+};
+
+static int
+netifd_handle_add_veths(struct ubus_context *ctx, struct ubus_object *obj,
+			struct ubus_request_data *req, const char *method,
+			struct blob_attr *msg)
+{
+	struct blob_attr *tb[__DEV_VETH_MAX];
+	int ret;
+
+	blobmsg_parse(dev_veth_policy, __DEV_VETH_MAX, tb, blob_data(msg), blob_len(msg));
+
+	if (!tb[DEV_VETH_LIST])
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	blob_buf_init(&b, 0);
+	ret = veth_add_batch(tb[DEV_VETH_LIST], &b);
+	if (ret == -EINVAL)
+		return UBUS_STATUS_INVALID_ARGUMENT;
+	else if (ret == -ENOMEM)
+		return UBUS_STATUS_UNKNOWN_ERROR;
+
+	ubus_send_reply(ctx, req, b.head);
+
+	return 0;
+}
+
+enum {
+	DEV_CLAIM_NAME,
+	DEV_CLAIM_OWNER,
+	__DEV_CLAIM_MAX,
+};
+
+static const struct blobmsg_policy dev_claim_policy[__DEV_CLAIM_MAX] = {
+	[DEV_CLAIM_NAME] = { .name = "name", .type = BLOBMSG_TYPE_STRING },
+	[DEV_CLAIM_OWNER] = { .name = "owner", .type = BLOBMSG_TYPE_STRING },
+};
+
+static int
+netifd_handle_claim(struct ubus_context *ctx, struct ubus_object *obj,
+		    struct ubus_request_data *req, const char *method,
+		    struct blob_attr *msg)
+{
+	struct blob_attr *tb[__DEV_CLAIM_MAX];
+	int ret;
+
+	blobmsg_parse(dev_claim_policy, __DEV_CLAIM_MAX, tb, blob_data(msg), blob_len(msg));
+
+	if (!tb[DEV_CLAIM_NAME] || !tb[DEV_CLAIM_OWNER])
+		return UBUS_STATUS_INVALID_ARGUMENT;
+
+	ret = shard_claim(blobmsg_get_string(tb[DEV_CLAIM_OWNER]),
+			  blobmsg_get_string(tb[DEV_CLAIM_NAME]),
+			  !strcmp(method, "claim"));
+	if (ret == -ENODEV || ret == -ENOENT)
+		return UBUS_STATUS_NOT_FOUND;
+	else if (ret == -EINVAL)
+		return UBUS_STATUS_INVALID_ARGUMENT;
+	else if (ret)
+		return UBUS_STATUS_UNKNOWN_ERROR;
+
+	return 0;
+}
+
 static struct ubus_method dev_object_methods[] = {
 	UBUS_METHOD("status", netifd_dev_status, dev_policy),
 	UBUS_METHOD("set_alias", netifd_handle_alias, alias_attrs),
 	UBUS_METHOD("set_state", netifd_handle_set_state, dev_state_policy),
+	UBUS_METHOD("add_fdb", netifd_handle_fdb, dev_fdb_policy),
+	UBUS_METHOD("remove_fdb", netifd_handle_fdb, dev_fdb_policy),
+	UBUS_METHOD("add_veths", netifd_handle_add_veths, dev_veth_policy),
+	UBUS_METHOD("claim", netifd_handle_claim, dev_claim_policy),
+	UBUS_METHOD("release", netifd_handle_claim, dev_claim_policy),
 };
 
 static struct ubus_object_type dev_object_type =
@@ -665,7 +835,7 @@ interface_ip_dump_prefix_assignment_list(struct interface *iface)
 	list_for_each_entry(prefix, &prefixes, head) {
 		struct device_prefix_assignment *assign;
 		list_for_each_entry(assign, &prefix->assignments, head) {
-			if (strcmp(assign->name, iface->name))
+			if (assign->name != iface->name)
 				continue;
 
 			struct in6_addr addr = prefix->addr;
@@ -895,6 +1065,11 @@ netifd_handle_dump(struct ubus_context *ctx, struct ubus_object *obj,
 	}
 
 	blobmsg_close_array(&b, a);
+
+	/* the coordinator's dump also lists the interfaces of its workers */
+	if (!shard_dump_interfaces(ctx, req, b.head))
+		return 0;
+
 	ubus_send_reply(ctx, req, b.head);
 
 	return 0;
@@ -1193,6 +1368,36 @@ netifd_handle_wdev_down(struct ubus_context *ctx, struct ubus_object *obj,
 	return 0;
 }
 
+/*
+ * Callers passing the "generation" of an earlier status or get_validate
+ * reply get only {"generation", "unchanged": true} when nothing changed.
+ * Returns true when that short reply was sent.
+ */
+static bool
+wdev_reply_unchanged(struct ubus_context *ctx, struct ubus_request_data *req,
+		     struct blob_attr *msg, struct wireless_device *wdev)
+{
+	static const struct blobmsg_policy gen_policy = {
+		.name = "generation", .type = BLOBMSG_TYPE_INT32
+	};
+	struct blob_attr *cur;
+	unsigned int gen;
+
+	blob_buf_init(&b, 0);
+	blobmsg_parse(&gen_policy, 1, &cur, blob_data(msg), blob_len(msg));
+	if (!cur)
+		return false;
+
+	gen = wireless_status_generation(wdev);
+	blobmsg_add_u32(&b, "generation", gen);
+	if (blobmsg_get_u32(cur) != gen)
+		return false;
+
+	blobmsg_add_u8(&b, "unchanged", true);
+	ubus_send_reply(ctx, req, b.head);
+	return true;
+}
+
 static int
 netifd_handle_wdev_status(struct ubus_context *ctx, struct ubus_object *obj,
 			  struct ubus_request_data *req, const char *method,
@@ -1205,7 +1410,9 @@ netifd_handle_wdev_status(struct ubus_context *ctx, struct ubus_object *obj,
 	if (ret == UBUS_STATUS_NOT_FOUND)
 		return ret;
 
-	blob_buf_init(&b, 0);
+	if (wdev_reply_unchanged(ctx, req, msg, wdev))
+		return 0;
+
 	if (wdev) {
 		wireless_device_status(wdev, &b);
 	} else {
@@ -1228,7 +1435,9 @@ netifd_handle_wdev_get_validate(struct ubus_context *ctx, struct ubus_object *ob
 	if (ret == UBUS_STATUS_NOT_FOUND)
 		return ret;
 
-	blob_buf_init(&b, 0);
+	if (wdev_reply_unchanged(ctx, req, msg, wdev))
+		return 0;
+
 	if (wdev) {
 		wireless_device_get_validate(wdev, &b);
 	} else {
@@ -1288,6 +1497,24 @@ netifd_ubus_init(const char *path)
 	ubus_ctx->connection_lost = netifd_ubus_connection_lost;
 	netifd_ubus_add_fd();
 
+	if (netifd_shard) {
+		char *name;
+
+		/* devices and wireless stay with the coordinator */
+		if (asprintf(&name, "network.shard.%s", netifd_shard) == -1)
+			return -ENOMEM;
+		main_object.name = name;
+
+		if (asprintf(&name, "network.shard.%s.interface", netifd_shard) == -1)
+			return -ENOMEM;
+		iface_object.name = name;
+
+		netifd_add_object(&main_object);
+		netifd_add_iface_object();
+
+		return 0;
+	}
+
 	netifd_add_object(&main_object);
 	netifd_add_object(&dev_object);
 	netifd_add_object(&wireless_object);
@@ -1311,6 +1538,13 @@ netifd_ubus_interface_event(struct interface *iface, bool up)
 	ubus_send_event(ubus_ctx, "network.interface", b.head);
 }
 
+/* interface notifications of the shard workers, relayed by the coordinator */
+void
+netifd_ubus_relay_interface_notify(const char *event, struct blob_attr *msg)
+{
+	ubus_notify(ubus_ctx, &iface_object, event, msg, -1);
+}
+
 void
 netifd_ubus_interface_notify(struct interface *iface, bool up)
 {
@@ -1328,7 +1562,8 @@ netifd_ubus_add_interface(struct interface *iface)
 	struct ubus_object *obj = &iface->ubus;
 	char *name = NULL;
 
-	if (asprintf(&name, "%s.interface.%s", main_object.name, iface->name) == -1)
+	/* interface names are unique across shards, keep the usual object path */
+	if (asprintf(&name, "network.interface.%s", iface->name) == -1)
 		return;
 
 	obj->name = name;
@@ -13,6 +13,8 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
 #include "utils.h"
 
 #include <arpa/inet.h>
@@ -146,32 +148,56 @@ format_macaddr(uint8_t *mac)
 	return str;
 }
 
+static uint32_t crcvals[256];
+
+static void
+crc32_table_init(void)
+{
+	for (size_t i = 0; i < 256; ++i) {
+		uint32_t c = i;
+		for (size_t j = 0; j < 8; ++j)
+			c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+		crcvals[i] = c;
+	}
+}
+
+/* also used from job threads */
+static const uint32_t *
+crc32_table(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, crc32_table_init);
+
+	return crcvals;
+}
+
 uint32_t
-crc32_file(FILE *fp)
+crc32_update(uint32_t crc, const void *data, size_t len)
 {
-	static uint32_t *crcvals = NULL;
-	if (!crcvals) {
-		crcvals = malloc(sizeof(*crcvals) * 256);
+	const uint32_t *crcvals = crc32_table();
+	const uint8_t *buf = data;
+	uint32_t c = crc ^ 0xFFFFFFFF;
 
-		for (size_t i = 0; i < 256; ++i) {
-			uint32_t c = i;
-			for (size_t j = 0; j < 8; ++j)
-				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
-			crcvals[i] = c;
-		}
-	}
+	for (size_t i = 0; i < len; ++i)
+		c = crcvals[(c ^ buf[i]) & 0xFF] ^ (c >> 8);
+
+	return c ^ 0xFFFFFFFF;
+}
 
+uint32_t
+crc32_file(FILE *fp)
+{
 	uint8_t buf[1024];
 	size_t len;
-	uint32_t c = 0xFFFFFFFF;
+	uint32_t c = 0;
 
 	do {
 		len = fread(buf, 1, sizeof(buf), fp);
-		for (size_t i = 0; i < len; ++i)
-			c = crcvals[(c ^ buf[i]) & 0xFF] ^ (c >> 8);
+		c = crc32_update(c, buf, len);
 	} while (len == sizeof(buf));
 
-	return c ^ 0xFFFFFFFF;
+	return c;
 }
 
 bool check_pid_path(int pid, const char *exe)
@@ -220,3 +246,391 @@ uci_get_validate_string(const struct uci_blob_param_list *p, int i)
 
 	return p->validate[BLOBMSG_TYPE_STRING];
 }
+
+struct intern_str {
+	struct intern_str *next;
+	uint32_t hash;
+	unsigned int refcount;
+	char str[];
+};
+
+static struct intern_str **intern_table;
+static unsigned int intern_size, intern_count;
+
+static uint32_t
+str_hash(const char *str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	while (len--) {
+		hash ^= (unsigned char) *str++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static struct intern_str *
+intern_entry(const char *str)
+{
+	return container_of(str, struct intern_str, str);
+}
+
+static bool
+intern_grow(void)
+{
+	unsigned int size = intern_size ? intern_size * 2 : 64;
+	struct intern_str **table, *e, *next;
+	unsigned int i;
+
+	table = calloc(size, sizeof(*table));
+	if (!table)
+		return false;
+
+	for (i = 0; i < intern_size; i++) {
+		for (e = intern_table[i]; e; e = next) {
+			next = e->next;
+			e->next = table[e->hash & (size - 1)];
+			table[e->hash & (size - 1)] = e;
+		}
+	}
+
+	free(intern_table);
+	intern_table = table;
+	intern_size = size;
+
+	return true;
+}
+
+const char *
+str_intern(const char *str)
+{
+	size_t len = strlen(str);
+	uint32_t hash = str_hash(str, len);
+	struct intern_str *e;
+
+	if (intern_size) {
+		for (e = intern_table[hash & (intern_size - 1)]; e; e = e->next) {
+			if (e->hash == hash && !strcmp(e->str, str)) {
+				e->refcount++;
+				return e->str;
+			}
+		}
+	}
+
+	if (intern_count >= intern_size && !intern_grow() && !intern_size)
+		return NULL;
+
+	e = malloc(sizeof(*e) + len + 1);
+	if (!e)
+		return NULL;
+
+	e->hash = hash;
+	e->refcount = 1;
+	memcpy(e->str, str, len + 1);
+	e->next = intern_table[hash & (intern_size - 1)];
+	intern_table[hash & (intern_size - 1)] = e;
+	intern_count++;
+
+	return e->str;
+}
+
+void
+str_release(const char *str)
+{
+	struct intern_str *e, **pe;
+
+	if (!str)
+		return;
+
+	e = intern_entry(str);
+	if (--e->refcount)
+		return;
+
+	for (pe = &intern_table[e->hash & (intern_size - 1)]; *pe; pe = &(*pe)->next) {
+		if (*pe != e)
+			continue;
+
+		*pe = e->next;
+		break;
+	}
+
+	intern_count--;
+	free(e);
+}
+
+/* avl_strcmp with a shortcut for keys that are the same interned string */
+int
+avl_atomcmp(const void *k1, const void *k2, void *ptr)
+{
+	if (k1 == k2)
+		return 0;
+
+	return strcmp(k1, k2);
+}
+
+/*
+ * per-policy name -> index hash, built on first use of a policy array.
+ * slot values are policy index + 1, 0 marks an empty slot.
+ */
+struct blobmsg_plan {
+	struct avl_node avl;
+	const struct blobmsg_policy *policy;
+	int n_policy;
+	bool fallback;
+	unsigned int mask;
+	uint16_t slot[];
+};
+
+static int
+blobmsg_plan_cmp(const void *k1, const void *k2, void *ptr)
+{
+	if (k1 == k2)
+		return 0;
+
+	return k1 < k2 ? -1 : 1;
+}
+
+static AVL_TREE(blobmsg_plans, blobmsg_plan_cmp, false, NULL);
+
+static struct blobmsg_plan *
+blobmsg_plan_create(const struct blobmsg_policy *policy, int n_policy)
+{
+	struct blobmsg_plan *plan;
+	unsigned int size = 8;
+	int i;
+
+	while (size < 2 * n_policy)
+		size <<= 1;
+
+	plan = calloc(1, sizeof(*plan) + size * sizeof(plan->slot[0]));
+	if (!plan)
+		return NULL;
+
+	plan->policy = policy;
+	plan->n_policy = n_policy;
+	plan->mask = size - 1;
+
+	for (i = 0; i < n_policy; i++) {
+		const char *name = policy[i].name;
+		unsigned int h;
+
+		if (!name)
+			continue;
+
+		/* casting types match several wire types, leave them to libubox */
+		if (policy[i].type > BLOBMSG_TYPE_LAST) {
+			plan->fallback = true;
+			break;
+		}
+
+		h = str_hash(name, strlen(name)) & plan->mask;
+		while (plan->slot[h])
+			h = (h + 1) & plan->mask;
+
+		plan->slot[h] = i + 1;
+	}
+
+	plan->avl.key = policy;
+	avl_insert(&blobmsg_plans, &plan->avl);
+
+	return plan;
+}
+
+/*
+ * Drop-in replacement for blobmsg_parse() for large, static policy arrays.
+ * Each attribute costs one hash lookup instead of a scan of the policy.
+ */
+int
+blobmsg_parse_cached(const struct blobmsg_policy *policy, int n_policy,
+		     struct blob_attr **tb, void *data, unsigned int len)
+{
+	struct blobmsg_plan *plan;
+	struct blob_attr *attr;
+
+	plan = avl_find_element(&blobmsg_plans, policy, plan, avl);
+	if (!plan)
+		plan = blobmsg_plan_create(policy, n_policy);
+
+	if (!plan || plan->fallback || plan->n_policy != n_policy)
+		return blobmsg_parse(policy, n_policy, tb, data, len);
+
+	memset(tb, 0, n_policy * sizeof(*tb));
+	if (!data || !len)
+		return -EINVAL;
+
+	__blob_for_each_attr(attr, data, len) {
+		const struct blobmsg_hdr *hdr = blob_data(attr);
+		unsigned int namelen, h;
+		bool checked = false;
+
+		if (blob_len(attr) < sizeof(*hdr))
+			continue;
+
+		namelen = be16_to_cpu(hdr->namelen);
+		if (!namelen || namelen > blob_len(attr) - sizeof(*hdr))
+			continue;
+
+		h = str_hash((const char *) hdr->name, namelen) & plan->mask;
+		for (; plan->slot[h]; h = (h + 1) & plan->mask) {
+			int i = plan->slot[h] - 1;
+
+			if (policy[i].type != BLOBMSG_TYPE_UNSPEC &&
+			    blob_id(attr) != policy[i].type)
+				continue;
+
+			if (strncmp(policy[i].name, (const char *) hdr->name, namelen) != 0 ||
+			    policy[i].name[namelen])
+				continue;
+
+			if (!checked && !blobmsg_check_attr(attr, true))
+				return -1;
+
+			checked = true;
+			if (!tb[i])
+				tb[i] = attr;
+		}
+	}
+
+	return 0;
+}
+
+#define SLAB_CHUNK_SIZE		4096
+#define SLAB_CHUNK_MIN		8
+
+struct slab_chunk {
+	struct list_head list;
+	void *free;
+	unsigned int used;
+};
+
+/* every object is preceded by a pointer to its chunk */
+union slab_hdr {
+	struct slab_chunk *chunk;
+	uint64_t align;
+};
+
+static LIST_HEAD(slabs);
+
+static size_t
+slab_slot_size(struct slab *s)
+{
+	return (sizeof(union slab_hdr) + s->size + 7) & ~7;
+}
+
+static void
+slab_init(struct slab *s)
+{
+	size_t slot = slab_slot_size(s);
+
+	s->per_chunk = (SLAB_CHUNK_SIZE - sizeof(struct slab_chunk)) / slot;
+	if (s->per_chunk < SLAB_CHUNK_MIN)
+		s->per_chunk = SLAB_CHUNK_MIN;
+
+	INIT_LIST_HEAD(&s->partial);
+	INIT_LIST_HEAD(&s->full);
+	list_add_tail(&s->list, &slabs);
+}
+
+static struct slab_chunk *
+slab_add_chunk(struct slab *s)
+{
+	size_t slot = slab_slot_size(s);
+	struct slab_chunk *c;
+	union slab_hdr *hdr;
+	char *data;
+	int i;
+
+	c = malloc(sizeof(*c) + s->per_chunk * slot);
+	if (!c)
+		return NULL;
+
+	c->free = NULL;
+	c->used = 0;
+
+	data = (char *) (c + 1);
+	for (i = s->per_chunk - 1; i >= 0; i--) {
+		hdr = (union slab_hdr *) (data + i * slot);
+		hdr->chunk = c;
+		*(void **) (hdr + 1) = c->free;
+		c->free = hdr + 1;
+	}
+
+	list_add(&c->list, &s->partial);
+	s->chunks++;
+
+	return c;
+}
+
+void *
+slab_alloc(struct slab *s)
+{
+	struct slab_chunk *c;
+	void *ptr;
+
+	if (!s->per_chunk)
+		slab_init(s);
+
+	if (list_empty(&s->partial)) {
+		if (!slab_add_chunk(s))
+			return NULL;
+	}
+
+	c = list_first_entry(&s->partial, struct slab_chunk, list);
+	ptr = c->free;
+	c->free = *(void **) ptr;
+	c->used++;
+
+	if (!c->free)
+		list_move(&c->list, &s->full);
+
+	s->allocs++;
+	if (++s->in_use > s->peak)
+		s->peak = s->in_use;
+
+	memset(ptr, 0, s->size);
+	return ptr;
+}
+
+void
+slab_free(struct slab *s, void *ptr)
+{
+	struct slab_chunk *c;
+
+	if (!ptr)
+		return;
+
+	c = ((union slab_hdr *) ptr - 1)->chunk;
+	*(void **) ptr = c->free;
+	c->free = ptr;
+	c->used--;
+	s->in_use--;
+
+	/* move to the front so the next allocation reuses this object */
+	list_move(&c->list, &s->partial);
+
+	/* keep one chunk of slack, return anything beyond that */
+	if (!c->used && s->in_use + 2 * s->per_chunk <= s->chunks * s->per_chunk) {
+		list_del(&c->list);
+		free(c);
+		s->chunks--;
+	}
+}
+
+void
+slab_dump_stats(struct blob_buf *b)
+{
+	struct slab *s;
+	void *c;
+
+	list_for_each_entry(s, &slabs, list) {
+		c = blobmsg_open_table(b, s->name);
+		blobmsg_add_u32(b, "size", s->size);
+		blobmsg_add_u32(b, "in_use", s->in_use);
+		blobmsg_add_u32(b, "peak", s->peak);
+		blobmsg_add_u32(b, "capacity", s->chunks * s->per_chunk);
+		blobmsg_add_u32(b, "chunks", s->chunks);
+		blobmsg_add_u64(b, "allocs", s->allocs);
+		blobmsg_close_table(b, c);
+	}
+}
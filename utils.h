@@ -111,10 +111,50 @@ bool check_pid_path(int pid, const char *exe);
 
 char * format_macaddr(uint8_t *mac);
 
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
 uint32_t crc32_file(FILE *fp);
 
 const char * uci_get_validate_string(const struct uci_blob_param_list *p, int i);
 
+int blobmsg_parse_cached(const struct blobmsg_policy *policy, int n_policy,
+			 struct blob_attr **tb, void *data, unsigned int len);
+
+/*
+ * pool of fixed-size objects, carved out of page-sized chunks.
+ * freed objects are handed out again before any new memory is taken.
+ */
+struct slab {
+	struct list_head list;
+	const char *name;
+	size_t size;
+	unsigned int per_chunk;
+
+	/* chunks with free objects, most recently used first */
+	struct list_head partial;
+	struct list_head full;
+
+	unsigned int chunks;
+	unsigned int in_use;
+	unsigned int peak;
+	unsigned long allocs;
+};
+
+#define SLAB_INIT(_name, _type) { .name = _name, .size = sizeof(_type) }
+
+/*
+ * interned strings: equal names share one reference counted copy, so they
+ * can be compared by pointer. str_intern() takes a reference, str_release()
+ * drops it.
+ */
+const char *str_intern(const char *str);
+void str_release(const char *str);
+
+int avl_atomcmp(const void *k1, const void *k2, void *ptr);
+
+void *slab_alloc(struct slab *s);
+void slab_free(struct slab *s, void *ptr);
+void slab_dump_stats(struct blob_buf *b);
+
 #ifdef __APPLE__
 #define s6_addr32	__u6_addr.__u6_addr32
 #endif
@@ -33,6 +33,7 @@ enum {
 	VETH_ATTR_MACADDR,
 	VETH_ATTR_PEER_NAME,
 	VETH_ATTR_PEER_MACADDR,
+	VETH_ATTR_PEER_NETNS,
 	__VETH_ATTR_MAX
 };
 
@@ -40,6 +41,7 @@ static const struct blobmsg_policy veth_attrs[__VETH_ATTR_MAX] = {
 	[VETH_ATTR_MACADDR] = { "macaddr", BLOBMSG_TYPE_STRING },
 	[VETH_ATTR_PEER_NAME]  = { "peer_name", BLOBMSG_TYPE_STRING },
 	[VETH_ATTR_PEER_MACADDR] = { "peer_macaddr", BLOBMSG_TYPE_STRING },
+	[VETH_ATTR_PEER_NETNS] = { "peer_netns", BLOBMSG_TYPE_STRING },
 };
 
 static const struct uci_blob_param_list veth_attr_list = {
@@ -50,6 +52,8 @@ static const struct uci_blob_param_list veth_attr_list = {
 	.next = { &device_attr_list },
 };
 
+static struct device_type veth_device_type;
+
 struct veth {
 	struct device dev;
 
@@ -57,6 +61,9 @@ struct veth {
 
 	struct blob_attr *config_data;
 	struct veth_config config;
+
+	/* link was already created by veth_add_batch */
+	bool created;
 };
 
 static int
@@ -73,9 +80,13 @@ veth_set_up(struct veth *veth)
 {
 	int ret;
 
-	ret = system_veth_add(&veth->dev, &veth->config);
-	if (ret < 0)
-		return ret;
+	if (veth->created)
+		veth->created = false;
+	else {
+		ret = system_veth_add(&veth->dev, &veth->config);
+		if (ret < 0)
+			return ret;
+	}
 
 	ret = veth->set_state(&veth->dev, true);
 	if (ret)
@@ -120,6 +131,8 @@ veth_dump_info(struct device *dev, struct blob_buf *b)
 	veth = container_of(dev, struct veth, dev);
 	if (veth->config.flags & VETH_OPT_PEER_NAME)
 		blobmsg_add_string(b, "peer", veth->config.peer_name);
+	if (veth->config.flags & VETH_OPT_PEER_NETNS)
+		blobmsg_add_string(b, "peer_netns", veth->config.peer_netns);
 	system_if_dump_info(dev, b);
 }
 
@@ -130,9 +143,8 @@ veth_config_init(struct device *dev)
 }
 
 static void
-veth_apply_settings(struct veth *veth, struct blob_attr **tb)
+veth_parse_config(struct veth_config *cfg, struct blob_attr **tb)
 {
-	struct veth_config *cfg = &veth->config;
 	struct blob_attr *cur;
 	struct ether_addr *ea;
 
@@ -161,6 +173,120 @@ veth_apply_settings(struct veth *veth, struct blob_attr **tb)
 			cfg->flags |= VETH_OPT_PEER_MACADDR;
 		}
 	}
+
+	if ((cur = tb[VETH_ATTR_PEER_NETNS]))
+	{
+		cfg->peer_netns = blobmsg_get_string(cur);
+		cfg->flags |= VETH_OPT_PEER_NETNS;
+	}
+}
+
+static void
+veth_apply_settings(struct veth *veth, struct blob_attr **tb)
+{
+	veth_parse_config(&veth->config, tb);
+}
+
+enum {
+	VETH_BATCH_ATTR_NAME,
+	__VETH_BATCH_ATTR_MAX
+};
+
+static const struct blobmsg_policy veth_batch_attrs[__VETH_BATCH_ATTR_MAX] = {
+	[VETH_BATCH_ATTR_NAME] = { "name", BLOBMSG_TYPE_STRING },
+};
+
+static void
+veth_register_created(const char *name, struct blob_attr *attr)
+{
+	struct device *dev;
+	struct blob_buf b;
+
+	if (device_find(name)) {
+		D(DEVICE, "veth '%s' created by batch already has a device\n", name);
+		return;
+	}
+
+	memset(&b, 0, sizeof(b));
+	blob_buf_init(&b, 0);
+	blob_put(&b, 0, blobmsg_data(attr), blobmsg_data_len(attr));
+	dev = device_create(name, &veth_device_type, blob_data(b.head));
+	blob_buf_free(&b);
+
+	if (dev && dev->type == &veth_device_type)
+		container_of(dev, struct veth, dev)->created = true;
+}
+
+/*
+ * Create a list of veth pairs in one go. Each entry is a table with "name"
+ * and the veth options; a per-entry result is added to b as an array of
+ * error codes. Created pairs are registered as veth devices, so they can be
+ * used and removed like configured ones.
+ */
+int
+veth_add_batch(struct blob_attr *list, struct blob_buf *b)
+{
+	struct blob_attr *tb_mv[__VETH_ATTR_MAX];
+	struct blob_attr *tb[__VETH_BATCH_ATTR_MAX];
+	struct veth_config *cfgs;
+	const char **ifnames;
+	struct blob_attr **entries;
+	struct blob_attr *cur;
+	int *results;
+	int i, n = 0, rem, ret = -ENOMEM;
+	void *c;
+
+	blobmsg_for_each_attr(cur, list, rem)
+		n++;
+
+	if (!n)
+		return -EINVAL;
+
+	cfgs = calloc(n, sizeof(*cfgs));
+	ifnames = calloc(n, sizeof(*ifnames));
+	results = calloc(n, sizeof(*results));
+	entries = calloc(n, sizeof(*entries));
+	if (!cfgs || !ifnames || !results || !entries)
+		goto out;
+
+	ret = -EINVAL;
+	i = 0;
+	blobmsg_for_each_attr(cur, list, rem) {
+		if (blobmsg_type(cur) != BLOBMSG_TYPE_TABLE)
+			goto out;
+
+		blobmsg_parse(veth_batch_attrs, __VETH_BATCH_ATTR_MAX, tb,
+			blobmsg_data(cur), blobmsg_len(cur));
+		if (!tb[VETH_BATCH_ATTR_NAME])
+			goto out;
+
+		blobmsg_parse(veth_attrs, __VETH_ATTR_MAX, tb_mv,
+			blobmsg_data(cur), blobmsg_len(cur));
+
+		ifnames[i] = blobmsg_get_string(tb[VETH_BATCH_ATTR_NAME]);
+		entries[i] = cur;
+		veth_parse_config(&cfgs[i], tb_mv);
+		i++;
+	}
+
+	ret = system_veth_add_batch(ifnames, cfgs, results, n);
+
+	for (i = 0; i < n; i++)
+		if (!results[i])
+			veth_register_created(ifnames[i], entries[i]);
+
+	/* 0 or -errno, INT32 values are signed in the JSON output */
+	c = blobmsg_open_array(b, "results");
+	for (i = 0; i < n; i++)
+		blobmsg_add_u32(b, NULL, (int32_t) results[i]);
+	blobmsg_close_array(b, c);
+
+out:
+	free(entries);
+	free(results);
+	free(ifnames);
+	free(cfgs);
+	return ret;
 }
 
 static enum dev_change_type
@@ -174,7 +300,7 @@ veth_reload(struct device *dev, struct blob_attr *attr)
 	veth = container_of(dev, struct veth, dev);
 	attr = blob_memdup(attr);
 
-	blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
+	blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
 		blob_data(attr), blob_len(attr));
 	blobmsg_parse(veth_attrs, __VETH_ATTR_MAX, tb_mv,
 		blob_data(attr), blob_len(attr));
@@ -186,7 +312,7 @@ veth_reload(struct device *dev, struct blob_attr *attr)
 		struct blob_attr *otb_dev[__DEV_ATTR_MAX];
 		struct blob_attr *otb_mv[__VETH_ATTR_MAX];
 
-		blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
+		blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
 			blob_data(veth->config_data), blob_len(veth->config_data));
 
 		if (uci_blob_diff(tb_dev, otb_dev, &device_attr_list, NULL))
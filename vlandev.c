@@ -233,6 +233,44 @@ vlandev_apply_settings(struct vlandev_device *mvdev, struct blob_attr **tb)
 	vlist_simple_flush(&cfg->egress_qos_mapping_list);
 }
 
+/*
+ * Only the qos maps can be changed on a live vlan link, a new vid or parent
+ * needs the link recreated.
+ */
+static bool
+vlandev_changelink(struct vlandev_device *mvdev, unsigned long diff,
+		   struct blob_attr **otb_mv)
+{
+	struct vlandev_config ocfg = {};
+	int ret;
+
+	if (diff & ((1 << VLANDEV_ATTR_IFNAME) | (1 << VLANDEV_ATTR_VID)))
+		return false;
+
+	if (!mvdev->dev.active)
+		return true;
+
+	vlist_simple_init(&ocfg.ingress_qos_mapping_list,
+			  struct vlan_qos_mapping, node);
+	vlist_simple_init(&ocfg.egress_qos_mapping_list,
+			  struct vlan_qos_mapping, node);
+
+	if (otb_mv[VLANDEV_ATTR_INGRESS_QOS_MAPPING])
+		vlandev_qos_mapping_list_apply(&ocfg.ingress_qos_mapping_list,
+					       otb_mv[VLANDEV_ATTR_INGRESS_QOS_MAPPING]);
+
+	if (otb_mv[VLANDEV_ATTR_EGRESS_QOS_MAPPING])
+		vlandev_qos_mapping_list_apply(&ocfg.egress_qos_mapping_list,
+					       otb_mv[VLANDEV_ATTR_EGRESS_QOS_MAPPING]);
+
+	ret = system_vlandev_change(&mvdev->dev, &mvdev->config, &ocfg);
+
+	vlist_simple_flush_all(&ocfg.ingress_qos_mapping_list);
+	vlist_simple_flush_all(&ocfg.egress_qos_mapping_list);
+
+	return !ret;
+}
+
 static enum dev_change_type
 vlandev_reload(struct device *dev, struct blob_attr *attr)
 {
@@ -244,7 +282,7 @@ vlandev_reload(struct device *dev, struct blob_attr *attr)
 	mvdev = container_of(dev, struct vlandev_device, dev);
 	attr = blob_memdup(attr);
 
-	blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
+	blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, tb_dev,
 		blob_data(attr), blob_len(attr));
 	blobmsg_parse(vlandev_attrs, __VLANDEV_ATTR_MAX, tb_mv,
 		blob_data(attr), blob_len(attr));
@@ -256,8 +294,9 @@ vlandev_reload(struct device *dev, struct blob_attr *attr)
 	if (mvdev->config_data) {
 		struct blob_attr *otb_dev[__DEV_ATTR_MAX];
 		struct blob_attr *otb_mv[__VLANDEV_ATTR_MAX];
+		unsigned long diff = 0;
 
-		blobmsg_parse(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
+		blobmsg_parse_cached(device_attr_list.params, __DEV_ATTR_MAX, otb_dev,
 			blob_data(mvdev->config_data), blob_len(mvdev->config_data));
 
 		if (uci_blob_diff(tb_dev, otb_dev, &device_attr_list, NULL))
@@ -266,7 +305,9 @@ vlandev_reload(struct device *dev, struct blob_attr *attr)
 		blobmsg_parse(vlandev_attrs, __VLANDEV_ATTR_MAX, otb_mv,
 			blob_data(mvdev->config_data), blob_len(mvdev->config_data));
 
-		if (uci_blob_diff(tb_mv, otb_mv, &vlandev_attr_list, NULL))
+		uci_blob_diff(tb_mv, otb_mv, &vlandev_attr_list, &diff);
+		if (diff && ret == DEV_CONFIG_APPLIED &&
+		    !vlandev_changelink(mvdev, diff, otb_mv))
 		    ret = DEV_CONFIG_RESTART;
 
 		vlandev_config_init(dev);
@@ -12,6 +12,9 @@
  * GNU General Public License for more details.
  */
 #include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <net/if.h>
 #include "netifd.h"
 #include "wireless.h"
 #include "handler.h"
@@ -26,10 +29,18 @@ static int drv_fd;
 static LIST_HEAD(handlers);
 static bool handler_pending;
 
+/* devices left running by the previous instance, see wireless_save_state */
+static struct blob_buf state_buf;
+static struct blob_attr *saved_state;
+
+static struct blob_buf status_buf;
+static unsigned int status_gen;
+
 enum {
 	WDEV_ATTR_DISABLED,
 	WDEV_ATTR_RECONF,
 	WDEV_ATTR_SERIALIZE,
+	WDEV_ATTR_START_PRIORITY,
 	__WDEV_ATTR_MAX,
 };
 
@@ -37,6 +48,7 @@ static const struct blobmsg_policy wdev_policy[__WDEV_ATTR_MAX] = {
 	[WDEV_ATTR_DISABLED] = { .name = "disabled", .type = BLOBMSG_TYPE_BOOL },
 	[WDEV_ATTR_RECONF] = { .name = "reconf", .type = BLOBMSG_TYPE_BOOL },
 	[WDEV_ATTR_SERIALIZE] = { .name = "serialize", .type = BLOBMSG_TYPE_BOOL },
+	[WDEV_ATTR_START_PRIORITY] = { .name = "start_priority", .type = BLOBMSG_TYPE_INT32 },
 };
 
 static const struct uci_blob_param_list wdev_param = {
@@ -113,8 +125,8 @@ put_container(struct blob_buf *buf, struct blob_attr *attr, const char *name)
 	blobmsg_close_table(buf, c);
 }
 
-static void
-vif_config_add_bridge(struct blob_buf *buf, struct blob_attr *networks, bool prepare)
+static struct device *
+vif_bridge_dev(struct blob_attr *networks)
 {
 	struct interface *iface;
 	struct device *dev = NULL;
@@ -123,7 +135,7 @@ vif_config_add_bridge(struct blob_buf *buf, struct blob_attr *networks, bool pre
 	int rem;
 
 	if (!networks)
-		return;
+		return NULL;
 
 	blobmsg_for_each_attr(cur, networks, rem) {
 		network = blobmsg_data(cur);
@@ -134,18 +146,23 @@ vif_config_add_bridge(struct blob_buf *buf, struct blob_attr *networks, bool pre
 
 		dev = iface->main_dev.dev;
 		if (!dev)
-			return;
+			return NULL;
 
 		if (!dev->type->bridge_capability)
-			return;
+			return NULL;
 	}
 
+	return dev;
+}
+
+static void
+vif_config_add_bridge(struct blob_buf *buf, struct blob_attr *networks)
+{
+	struct device *dev = vif_bridge_dev(networks);
+
 	if (!dev)
 		return;
 
-	if (dev->hotplug_ops && dev->hotplug_ops->prepare)
-		dev->hotplug_ops->prepare(dev);
-
 	blobmsg_add_string(buf, "bridge", dev->ifname);
 
 	if (dev->settings.flags & DEV_OPT_MULTICAST_TO_UNICAST)
@@ -153,55 +170,143 @@ vif_config_add_bridge(struct blob_buf *buf, struct blob_attr *networks, bool pre
 			       dev->settings.multicast_to_unicast);
 }
 
+static uint32_t
+vif_prepare_bridge(uint32_t crc, struct blob_attr *networks)
+{
+	struct device *dev = vif_bridge_dev(networks);
+
+	if (!dev)
+		return crc32_update(crc, "", 1);
+
+	if (dev->hotplug_ops && dev->hotplug_ops->prepare)
+		dev->hotplug_ops->prepare(dev);
+
+	crc = crc32_update(crc, dev->ifname, strlen(dev->ifname) + 1);
+	if (dev->settings.flags & DEV_OPT_MULTICAST_TO_UNICAST)
+		crc = crc32_update(crc, &dev->settings.multicast_to_unicast,
+				   sizeof(dev->settings.multicast_to_unicast));
+
+	return crc;
+}
+
+/*
+ * (Re)link vlans and stations under their vif, only needed after a vif,
+ * vlan or station was added, changed or removed
+ */
 static void
-prepare_config(struct wireless_device *wdev, struct blob_buf *buf, bool up)
+wireless_device_link_vifs(struct wireless_device *wdev)
+{
+	struct wireless_interface *vif;
+	struct wireless_vlan *vlan;
+	struct wireless_station *sta;
+
+	if (wdev->vif_links_valid)
+		return;
+
+	vlist_for_each_element(&wdev->interfaces, vif, node) {
+		INIT_LIST_HEAD(&vif->vlans);
+		INIT_LIST_HEAD(&vif->stations);
+	}
+
+	vlist_for_each_element(&wdev->vlans, vlan, node) {
+		vif = vlist_find(&wdev->interfaces, vlan->vif, vif, node);
+		if (vif)
+			list_add_tail(&vlan->vif_list, &vif->vlans);
+	}
+
+	vlist_for_each_element(&wdev->stations, sta, node) {
+		vif = vlist_find(&wdev->interfaces, sta->vif, vif, node);
+		if (vif)
+			list_add_tail(&sta->vif_list, &vif->stations);
+	}
+
+	wdev->vif_links_valid = true;
+}
+
+static void
+wireless_device_invalidate(struct wireless_device *wdev)
+{
+	free(wdev->config_cache);
+	wdev->config_cache = NULL;
+	free(wdev->status_cache);
+	wdev->status_cache = NULL;
+	wdev->vif_links_valid = false;
+}
+
+static void
+prepare_config(struct wireless_device *wdev, struct blob_buf *buf)
 {
 	struct wireless_interface *vif;
 	struct wireless_vlan *vlan;
 	struct wireless_station *sta;
 	void *l, *i, *j, *k;
 
-	blob_buf_init(&b, 0);
-	put_container(&b, wdev->config, "config");
+	wireless_device_link_vifs(wdev);
+
+	blob_buf_init(buf, 0);
+	put_container(buf, wdev->config, "config");
 	if (wdev->data)
-		blobmsg_add_blob(&b, wdev->data);
+		blobmsg_add_blob(buf, wdev->data);
 
-	l = blobmsg_open_table(&b, "interfaces");
+	l = blobmsg_open_table(buf, "interfaces");
 	vlist_for_each_element(&wdev->interfaces, vif, node) {
-		i = blobmsg_open_table(&b, vif->name);
-		vif_config_add_bridge(&b, vif->network, up);
-		put_container(&b, vif->config, "config");
+		i = blobmsg_open_table(buf, vif->name);
+		vif_config_add_bridge(buf, vif->network);
+		put_container(buf, vif->config, "config");
 		if (vif->data)
-			blobmsg_add_blob(&b, vif->data);
+			blobmsg_add_blob(buf, vif->data);
 
-		j = blobmsg_open_table(&b, "vlans");
-		vlist_for_each_element(&wdev->vlans, vlan, node) {
-			if (strcmp(vlan->vif, vif->name))
-				continue;
-			k = blobmsg_open_table(&b, vlan->name);
-			vif_config_add_bridge(&b, vlan->network, up);
-			put_container(&b, vlan->config, "config");
+		j = blobmsg_open_table(buf, "vlans");
+		list_for_each_entry(vlan, &vif->vlans, vif_list) {
+			k = blobmsg_open_table(buf, vlan->name);
+			vif_config_add_bridge(buf, vlan->network);
+			put_container(buf, vlan->config, "config");
 			if (vlan->data)
-				blobmsg_add_blob(&b, vlan->data);
-			blobmsg_close_table(&b, k);
+				blobmsg_add_blob(buf, vlan->data);
+			blobmsg_close_table(buf, k);
 		}
-		blobmsg_close_table(&b, j);
+		blobmsg_close_table(buf, j);
 
-		j = blobmsg_open_table(&b, "stas");
-		vlist_for_each_element(&wdev->stations, sta, node) {
-			if (strcmp(sta->vif, vif->name))
-				continue;
-			k = blobmsg_open_table(&b, sta->name);
-			put_container(&b, sta->config, "config");
+		j = blobmsg_open_table(buf, "stas");
+		list_for_each_entry(sta, &vif->stations, vif_list) {
+			k = blobmsg_open_table(buf, sta->name);
+			put_container(buf, sta->config, "config");
 			if (sta->data)
-				blobmsg_add_blob(&b, sta->data);
-			blobmsg_close_table(&b, k);
+				blobmsg_add_blob(buf, sta->data);
+			blobmsg_close_table(buf, k);
 		}
-		blobmsg_close_table(&b, j);
-		blobmsg_close_table(&b, i);
+		blobmsg_close_table(buf, j);
+		blobmsg_close_table(buf, i);
 	}
-	blobmsg_close_table(&b, l);
+	blobmsg_close_table(buf, l);
+}
+
+/*
+ * Handler config of the device. The bridges of all vifs and vlans are
+ * prepared on every call, the rest is only reassembled after the cached
+ * copy was invalidated or one of the bridges changed.
+ */
+static struct blob_attr *
+wireless_device_get_config(struct wireless_device *wdev)
+{
+	struct wireless_interface *vif;
+	struct wireless_vlan *vlan;
+	uint32_t bridges = 0;
+
+	vlist_for_each_element(&wdev->interfaces, vif, node)
+		bridges = vif_prepare_bridge(bridges, vif->network);
+	vlist_for_each_element(&wdev->vlans, vlan, node)
+		bridges = vif_prepare_bridge(bridges, vlan->network);
 
+	if (wdev->config_cache && wdev->config_cache_bridges == bridges)
+		return wdev->config_cache;
+
+	prepare_config(wdev, &b);
+	free(wdev->config_cache);
+	wdev->config_cache = blob_memdup(b.head);
+	wdev->config_cache_bridges = bridges;
+
+	return b.head;
 }
 
 static bool
@@ -275,6 +380,7 @@ wireless_device_free_state(struct wireless_device *wdev)
 	uloop_timeout_cancel(&wdev->script_check);
 	uloop_timeout_cancel(&wdev->timeout);
 	wireless_complete_kill_request(wdev);
+	wireless_device_invalidate(wdev);
 	free(wdev->data);
 	wdev->data = NULL;
 	vlist_for_each_element(&wdev->interfaces, vif, node) {
@@ -391,8 +497,10 @@ wireless_device_run_handler(struct wireless_device *wdev, bool up)
 		free(wdev->prev_config);
 		wdev->prev_config = NULL;
 	} else {
-		prepare_config(wdev, &b, up);
-		config = blobmsg_format_json(b.head, true);
+		struct blob_attr *cfg = wireless_device_get_config(wdev);
+
+		wdev->setup_crc = crc32_update(0, cfg, blob_pad_len(cfg));
+		config = blobmsg_format_json(cfg, true);
 	}
 
 	argv[i++] = wdev->drv->script;
@@ -462,7 +570,11 @@ wireless_device_free(struct wireless_device *wdev)
 	avl_delete(&wireless_devices.avl, &wdev->node.avl);
 	free(wdev->config);
 	free(wdev->prev_config);
+	free(wdev->config_cache);
+	free(wdev->status_cache);
+	free(wdev->validate_cache);
 	free(wdev);
+	status_gen++;
 }
 
 static void
@@ -564,10 +676,16 @@ wireless_device_mark_up(struct wireless_device *wdev)
 
 	D(WIRELESS, "Wireless device '%s' is now up\n", wdev->name);
 	wdev->state = IFS_UP;
+
+	/* attach all vifs and vlans of the radio to their bridges at once */
+	device_lock();
+	bridge_batch_begin();
 	vlist_for_each_element(&wdev->interfaces, vif, node)
 		wireless_interface_handle_link(vif, true);
 	vlist_for_each_element(&wdev->vlans, vlan, node)
 		wireless_vlan_handle_link(vlan, true);
+	bridge_batch_end();
+	device_unlock();
 }
 
 static void
@@ -631,8 +749,7 @@ wdev_prepare_prev_config(struct wireless_device *wdev)
 	if (wdev->prev_config)
 		return;
 
-	prepare_config(wdev, &b, false);
-	wdev->prev_config = blob_memdup(b.head);
+	wdev->prev_config = blob_memdup(wireless_device_get_config(wdev));
 }
 
 static void
@@ -641,6 +758,7 @@ wdev_change_config(struct wireless_device *wdev, struct wireless_device *wd_new)
 	struct blob_attr *new_config = wd_new->config;
 	bool disabled = wd_new->disabled;
 
+	wdev->start_priority = wd_new->start_priority;
 	free(wd_new);
 
 	wdev_prepare_prev_config(wdev);
@@ -650,6 +768,7 @@ wdev_change_config(struct wireless_device *wdev, struct wireless_device *wd_new)
 	D(WIRELESS, "Update configuration of wireless device '%s'\n", wdev->name);
 	free(wdev->config);
 	wdev->config = blob_memdup(new_config);
+	wireless_device_invalidate(wdev);
 	wdev->disabled = disabled;
 	wdev->retry_setup_failed = false;
 	wdev_set_config_state(wdev, IFC_RELOAD);
@@ -660,6 +779,7 @@ wdev_create(struct wireless_device *wdev)
 {
 	wdev->retry = WIRELESS_SETUP_RETRY;
 	wdev->config = blob_memdup(wdev->config);
+	wdev->status_gen = ++status_gen;
 }
 
 static void
@@ -741,11 +861,21 @@ void wireless_init(void)
 	wireless_devices.no_delete = true;
 
 	avl_init(&wireless_drivers, avl_strcmp, false, NULL);
+
+	/* wireless devices and their saved state belong to the coordinator */
+	if (netifd_shard)
+		return;
+
 	drv_fd = netifd_open_subdir("wireless");
 	if (drv_fd < 0)
 		return;
 
 	netifd_init_script_handlers(drv_fd, wireless_add_handler);
+
+	blob_buf_init(&state_buf, 0);
+	if (blobmsg_add_json_from_file(&state_buf, DEFAULT_WIRELESS_STATE))
+		saved_state = state_buf.head;
+	unlink(DEFAULT_WIRELESS_STATE);
 }
 
 static void
@@ -811,6 +941,7 @@ vif_update(struct vlist_tree *tree, struct vlist_node *node_new,
 		free(vif_old);
 	}
 
+	wireless_device_invalidate(wdev);
 	wdev_set_config_state(wdev, IFC_RELOAD);
 }
 
@@ -872,6 +1003,7 @@ vlan_update(struct vlist_tree *tree, struct vlist_node *node_new,
 		free(vlan_old);
 	}
 
+	wireless_device_invalidate(wdev);
 	wdev_set_config_state(wdev, IFC_RELOAD);
 }
 
@@ -911,6 +1043,7 @@ station_update(struct vlist_tree *tree, struct vlist_node *node_new,
 		free(sta_old);
 	}
 
+	wireless_device_invalidate(wdev);
 	wdev_set_config_state(wdev, IFC_RELOAD);
 }
 
@@ -993,6 +1126,9 @@ wireless_device_create(struct wireless_driver *drv, const char *name, struct blo
 	cur = tb[WDEV_ATTR_RECONF];
 	wdev->reconf = cur && blobmsg_get_bool(cur);
 
+	if ((cur = tb[WDEV_ATTR_START_PRIORITY]))
+		wdev->start_priority = blobmsg_get_u32(cur);
+
 	wdev->retry_setup_failed = false;
 	wdev->autostart = true;
 	INIT_LIST_HEAD(&wdev->script_proc);
@@ -1143,20 +1279,25 @@ wireless_interface_status(struct wireless_interface *iface, struct blob_buf *b)
 		blobmsg_add_string(b, "ifname", iface->ifname);
 	put_container(b, iface->config, "config");
 	j = blobmsg_open_array(b, "vlans");
-	vlist_for_each_element(&iface->wdev->vlans, vlan, node)
-		if (!strcmp(iface->name, vlan->vif))
-			wireless_vlan_status(vlan, b);
+	list_for_each_entry(vlan, &iface->vlans, vif_list)
+		wireless_vlan_status(vlan, b);
 	blobmsg_close_array(b, j);
 	j = blobmsg_open_array(b, "stations");
-	vlist_for_each_element(&iface->wdev->stations, sta, node)
-		if (!strcmp(iface->name, sta->vif))
-			wireless_station_status(sta, b);
+	list_for_each_entry(sta, &iface->stations, vif_list)
+		wireless_station_status(sta, b);
 	blobmsg_close_array(b, j);
 	blobmsg_close_table(b, i);
 }
 
-void
-wireless_device_status(struct wireless_device *wdev, struct blob_buf *b)
+static unsigned int
+wireless_device_status_flags(struct wireless_device *wdev)
+{
+	return wdev->state | (wdev->autostart << 8) | (wdev->disabled << 9) |
+	       (wdev->retry_setup_failed << 10);
+}
+
+static void
+__wireless_device_status(struct wireless_device *wdev, struct blob_buf *b)
 {
 	struct wireless_interface *iface;
 	void *c, *i;
@@ -1169,6 +1310,7 @@ wireless_device_status(struct wireless_device *wdev, struct blob_buf *b)
 	blobmsg_add_u8(b, "retry_setup_failed", wdev->retry_setup_failed);
 	put_container(b, wdev->config, "config");
 
+	wireless_device_link_vifs(wdev);
 	i = blobmsg_open_array(b, "interfaces");
 	vlist_for_each_element(&wdev->interfaces, iface, node)
 		wireless_interface_status(iface, b);
@@ -1176,8 +1318,57 @@ wireless_device_status(struct wireless_device *wdev, struct blob_buf *b)
 	blobmsg_close_table(b, c);
 }
 
+/*
+ * The status reply of a device is kept serialized until the device, one of
+ * its vifs, vlans or stations changes, or its state flags differ from the
+ * ones it was built with. Every rebuild takes a new generation.
+ */
+static void
+wireless_device_status_refresh(struct wireless_device *wdev)
+{
+	unsigned int flags = wireless_device_status_flags(wdev);
+
+	if (wdev->status_cache && wdev->status_flags == flags)
+		return;
+
+	blob_buf_init(&status_buf, 0);
+	__wireless_device_status(wdev, &status_buf);
+	free(wdev->status_cache);
+	wdev->status_cache = blob_memdup(blob_data(status_buf.head));
+	wdev->status_flags = flags;
+	wdev->status_gen = ++status_gen;
+}
+
 void
-wireless_device_get_validate(struct wireless_device *wdev, struct blob_buf *b)
+wireless_device_status(struct wireless_device *wdev, struct blob_buf *b)
+{
+	wireless_device_status_refresh(wdev);
+	if (wdev->status_cache)
+		blobmsg_add_blob(b, wdev->status_cache);
+	else
+		__wireless_device_status(wdev, b);
+}
+
+/*
+ * Generation of the status of one device, or of all devices when wdev is
+ * NULL. It changes whenever the corresponding status reply would.
+ */
+unsigned int
+wireless_status_generation(struct wireless_device *wdev)
+{
+	if (wdev) {
+		wireless_device_status_refresh(wdev);
+		return wdev->status_gen;
+	}
+
+	vlist_for_each_element(&wireless_devices, wdev, node)
+		wireless_device_status_refresh(wdev);
+
+	return status_gen;
+}
+
+static void
+__wireless_device_get_validate(struct wireless_device *wdev, struct blob_buf *b)
 {
 	struct uci_blob_param_list *p;
 	void *c, *d;
@@ -1200,6 +1391,22 @@ wireless_device_get_validate(struct wireless_device *wdev, struct blob_buf *b)
 	blobmsg_close_table(b, c);
 }
 
+/* only depends on the driver, which never changes for a device */
+void
+wireless_device_get_validate(struct wireless_device *wdev, struct blob_buf *b)
+{
+	if (!wdev->validate_cache) {
+		blob_buf_init(&status_buf, 0);
+		__wireless_device_get_validate(wdev, &status_buf);
+		wdev->validate_cache = blob_memdup(blob_data(status_buf.head));
+	}
+
+	if (wdev->validate_cache)
+		blobmsg_add_blob(b, wdev->validate_cache);
+	else
+		__wireless_device_get_validate(wdev, b);
+}
+
 static void
 wireless_interface_set_data(struct wireless_interface *vif)
 {
@@ -1415,6 +1622,7 @@ wireless_device_notify(struct wireless_device *wdev, struct blob_attr *data,
 			return UBUS_STATUS_INVALID_ARGUMENT;
 
 		*pdata = blob_memdup(cur);
+		wireless_device_invalidate(wdev);
 		if (vif)
 			wireless_interface_set_data(vif);
 		else if (vlan)
@@ -1433,11 +1641,306 @@ wireless_device_notify(struct wireless_device *wdev, struct blob_attr *data,
 	return 0;
 }
 
+static void
+wireless_save_data(struct blob_buf *buf, struct blob_attr *data, const char *name)
+{
+	if (!data)
+		return;
+
+	blobmsg_add_field(buf, BLOBMSG_TYPE_TABLE, name,
+			  blobmsg_data(data), blobmsg_data_len(data));
+}
+
+/*
+ * Record the handler data and processes of all running devices, so that
+ * the next instance can adopt them instead of running teardown/setup.
+ */
 void
-wireless_start_pending(void)
+wireless_save_state(void)
 {
 	struct wireless_device *wdev;
+	struct wireless_interface *vif;
+	struct wireless_vlan *vlan;
+	struct wireless_process *proc;
+	const char *tmp = DEFAULT_WIRELESS_STATE ".tmp";
+	char crc[9], *str;
+	void *c, *l, *t;
+	bool empty = true;
+	FILE *f;
+	int ret;
+
+	blob_buf_init(&state_buf, 0);
+	saved_state = NULL;
+
+	vlist_for_each_element(&wireless_devices, wdev, node) {
+		if (wdev->state != IFS_UP)
+			continue;
 
-	vlist_for_each_element(&wireless_devices, wdev, node)
+		empty = false;
+		c = blobmsg_open_table(&state_buf, wdev->name);
+
+		snprintf(crc, sizeof(crc), "%08x", wdev->setup_crc);
+		blobmsg_add_string(&state_buf, "config", crc);
+		wireless_save_data(&state_buf, wdev->data, "data");
+
+		l = blobmsg_open_table(&state_buf, "interfaces");
+		vlist_for_each_element(&wdev->interfaces, vif, node)
+			wireless_save_data(&state_buf, vif->data, vif->name);
+		blobmsg_close_table(&state_buf, l);
+
+		l = blobmsg_open_table(&state_buf, "vlans");
+		vlist_for_each_element(&wdev->vlans, vlan, node)
+			wireless_save_data(&state_buf, vlan->data, vlan->name);
+		blobmsg_close_table(&state_buf, l);
+
+		l = blobmsg_open_array(&state_buf, "processes");
+		list_for_each_entry(proc, &wdev->script_proc, list) {
+			t = blobmsg_open_table(&state_buf, NULL);
+			blobmsg_add_u32(&state_buf, "pid", proc->pid);
+			blobmsg_add_string(&state_buf, "exe", proc->exe);
+			blobmsg_add_u8(&state_buf, "required", proc->required);
+			blobmsg_close_table(&state_buf, t);
+		}
+		blobmsg_close_array(&state_buf, l);
+
+		blobmsg_close_table(&state_buf, c);
+	}
+
+	str = empty ? NULL : blobmsg_format_json(state_buf.head, true);
+	blob_buf_free(&state_buf);
+	if (!str)
+		return;
+
+	f = fopen(tmp, "w");
+	if (!f) {
+		free(str);
+		return;
+	}
+
+	ret = fputs(str, f);
+	if (fclose(f) || ret < 0 || rename(tmp, DEFAULT_WIRELESS_STATE))
+		unlink(tmp);
+
+	free(str);
+}
+
+static struct blob_attr *
+wireless_saved_data(struct blob_attr *list, const char *name)
+{
+	struct blob_attr *cur;
+	int rem;
+
+	if (!list)
+		return NULL;
+
+	blobmsg_for_each_attr(cur, list, rem)
+		if (blobmsg_type(cur) == BLOBMSG_TYPE_TABLE &&
+		    !strcmp(blobmsg_name(cur), name))
+			return cur;
+
+	return NULL;
+}
+
+static bool
+wireless_saved_ifname_exists(struct blob_attr *data)
+{
+	static const struct blobmsg_policy ifname_policy = {
+		.name = "ifname", .type = BLOBMSG_TYPE_STRING
+	};
+	struct blob_attr *cur;
+
+	blobmsg_parse(&ifname_policy, 1, &cur, blobmsg_data(data), blobmsg_data_len(data));
+
+	return !cur || if_nametoindex(blobmsg_get_string(cur));
+}
+
+/*
+ * saved vif and vlan entries are named after their section, the live data
+ * is a table named "data" like the one received from the handler
+ */
+static struct blob_attr *
+wireless_restore_data(struct blob_attr *data)
+{
+	struct blob_attr *ret;
+	struct blob_buf b;
+
+	memset(&b, 0, sizeof(b));
+	blob_buf_init(&b, 0);
+	blobmsg_add_field(&b, BLOBMSG_TYPE_TABLE, "data",
+			  blobmsg_data(data), blobmsg_data_len(data));
+	ret = blob_memdup(blob_data(b.head));
+	blob_buf_free(&b);
+
+	return ret;
+}
+
+/*
+ * Take over a device that the previous instance left running, provided
+ * its config is unchanged, its required processes are still alive and
+ * all of its vif netdevs still exist.
+ */
+static bool
+wireless_device_adopt(struct wireless_device *wdev)
+{
+	enum {
+		STATE_ATTR_CONFIG,
+		STATE_ATTR_DATA,
+		STATE_ATTR_INTERFACES,
+		STATE_ATTR_VLANS,
+		STATE_ATTR_PROCESSES,
+		__STATE_ATTR_MAX
+	};
+	static const struct blobmsg_policy state_policy[__STATE_ATTR_MAX] = {
+		[STATE_ATTR_CONFIG] = { .name = "config", .type = BLOBMSG_TYPE_STRING },
+		[STATE_ATTR_DATA] = { .name = "data", .type = BLOBMSG_TYPE_TABLE },
+		[STATE_ATTR_INTERFACES] = { .name = "interfaces", .type = BLOBMSG_TYPE_TABLE },
+		[STATE_ATTR_VLANS] = { .name = "vlans", .type = BLOBMSG_TYPE_TABLE },
+		[STATE_ATTR_PROCESSES] = { .name = "processes", .type = BLOBMSG_TYPE_ARRAY },
+	};
+	static const struct blobmsg_policy proc_policy[] = {
+		{ .name = "pid", .type = BLOBMSG_TYPE_INT32 },
+		{ .name = "exe", .type = BLOBMSG_TYPE_STRING },
+		{ .name = "required", .type = BLOBMSG_TYPE_BOOL },
+	};
+	struct blob_attr *tb[__STATE_ATTR_MAX], *ptb[ARRAY_SIZE(proc_policy)];
+	struct blob_attr *state = NULL, *cfg, *cur, *data;
+	struct wireless_interface *vif;
+	struct wireless_vlan *vlan;
+	char crc[9];
+	int rem;
+
+	if (!saved_state || wdev->disabled || !wdev->autostart ||
+	    wdev->retry_setup_failed || wdev->state != IFS_DOWN)
+		return false;
+
+	blob_for_each_attr(cur, saved_state, rem)
+		if (!strcmp(blobmsg_name(cur), wdev->name))
+			state = cur;
+
+	if (!state || blobmsg_type(state) != BLOBMSG_TYPE_TABLE)
+		return false;
+
+	blobmsg_parse(state_policy, __STATE_ATTR_MAX, tb,
+		      blobmsg_data(state), blobmsg_data_len(state));
+	if (!tb[STATE_ATTR_CONFIG])
+		return false;
+
+	cfg = wireless_device_get_config(wdev);
+	snprintf(crc, sizeof(crc), "%08x", crc32_update(0, cfg, blob_pad_len(cfg)));
+	if (strcmp(crc, blobmsg_get_string(tb[STATE_ATTR_CONFIG]))) {
+		D(WIRELESS, "Wireless device '%s' config changed, not adopting\n", wdev->name);
+		return false;
+	}
+
+	blobmsg_for_each_attr(cur, tb[STATE_ATTR_PROCESSES], rem) {
+		blobmsg_parse(proc_policy, ARRAY_SIZE(proc_policy), ptb,
+			      blobmsg_data(cur), blobmsg_data_len(cur));
+		if (!ptb[0] || !ptb[1])
+			return false;
+
+		if (ptb[2] && blobmsg_get_bool(ptb[2]) &&
+		    !check_pid_path(blobmsg_get_u32(ptb[0]), blobmsg_get_string(ptb[1])))
+			return false;
+	}
+
+	vlist_for_each_element(&wdev->interfaces, vif, node) {
+		data = wireless_saved_data(tb[STATE_ATTR_INTERFACES], vif->name);
+		if (data && !wireless_saved_ifname_exists(data))
+			return false;
+	}
+
+	vlist_for_each_element(&wdev->vlans, vlan, node) {
+		data = wireless_saved_data(tb[STATE_ATTR_VLANS], vlan->name);
+		if (data && !wireless_saved_ifname_exists(data))
+			return false;
+	}
+
+	netifd_log_message(L_NOTICE, "Adopting running wireless device '%s'\n", wdev->name);
+
+	if (tb[STATE_ATTR_DATA])
+		wdev->data = blob_memdup(tb[STATE_ATTR_DATA]);
+
+	vlist_for_each_element(&wdev->interfaces, vif, node) {
+		data = wireless_saved_data(tb[STATE_ATTR_INTERFACES], vif->name);
+		if (!data)
+			continue;
+
+		vif->data = wireless_restore_data(data);
+		wireless_interface_set_data(vif);
+	}
+
+	vlist_for_each_element(&wdev->vlans, vlan, node) {
+		data = wireless_saved_data(tb[STATE_ATTR_VLANS], vlan->name);
+		if (!data)
+			continue;
+
+		vlan->data = wireless_restore_data(data);
+		wireless_vlan_set_data(vlan);
+	}
+
+	/* dead processes that were not required are dropped by the next check */
+	blobmsg_for_each_attr(cur, tb[STATE_ATTR_PROCESSES], rem)
+		wireless_device_add_process(wdev, cur);
+
+	wireless_device_invalidate(wdev);
+	wdev->setup_crc = crc32_update(0, cfg, blob_pad_len(cfg));
+	wdev->retry = WIRELESS_SETUP_RETRY;
+	wdev->state = IFS_SETUP;
+	wireless_device_mark_up(wdev);
+
+	return true;
+}
+
+static void
+wireless_device_start(struct wireless_device *wdev)
+{
+	if (!wireless_device_adopt(wdev))
 		__wireless_device_set_up(wdev, 0);
 }
+
+static int
+wdev_start_cmp(const void *k1, const void *k2)
+{
+	const struct wireless_device *w1 = *(const struct wireless_device **) k1;
+	const struct wireless_device *w2 = *(const struct wireless_device **) k2;
+
+	if (w1->start_priority != w2->start_priority)
+		return w1->start_priority > w2->start_priority ? -1 : 1;
+
+	return strcmp(w1->name, w2->name);
+}
+
+void
+wireless_start_pending(void)
+{
+	struct wireless_device *wdev, **list;
+	int i, n = 0;
+
+	vlist_for_each_element(&wireless_devices, wdev, node)
+		n++;
+
+	list = calloc(n, sizeof(*list));
+	if (!list) {
+		vlist_for_each_element(&wireless_devices, wdev, node)
+			wireless_device_start(wdev);
+		goto out;
+	}
+
+	n = 0;
+	vlist_for_each_element(&wireless_devices, wdev, node)
+		list[n++] = wdev;
+
+	/* highest start_priority first, like interface_start_pending */
+	qsort(list, n, sizeof(*list), wdev_start_cmp);
+	for (i = 0; i < n; i++)
+		wireless_device_start(list[i]);
+
+	free(list);
+
+out:
+	/* only the first start after launch may adopt devices */
+	if (saved_state) {
+		blob_buf_free(&state_buf);
+		saved_state = NULL;
+	}
+}
@@ -60,10 +60,24 @@ struct wireless_device {
 	struct blob_attr *prev_config;
 	struct blob_attr *config;
 	struct blob_attr *data;
+	/* crc of the handler config of the last setup run */
+	uint32_t setup_crc;
+
+	/* assembled handler config, dropped when a vif, vlan or station changes */
+	struct blob_attr *config_cache;
+	uint32_t config_cache_bridges;
+	bool vif_links_valid;
+
+	/* serialized status and validate replies, see wireless_device_status */
+	struct blob_attr *status_cache;
+	struct blob_attr *validate_cache;
+	unsigned int status_flags;
+	unsigned int status_gen;
 
 	bool autostart;
 	bool disabled;
 	bool retry_setup_failed;
+	int start_priority;
 
 	enum interface_state state;
 	enum interface_config_state config_state;
@@ -90,6 +104,10 @@ struct wireless_interface {
 	struct blob_attr *network;
 	bool isolate;
 	bool ap_mode;
+
+	/* vlans and stations of this vif, see wireless_device_link_vifs */
+	struct list_head vlans;
+	struct list_head stations;
 };
 
 struct wireless_vlan {
@@ -99,6 +117,7 @@ struct wireless_vlan {
 
 	struct wireless_device *wdev;
 	char *vif;
+	struct list_head vif_list;
 
 	struct blob_attr *config;
 	struct blob_attr *data;
@@ -115,6 +134,7 @@ struct wireless_station {
 
 	struct wireless_device *wdev;
 	char *vif;
+	struct list_head vif_list;
 
 	struct blob_attr *config;
 	struct blob_attr *data;
@@ -135,6 +155,7 @@ void wireless_device_set_down(struct wireless_device *wdev);
 void wireless_device_reconf(struct wireless_device *wdev);
 void wireless_device_status(struct wireless_device *wdev, struct blob_buf *b);
 void wireless_device_get_validate(struct wireless_device *wdev, struct blob_buf *b);
+unsigned int wireless_status_generation(struct wireless_device *wdev);
 struct wireless_interface* wireless_interface_create(struct wireless_device *wdev, struct blob_attr *data, const char *section);
 void wireless_vlan_create(struct wireless_device *wdev, char *vif, struct blob_attr *data, const char *section);
 void wireless_station_create(struct wireless_device *wdev, char *vif, struct blob_attr *data, const char *section);
@@ -142,6 +163,7 @@ int wireless_device_notify(struct wireless_device *wdev, struct blob_attr *data,
 			   struct ubus_request_data *req);
 
 void wireless_start_pending(void);
+void wireless_save_state(void);
 void wireless_init(void);
 
 #endif